@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <QFile>
+#include <QElapsedTimer>
+
+#include "archiveBenchmark.h"
+#include "archiveFileWriter.h"
+#include "pipelineMetrics.h"
+
+#define  BENCHMARK_PACKET_BYTES     (32*1024)   // Typical size of HD keyframe fragment written by muxer
+
+ErrorCode ArchiveBenchmark::Run(int sizeMB)
+{
+    DataDirectory*      pDataDirectory = DataDirectoryInstance::instance();
+    QString             fileName = pDataDirectory->pipelineParams.archivePath + "/archive_benchmark.tmp";
+    qint64              totalBytes = (qint64)sizeMB * 1024 * 1024;
+    QByteArray          packet(BENCHMARK_PACKET_BYTES, Qt::Uninitialized);
+    ArchiveFileWriter*  pWriter;
+    QElapsedTimer       timer;
+    QElapsedTimer       writeTimer;
+    qint64              maxStallUs = 0;
+    qint64              written;
+    qint64              elapsedUs;
+    bool                ok;
+    int                 i;
+
+    for (i = 0; i < packet.size(); i++)
+    {
+        packet[i] = (char)(rand() & 0xFF);
+    }
+
+    pWriter = new ArchiveFileWriter(pDataDirectory->recordParams.writeBlockKB,
+                                    pDataDirectory->recordParams.writeQueueBlocks);
+
+    printf("Archive writer: %d MB to %s, %d KB blocks, %d queued blocks\n",
+           sizeMB, fileName.toUtf8().constData(),
+           pDataDirectory->recordParams.writeBlockKB, pDataDirectory->recordParams.writeQueueBlocks);
+
+    if (CAMERA_PIPELINE_OK != pWriter->Open(fileName, totalBytes))
+    {
+        printf("Failed to open %s (see log for error)\n", fileName.toUtf8().constData());
+        delete pWriter;
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    timer.start();
+    for (written = 0; written < totalBytes; written += packet.size())
+    {
+        writeTimer.start();
+        avio_write(pWriter->IoContext(), (const unsigned char *)packet.constData(), packet.size());
+        maxStallUs = qMax(maxStallUs, writeTimer.nsecsElapsed() / 1000);
+    }
+
+    // Close waits until all queued blocks are on disk
+    pWriter->Close();
+    elapsedUs = timer.nsecsElapsed() / 1000;
+    ok = (pWriter->WrittenOffset() >= written);
+    delete pWriter;
+
+    QFile::remove(fileName);
+
+    if (!ok)
+    {
+        printf("Archive write failed (see log for error)\n");
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    printf("%-24s %8lld MB in %8lld ms, %10.1f MB/s\n", "Archive written",
+           (long long)(written / (1024 * 1024)), (long long)(elapsedUs / 1000),
+           (elapsedUs > 0) ? ((double)written / elapsedUs) : 0.0);
+    printf("%-24s %10.1f MB/s\n", "pwrite() throughput",
+           PipelineMetrics::instance()->Value("archive_write_throughput_mbytes_per_sec"));
+    printf("%-24s %8lld us\n", "Longest muxer stall", (long long)maxStallUs);
+
+    return CAMERA_PIPELINE_OK;
+}
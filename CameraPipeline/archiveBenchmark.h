@@ -0,0 +1,18 @@
+#ifndef ARCHIVEBENCHMARK_H
+#define ARCHIVEBENCHMARK_H
+
+#include "cameraPipelineCommon.h"
+
+/*
+ * Throughput benchmark of async archive writer
+ * Data is written to archive folder through ArchiveFileWriter AVIO context in packet-sized chunks
+ * (the same way muxer does) with configured block size and queue length. Total and pwrite-only
+ * throughput and the longest muxer side stall are reported. Benchmark file is removed after the run.
+ */
+class ArchiveBenchmark
+{
+public:
+    static ErrorCode Run(int sizeMB);
+};
+
+#endif // ARCHIVEBENCHMARK_H
@@ -0,0 +1,328 @@
+#include <QElapsedTimer>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "archiveFileWriter.h"
+#include "pipelineMetrics.h"
+
+static int ArchiveWriteCallback(void* opaque, uint8_t* buf, int size)
+{
+    return reinterpret_cast<ArchiveFileWriter*>(opaque)->Write(buf, size);
+}
+
+static int64_t ArchiveSeekCallback(void* opaque, int64_t offset, int whence)
+{
+    return reinterpret_cast<ArchiveFileWriter*>(opaque)->Seek(offset, whence);
+}
+
+ArchiveFileWriter::ArchiveFileWriter(int blockSizeKB, int maxQueuedBlocks) :
+    QThread(NULL),
+    m_fd(-1),
+    m_pAVIOCtx(NULL),
+    m_pAvioCtxBuffer(NULL),
+    m_position(0),
+    m_fileSize(0),
+    m_writing(false),
+    m_stop(false),
+    m_failed(0),
+    m_writtenOffset(0),
+    m_bytesWritten(0),
+    m_writeTimeUs(0)
+{
+    // Block size is rounded up to alignment
+    m_blockSize = qMax(1, (blockSizeKB * 1024 + ARCHIVE_WRITE_ALIGNMENT - 1) / ARCHIVE_WRITE_ALIGNMENT) * ARCHIVE_WRITE_ALIGNMENT;
+    m_maxQueuedBlocks = qMax(1, maxQueuedBlocks);
+
+    m_currentBlock.pData = NULL;
+    m_currentBlock.size = 0;
+    m_currentBlock.fileOffset = 0;
+
+    start();
+}
+
+ArchiveFileWriter::~ArchiveFileWriter()
+{
+    Close();
+
+    m_mutex.lock();
+    m_stop = true;
+    m_queueChanged.wakeAll();
+    m_mutex.unlock();
+    wait();
+
+    if (NULL != m_currentBlock.pData)
+    {
+        free(m_currentBlock.pData);
+    }
+    Q_FOREACH (uint8_t* pBlock, m_freeBlocks)
+    {
+        free(pBlock);
+    }
+}
+
+ErrorCode ArchiveFileWriter::Open(QString fileName, qint64 preallocateBytes)
+{
+    Close();
+
+    m_fd = open(QFile::encodeName(fileName).constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0)
+    {
+        ERROR_MESSAGE2(ERR_TYPE_ERROR, "ArchiveFileWriter", "Failed to open %s: %s",
+                       fileName.toUtf8().constData(), strerror(errno));
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    // Reserve space for the whole segment in one extent (file size is not changed)
+    if (preallocateBytes > 0 && 0 != fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, preallocateBytes))
+    {
+        DEBUG_MESSAGE1("ArchiveFileWriter", "fallocate() failed: %s", strerror(errno));
+    }
+
+    m_pAvioCtxBuffer = (uint8_t *)av_malloc(ARCHIVE_AVIO_BUFSIZE);
+    if (NULL == m_pAvioCtxBuffer)
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "ArchiveFileWriter", "Failed to allocate avio buffer");
+        Close();
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    m_pAVIOCtx = avio_alloc_context(m_pAvioCtxBuffer, ARCHIVE_AVIO_BUFSIZE, 1, this, NULL,
+                                    &ArchiveWriteCallback, &ArchiveSeekCallback);
+    if (NULL == m_pAVIOCtx)
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "ArchiveFileWriter", "Failed to allocate avio context");
+        av_freep(&m_pAvioCtxBuffer);
+        Close();
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    m_fileName = fileName;
+    m_position = 0;
+    m_fileSize = 0;
+    m_failed.storeRelease(0);
+    m_mutex.lock();
+    m_writtenOffset = 0;
+    m_mutex.unlock();
+    m_currentBlock.size = 0;
+    m_currentBlock.fileOffset = 0;
+    return CAMERA_PIPELINE_OK;
+}
+
+void ArchiveFileWriter::Close()
+{
+    if (NULL != m_pAVIOCtx)
+    {
+        avio_flush(m_pAVIOCtx);
+        av_freep(&m_pAVIOCtx->buffer);
+        avio_context_free(&m_pAVIOCtx);
+        m_pAvioCtxBuffer = NULL;
+    }
+
+    if (m_fd >= 0)
+    {
+        SubmitBlock();
+        WaitQueueEmpty();
+
+        // Release preallocated space beyond actual data
+        if (0 != ftruncate(m_fd, m_fileSize))
+        {
+            DEBUG_MESSAGE1("ArchiveFileWriter", "ftruncate() failed: %s", strerror(errno));
+        }
+        ::close(m_fd);
+        m_fd = -1;
+
+        if (m_failed.loadAcquire())
+        {
+            ERROR_MESSAGE1(ERR_TYPE_ERROR, "ArchiveFileWriter", "Archive file %s is incomplete",
+                           m_fileName.toUtf8().constData());
+        }
+    }
+}
+
+qint64 ArchiveFileWriter::WrittenOffset()
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_writtenOffset;
+}
+
+int ArchiveFileWriter::Write(uint8_t* pData, int size)
+{
+    int written = 0;
+
+    while (written < size)
+    {
+        if (NULL == m_currentBlock.pData)
+        {
+            m_currentBlock.pData = AllocateBlock();
+        }
+
+        if (0 == m_currentBlock.size)
+        {
+            m_currentBlock.fileOffset = m_position;
+        }
+
+        int chunk = qMin(size - written, m_blockSize - m_currentBlock.size);
+        memcpy(m_currentBlock.pData + m_currentBlock.size, pData + written, chunk);
+        m_currentBlock.size += chunk;
+        m_position += chunk;
+        written += chunk;
+
+        if (m_currentBlock.size == m_blockSize)
+        {
+            SubmitBlock();
+        }
+    }
+
+    m_fileSize = qMax(m_fileSize, m_position);
+    return m_failed.loadAcquire() ? AVERROR(EIO) : size;
+}
+
+int64_t ArchiveFileWriter::Seek(int64_t offset, int whence)
+{
+    if (whence & AVSEEK_SIZE)
+    {
+        return m_fileSize;
+    }
+
+    switch (whence & ~AVSEEK_FORCE)
+    {
+        case SEEK_SET: break;
+        case SEEK_CUR: offset += m_position; break;
+        case SEEK_END: offset += m_fileSize; break;
+        default: return AVERROR(EINVAL);
+    }
+
+    if (offset < 0)
+    {
+        return AVERROR(EINVAL);
+    }
+
+    // Everything written before seek goes to disk, new block starts at new position
+    SubmitBlock();
+    WaitQueueEmpty();
+    m_position = offset;
+    return offset;
+}
+
+void ArchiveFileWriter::SubmitBlock()
+{
+    if (NULL == m_currentBlock.pData || 0 == m_currentBlock.size)
+    {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    // Bounded memory: muxer waits until I/O thread catches up
+    if (m_queue.size() >= m_maxQueuedBlocks)
+    {
+        PipelineMetrics::instance()->AddCounter("archive_write_stalls_total");
+        while (m_queue.size() >= m_maxQueuedBlocks)
+        {
+            m_queueChanged.wait(&m_mutex);
+        }
+    }
+
+    m_queue.append(m_currentBlock);
+    m_queueChanged.wakeAll();
+
+    m_currentBlock.pData = NULL;
+    m_currentBlock.size = 0;
+}
+
+void ArchiveFileWriter::WaitQueueEmpty()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_queue.isEmpty() || m_writing)
+    {
+        m_queueChanged.wait(&m_mutex);
+    }
+}
+
+uint8_t* ArchiveFileWriter::AllocateBlock()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_freeBlocks.isEmpty())
+    {
+        return m_freeBlocks.takeLast();
+    }
+
+    void* pBlock = NULL;
+    if (0 != posix_memalign(&pBlock, ARCHIVE_WRITE_ALIGNMENT, m_blockSize))
+    {
+        qFatal("ArchiveFileWriter: failed to allocate %d bytes", m_blockSize);
+    }
+    return (uint8_t *)pBlock;
+}
+
+void ArchiveFileWriter::run()
+{
+    QElapsedTimer timer;
+
+    m_mutex.lock();
+    forever
+    {
+        while (m_queue.isEmpty() && !m_stop)
+        {
+            m_queueChanged.wait(&m_mutex);
+        }
+
+        if (m_queue.isEmpty())
+        {
+            break;
+        }
+
+        WriteBlock block = m_queue.takeFirst();
+        m_writing = true;
+        m_queueChanged.wakeAll();
+        m_mutex.unlock();
+
+        qint64 done = 0;
+        timer.start();
+        while (done < block.size)
+        {
+            ssize_t res = pwrite(m_fd, block.pData + done, block.size - done, block.fileOffset + done);
+            if (res < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else if (res <= 0)
+            {
+                ERROR_MESSAGE1(ERR_TYPE_ERROR, "ArchiveFileWriter", "pwrite() failed: %s", strerror(errno));
+                m_failed.storeRelease(1);
+                break;
+            }
+            done += res;
+        }
+
+        // Sustained write throughput in MB/s (bytes per microsecond, time spent in pwrite only)
+        m_writeTimeUs += timer.nsecsElapsed() / 1000;
+        m_bytesWritten += done;
+
+        PipelineMetrics* pMetrics = PipelineMetrics::instance();
+        pMetrics->AddCounter("archive_write_bytes_total", done);
+        if (m_writeTimeUs > 0)
+        {
+            pMetrics->SetGauge("archive_write_throughput_mbytes_per_sec", (double)m_bytesWritten / m_writeTimeUs);
+        }
+
+        m_mutex.lock();
+        // Blocks are written in order (seeks drain the queue), so written data is contiguous
+        if (done == block.size && !m_failed.loadAcquire())
+        {
+            m_writtenOffset = qMax(m_writtenOffset, block.fileOffset + done);
+        }
+        m_freeBlocks.append(block.pData);
+        m_writing = false;
+        pMetrics->SetGauge("archive_write_queue_blocks", m_queue.size());
+        m_queueChanged.wakeAll();
+    }
+    m_mutex.unlock();
+}
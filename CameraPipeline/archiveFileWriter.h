@@ -0,0 +1,84 @@
+#ifndef ARCHIVEFILEWRITER_H
+#define ARCHIVEFILEWRITER_H
+
+#include <QList>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QThread>
+#include <QString>
+#include <QWaitCondition>
+
+#include "cameraPipelineCommon.h"
+
+#define  ARCHIVE_WRITE_ALIGNMENT    4096        // Block memory alignment and size granularity
+#define  ARCHIVE_AVIO_BUFSIZE       (64*1024)   // Muxer side avio buffer
+
+/*
+ * Custom AVIO output for archive segments
+ * Muxer output is collected into large aligned blocks, which are written with pwrite()
+ * from dedicated I/O thread. Number of queued blocks is limited, so memory usage is bounded
+ * (muxer waits, if disk can't keep up). Segment space is preallocated at open to reduce fragmentation,
+ * unused preallocated space is released when file is closed.
+ *
+ * Seeking (moov size updates etc.) drains the queue first, so the file is consistent for readers.
+ * I/O thread publishes offset, up to which data is in file, so muxer thread never waits for disk
+ * to know what readers can see. Writer thread is reused for all segments.
+ */
+class ArchiveFileWriter : public QThread
+{
+    Q_OBJECT
+public:
+    ArchiveFileWriter(int blockSizeKB, int maxQueuedBlocks);
+    ~ArchiveFileWriter();
+
+    ErrorCode       Open(QString fileName, qint64 preallocateBytes);
+    void            Close();                    /// Flush all data and close file
+    qint64          WrittenOffset();            /// File data before this offset is written (does not wait)
+
+    AVIOContext*    IoContext() { return m_pAVIOCtx; }
+    qint64          FileSize() { return m_fileSize; }
+
+    // AVIO callbacks
+    int             Write(uint8_t* pData, int size);
+    int64_t         Seek(int64_t offset, int whence);
+
+protected:
+    void            run();
+
+private:
+    struct WriteBlock
+    {
+        uint8_t*    pData;
+        int         size;
+        qint64      fileOffset;
+    };
+
+    int                 m_fd;
+    QString             m_fileName;
+    AVIOContext*        m_pAVIOCtx;
+    uint8_t*            m_pAvioCtxBuffer;
+
+    int                 m_blockSize;
+    int                 m_maxQueuedBlocks;
+    WriteBlock          m_currentBlock;         /// Block being filled by muxer
+    qint64              m_position;             /// Logical file position
+    qint64              m_fileSize;             /// Logical file size
+
+    QMutex              m_mutex;
+    QWaitCondition      m_queueChanged;
+    QList<WriteBlock>   m_queue;                /// Blocks waiting for I/O thread
+    QList<uint8_t*>     m_freeBlocks;           /// Reusable block buffers
+    bool                m_writing;              /// I/O thread is writing a block
+    bool                m_stop;
+    QAtomicInt          m_failed;               /// Write error happened for current file (set by I/O thread)
+    qint64              m_writtenOffset;        /// End of data written by I/O thread (stops at first failure)
+
+    qint64              m_bytesWritten;         /// Throughput statistics (for metrics)
+    qint64              m_writeTimeUs;
+
+    void                SubmitBlock();          /// Pass current block to I/O thread
+    void                WaitQueueEmpty();
+    uint8_t*            AllocateBlock();
+};
+
+#endif // ARCHIVEFILEWRITER_H
@@ -0,0 +1,486 @@
+#include <QDir>
+#include <QFileInfo>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+#include "archiveHttpServer.h"
+#include "archiveIndex.h"
+#include "pipelineMetrics.h"
+
+ArchiveHttpServer::ArchiveHttpServer(QString rootFolder, QString cameraFolder, QString address, int port, int ioThreads, QObject* parent) :
+    QTcpServer(parent),
+    m_rootFolder(QDir::cleanPath(rootFolder)),
+    m_cameraFolder(cameraFolder),
+    m_nextThread(0)
+{
+    QHostAddress hostAddress(address);
+
+    for (int i = 0; i < qMax(1, ioThreads); i++)
+    {
+        QThread* pThread = new QThread;
+        pThread->start();
+        m_ioThreads.append(pThread);
+    }
+
+    if (hostAddress.isNull())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "ArchiveHttpServer", "Invalid address %s, listening on localhost",
+                       address.toUtf8().constData());
+        hostAddress = QHostAddress::LocalHost;
+    }
+
+    if (!listen(hostAddress, port))
+    {
+        ERROR_MESSAGE2(ERR_TYPE_ERROR, "ArchiveHttpServer", "Failed to listen on port %d: %s",
+                       port, errorString().toUtf8().constData());
+    }
+    else
+    {
+        ERROR_MESSAGE4(ERR_TYPE_MESSAGE, "ArchiveHttpServer", "Serving %s/%s on %s:%d",
+                       m_rootFolder.toUtf8().constData(), m_cameraFolder.toUtf8().constData(),
+                       hostAddress.toString().toUtf8().constData(), port);
+    }
+}
+
+ArchiveHttpServer::~ArchiveHttpServer()
+{
+    close();
+
+    // Remaining connections are deleted when their thread finishes
+    Q_FOREACH (QThread* pThread, m_ioThreads)
+    {
+        pThread->quit();
+        pThread->wait();
+        delete pThread;
+    }
+    m_ioThreads.clear();
+}
+
+void ArchiveHttpServer::incomingConnection(qintptr socketDescriptor)
+{
+    QThread*                pThread = m_ioThreads.at(m_nextThread);
+    ArchiveHttpConnection*  pConnection = new ArchiveHttpConnection((int)socketDescriptor, m_rootFolder, m_cameraFolder);
+
+    PipelineMetrics::instance()->AddCounter("archive_http_connections_total");
+
+    m_nextThread = (m_nextThread + 1) % m_ioThreads.size();
+
+    pConnection->moveToThread(pThread);
+    QObject::connect(pThread, SIGNAL(finished()), pConnection, SLOT(deleteLater()));
+    QMetaObject::invokeMethod(pConnection, "Start", Qt::QueuedConnection);
+}
+
+ArchiveHttpConnection::ArchiveHttpConnection(int socketDescriptor, QString rootFolder, QString cameraFolder) :
+    QObject(NULL),
+    m_socket(socketDescriptor),
+    m_rootFolder(rootFolder),
+    m_cameraFolder(cameraFolder),
+    m_pReadNotifier(NULL),
+    m_pWriteNotifier(NULL),
+    m_pIdleTimer(NULL),
+    m_fileDescriptor(-1),
+    m_sending(false),
+    m_closeAfterResponse(false)
+{
+
+}
+
+ArchiveHttpConnection::~ArchiveHttpConnection()
+{
+    // Notifiers should not watch closed descriptor
+    SAFE_DELETE(m_pReadNotifier);
+    SAFE_DELETE(m_pWriteNotifier);
+    SAFE_DELETE(m_pIdleTimer);
+
+    CloseFile();
+    if (m_socket >= 0)
+    {
+        ::close(m_socket);
+    }
+}
+
+void ArchiveHttpConnection::Start()
+{
+    int flags = fcntl(m_socket, F_GETFL, 0);
+
+    // Connection is served from event loop, socket calls should never block
+    fcntl(m_socket, F_SETFL, flags | O_NONBLOCK);
+
+    m_pReadNotifier = new QSocketNotifier(m_socket, QSocketNotifier::Read, this);
+    m_pWriteNotifier = new QSocketNotifier(m_socket, QSocketNotifier::Write, this);
+    m_pWriteNotifier->setEnabled(false);
+    QObject::connect(m_pReadNotifier, SIGNAL(activated(int)), this, SLOT(ReadReady()));
+    QObject::connect(m_pWriteNotifier, SIGNAL(activated(int)), this, SLOT(WriteReady()));
+
+    m_pIdleTimer = new QTimer(this);
+    m_pIdleTimer->setSingleShot(true);
+    m_pIdleTimer->setInterval(ARCHIVE_HTTP_IDLE_TIMEOUT_MS);
+    QObject::connect(m_pIdleTimer, SIGNAL(timeout()), this, SLOT(Finish()));
+    m_pIdleTimer->start();
+}
+
+void ArchiveHttpConnection::ReadReady()
+{
+    char    buffer[4096];
+    ssize_t received = recv(m_socket, buffer, sizeof(buffer), 0);
+
+    if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return;
+    }
+    else if (received <= 0)
+    {
+        Finish();
+        return;
+    }
+
+    m_inputBuffer.append(buffer, (int)received);
+    ProcessInput();
+}
+
+void ArchiveHttpConnection::WriteReady()
+{
+    Send();
+}
+
+void ArchiveHttpConnection::Finish()
+{
+    if (m_socket < 0)
+    {
+        return;
+    }
+
+    m_pReadNotifier->setEnabled(false);
+    m_pWriteNotifier->setEnabled(false);
+    m_pIdleTimer->stop();
+
+    CloseFile();
+    ::close(m_socket);
+    m_socket = -1;
+
+    deleteLater();
+}
+
+void ArchiveHttpConnection::ProcessInput()
+{
+    HttpRequest request;
+
+    // Requests are answered one by one (next one is parsed after response is sent)
+    if (m_sending || m_socket < 0)
+    {
+        return;
+    }
+
+    int consumed = request.Parse(m_inputBuffer);
+    if (0 == consumed)
+    {
+        return;
+    }
+
+    m_pIdleTimer->stop();
+    m_pReadNotifier->setEnabled(false);
+    m_sending = true;
+
+    if (consumed < 0)
+    {
+        SetError(400, false);
+    }
+    else
+    {
+        m_inputBuffer.remove(0, consumed);
+        ProcessRequest(request);
+    }
+    Send();
+}
+
+void ArchiveHttpConnection::ProcessRequest(const HttpRequest& request)
+{
+    bool        keepAlive = request.KeepAlive();
+    bool        headOnly = (request.method == "HEAD");
+    QString     path = QDir::cleanPath(request.path);
+
+    PipelineMetrics::instance()->AddCounter("archive_http_requests_total");
+
+    if (request.method != "GET" && !headOnly)
+    {
+        SetError(405, keepAlive);
+        return;
+    }
+
+    // Only files inside archive folder can be requested
+    if (!path.startsWith('/') || path.contains("/../") || path.endsWith("/.."))
+    {
+        SetError(400, keepAlive);
+        return;
+    }
+
+    // Only media files of own camera are served (not indexes, caches, databases or other cameras)
+    if (!path.startsWith('/' + m_cameraFolder + '/') || !IsMediaFile(path))
+    {
+        PipelineMetrics::instance()->AddCounter("archive_http_forbidden_total");
+        SetError(403, keepAlive);
+        return;
+    }
+
+    QString     fileName = m_rootFolder + path;
+    QByteArray  nativeName = QFile::encodeName(fileName);
+    struct stat fileStat;
+    int         fileDescriptor = open(nativeName.constData(), O_RDONLY);
+
+    if (fileDescriptor < 0 || fstat(fileDescriptor, &fileStat) != 0 || !S_ISREG(fileStat.st_mode))
+    {
+        if (fileDescriptor >= 0)
+        {
+            ::close(fileDescriptor);
+        }
+        SetError(404, keepAlive);
+        return;
+    }
+
+    // Size is fixed at request time (segment can be still growing)
+    qint64      fileSize = fileStat.st_size;
+    qint64      initSize = 0;                   /// Bytes sent from file start before main range (for '?t=' requests)
+    qint64      offset = 0;
+    qint64      size = fileSize;
+    int         code = 200;
+    QByteArray  extraHeaders = "Accept-Ranges: bytes\r\n";
+
+    if (request.query.hasQueryItem("t"))
+    {
+        ArchiveSegmentIndex index;
+        int64_t             seekMs = (int64_t)(request.query.queryItemValue("t").toDouble() * 1000);
+
+        // Seek is possible only in fragmented segments with known fragment offsets
+        if (CAMERA_PIPELINE_OK == ReadArchiveIndex(fileName, &index) &&
+            !index.keyFrames.isEmpty() &&
+            index.keyFrames.first().byteOffset > 0)
+        {
+            initSize = index.keyFrames.first().byteOffset;
+            offset = initSize;
+
+            Q_FOREACH (const ArchiveKeyframe& keyFrame, index.keyFrames)
+            {
+                if (keyFrame.mediaMs > seekMs || keyFrame.byteOffset < 0 || keyFrame.byteOffset > fileSize)
+                {
+                    break;
+                }
+                offset = keyFrame.byteOffset;
+            }
+
+            if (offset > initSize)
+            {
+                size = fileSize - offset;
+            }
+            else
+            {
+                // Seek to the first fragment is the same as whole file
+                initSize = 0;
+                offset = 0;
+            }
+        }
+    }
+    else if (!request.Header("range").isEmpty())
+    {
+        if (!ParseRange(request.Header("range"), fileSize, &offset, &size))
+        {
+            ::close(fileDescriptor);
+            SetError(416, keepAlive, "Content-Range: bytes */" + QByteArray::number(fileSize) + "\r\n");
+            return;
+        }
+
+        code = 206;
+        extraHeaders += "Content-Range: bytes " + QByteArray::number(offset) + "-" +
+                        QByteArray::number(offset + size - 1) + "/" + QByteArray::number(fileSize) + "\r\n";
+    }
+
+    m_outputBuffer = HttpRequest::ResponseHeader(code, ContentType(fileName), initSize + size, keepAlive, extraHeaders);
+    m_closeAfterResponse = !keepAlive;
+
+    if (headOnly)
+    {
+        ::close(fileDescriptor);
+        return;
+    }
+
+    m_fileDescriptor = fileDescriptor;
+    if (initSize > 0)
+    {
+        FileRange initRange = { 0, initSize };
+        m_fileRanges.append(initRange);
+    }
+    FileRange mainRange = { offset, size };
+    m_fileRanges.append(mainRange);
+}
+
+void ArchiveHttpConnection::SetError(int code, bool keepAlive, const QByteArray& extraHeaders)
+{
+    m_outputBuffer = HttpRequest::ResponseHeader(code, "text/plain", 0, keepAlive, extraHeaders);
+    m_closeAfterResponse = !keepAlive;
+}
+
+void ArchiveHttpConnection::Send()
+{
+    if (!SendBuffer() || (m_outputBuffer.isEmpty() && !SendFileRanges()))
+    {
+        // File was truncated or client is gone
+        Finish();
+        return;
+    }
+
+    // Socket buffer is full - continue when client reads data (no timeout, player can be paused)
+    if (!m_outputBuffer.isEmpty() || !m_fileRanges.isEmpty())
+    {
+        m_pWriteNotifier->setEnabled(true);
+        return;
+    }
+
+    // Response is complete
+    m_pWriteNotifier->setEnabled(false);
+    CloseFile();
+    m_sending = false;
+
+    if (m_closeAfterResponse)
+    {
+        Finish();
+        return;
+    }
+
+    m_pReadNotifier->setEnabled(true);
+    m_pIdleTimer->start();
+
+    // Next request could be already received
+    ProcessInput();
+}
+
+bool ArchiveHttpConnection::SendBuffer()
+{
+    while (!m_outputBuffer.isEmpty())
+    {
+        ssize_t sent = send(m_socket, m_outputBuffer.constData(), m_outputBuffer.size(), MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        m_outputBuffer.remove(0, (int)sent);
+    }
+    return true;
+}
+
+bool ArchiveHttpConnection::SendFileRanges()
+{
+    while (!m_fileRanges.isEmpty())
+    {
+        FileRange&  range = m_fileRanges.first();
+        off_t       fileOffset = range.offset;
+        ssize_t     sent = sendfile(m_socket, m_fileDescriptor, &fileOffset, qMin(range.size, (qint64)ARCHIVE_HTTP_SENDFILE_CHUNK));
+
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        else if (0 == sent)
+        {
+            return false;
+        }
+
+        range.offset += sent;
+        range.size -= sent;
+        if (range.size <= 0)
+        {
+            m_fileRanges.removeFirst();
+        }
+        PipelineMetrics::instance()->AddCounter("archive_http_bytes_sent_total", sent);
+    }
+    return true;
+}
+
+void ArchiveHttpConnection::CloseFile()
+{
+    if (m_fileDescriptor >= 0)
+    {
+        ::close(m_fileDescriptor);
+        m_fileDescriptor = -1;
+    }
+    m_fileRanges.clear();
+}
+
+bool ArchiveHttpConnection::ParseRange(const QByteArray& range, qint64 fileSize, qint64* pOffset, qint64* pSize)
+{
+    // Only single range is supported
+    if (!range.startsWith("bytes=") || range.contains(','))
+    {
+        return false;
+    }
+
+    QByteArray  spec = range.mid(6).trimmed();
+    int         separator = spec.indexOf('-');
+    bool        firstOk = true;
+    bool        lastOk = true;
+
+    if (separator < 0)
+    {
+        return false;
+    }
+
+    QByteArray  firstStr = spec.left(separator);
+    QByteArray  lastStr = spec.mid(separator + 1);
+    qint64      first;
+    qint64      last;
+
+    if (firstStr.isEmpty())
+    {
+        // Suffix range: last N bytes
+        qint64 suffix = lastStr.toLongLong(&lastOk);
+        if (!lastOk || suffix <= 0)
+        {
+            return false;
+        }
+        first = qMax((qint64)0, fileSize - suffix);
+        last = fileSize - 1;
+    }
+    else
+    {
+        first = firstStr.toLongLong(&firstOk);
+        last = lastStr.isEmpty() ? fileSize - 1 : lastStr.toLongLong(&lastOk);
+    }
+
+    if (!firstOk || !lastOk || first < 0 || first >= fileSize || last < first)
+    {
+        return false;
+    }
+
+    *pOffset = first;
+    *pSize = qMin(last, fileSize - 1) - first + 1;
+    return true;
+}
+
+bool ArchiveHttpConnection::IsMediaFile(const QString& fileName)
+{
+    return fileName.endsWith(".mp4") || fileName.endsWith(".m4s") || fileName.endsWith(".m3u8");
+}
+
+const char* ArchiveHttpConnection::ContentType(const QString& fileName)
+{
+    if (fileName.endsWith(".mp4") || fileName.endsWith(".m4s"))
+    {
+        return "video/mp4";
+    }
+    else if (fileName.endsWith(".m3u8"))
+    {
+        return "application/vnd.apple.mpegurl";
+    }
+    return "application/octet-stream";
+}
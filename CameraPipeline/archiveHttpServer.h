@@ -0,0 +1,103 @@
+#ifndef ARCHIVEHTTPSERVER_H
+#define ARCHIVEHTTPSERVER_H
+
+#include <QList>
+#include <QTimer>
+#include <QString>
+#include <QThread>
+#include <QByteArray>
+#include <QTcpServer>
+#include <QSocketNotifier>
+
+#include "networkUtils/httpRequest.h"
+
+#define  ARCHIVE_HTTP_IDLE_TIMEOUT_MS   5000        // Keep-alive connection is closed after this idle time (between requests)
+#define  ARCHIVE_HTTP_SENDFILE_CHUNK    (1 << 20)   // Maximum size of single sendfile() call
+
+/*
+ * Local HTTP server for archive playback
+ * Serves files from archive folder (segments, event clips, exports) with Range support.
+ * File data is passed from page cache to socket with sendfile(), without copying through user space.
+ * Archive segments can be requested from keyframe with '?t=<seconds from segment start>',
+ * in this case init section (ftyp + moov) is sent followed by fragments from found keyframe.
+ *
+ * Only media files (segments, fragments, playlists) of own camera folder are served,
+ * other files of archive (indexes, caches, databases) are refused with 403.
+ *
+ * Accepted connections are not wrapped in QTcpSocket - socket descriptors are non-blocking
+ * and served by event loops of a few I/O threads. Sending continues from socket write notifications,
+ * so each player (also paused one) costs only a descriptor, not a thread.
+ */
+class ArchiveHttpServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    ArchiveHttpServer(QString rootFolder, QString cameraFolder, QString address, int port, int ioThreads, QObject* parent = NULL);
+    ~ArchiveHttpServer();
+
+protected:
+    void    incomingConnection(qintptr socketDescriptor);
+
+private:
+    QString         m_rootFolder;
+    QString         m_cameraFolder;     /// Camera folder inside root folder, requests outside it are refused
+    QList<QThread*> m_ioThreads;        /// Connections are distributed round robin
+    int             m_nextThread;
+};
+
+/*
+ * Single client connection, served by event loop of I/O thread
+ */
+class ArchiveHttpConnection : public QObject
+{
+    Q_OBJECT
+public:
+    ArchiveHttpConnection(int socketDescriptor, QString rootFolder, QString cameraFolder);
+    ~ArchiveHttpConnection();
+
+public slots:
+    void    Start();                    /// Called in I/O thread
+
+private slots:
+    void    ReadReady();
+    void    WriteReady();
+    void    Finish();                   /// Close connection and delete object
+
+private:
+    /// File range waiting for sendfile()
+    struct FileRange
+    {
+        qint64  offset;
+        qint64  size;
+    };
+
+    int                 m_socket;
+    QString             m_rootFolder;
+    QString             m_cameraFolder;
+    QByteArray          m_inputBuffer;      /// Received data, that was not parsed yet
+    QSocketNotifier*    m_pReadNotifier;
+    QSocketNotifier*    m_pWriteNotifier;
+    QTimer*             m_pIdleTimer;       /// Runs only while connection waits for request
+
+    // Response being sent
+    QByteArray          m_outputBuffer;     /// Header (or error response) to send before file data
+    int                 m_fileDescriptor;   /// File of response (-1 if none)
+    QList<FileRange>    m_fileRanges;
+    bool                m_sending;
+    bool                m_closeAfterResponse;
+
+    void        ProcessInput();             /// Parse buffered requests and start their responses
+    void        ProcessRequest(const HttpRequest& request);
+    void        SetError(int code, bool keepAlive, const QByteArray& extraHeaders = QByteArray());
+    void        Send();                     /// Send pending response until socket buffer is full
+    bool        SendBuffer();
+    bool        SendFileRanges();
+    void        CloseFile();
+
+    /// Parse single range "bytes=first-last", returns false if range can not be satisfied
+    static bool ParseRange(const QByteArray& range, qint64 fileSize, qint64* pOffset, qint64* pSize);
+    static bool IsMediaFile(const QString& fileName);
+    static const char* ContentType(const QString& fileName);
+};
+
+#endif // ARCHIVEHTTPSERVER_H
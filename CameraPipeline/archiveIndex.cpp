@@ -0,0 +1,115 @@
+#include "archiveIndex.h"
+
+ArchiveIndexWriter::ArchiveIndexWriter()
+{
+
+}
+
+ArchiveIndexWriter::~ArchiveIndexWriter()
+{
+    Close();
+}
+
+QString ArchiveIndexWriter::IndexFileName(QString segmentFileName)
+{
+    int extension = segmentFileName.lastIndexOf('.');
+
+    if (extension > segmentFileName.lastIndexOf('/'))
+    {
+        segmentFileName.truncate(extension);
+    }
+    return segmentFileName + ARCHIVE_INDEX_EXTENSION;
+}
+
+ErrorCode ArchiveIndexWriter::Open(QString segmentFileName, int64_t startTime)
+{
+    ArchiveIndexHeader header;
+
+    Close();
+
+    m_file.setFileName(IndexFileName(segmentFileName));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "ArchiveIndexWriter", "Failed to open archive index file %s",
+                       m_file.fileName().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    header.magic = ARCHIVE_INDEX_MAGIC;
+    header.version = ARCHIVE_INDEX_VERSION;
+    header.startTime = startTime;
+
+    if (m_file.write((const char *)&header, sizeof(header)) != sizeof(header) || !m_file.flush())
+    {
+        ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "ArchiveIndexWriter", "Failed to write archive index header");
+        m_file.close();
+        return CAMERA_PIPELINE_ERROR;
+    }
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode ArchiveIndexWriter::Append(int64_t serverTime, const ArchiveKeyframe& keyFrame)
+{
+    ArchiveIndexRecord record;
+
+    if (!m_file.isOpen())
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    record.mediaMs = keyFrame.mediaMs;
+    record.serverTime = serverTime;
+    record.byteOffset = keyFrame.byteOffset;
+
+    // Each record is flushed at once (small write for each gop)
+    if (m_file.write((const char *)&record, sizeof(record)) != sizeof(record) || !m_file.flush())
+    {
+        ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "ArchiveIndexWriter", "Failed to append archive index record");
+        return CAMERA_PIPELINE_ERROR;
+    }
+    return CAMERA_PIPELINE_OK;
+}
+
+void ArchiveIndexWriter::Close()
+{
+    if (m_file.isOpen())
+    {
+        m_file.close();
+    }
+}
+
+ErrorCode ReadArchiveIndex(QString segmentFileName, ArchiveSegmentIndex* pIndex)
+{
+    QFile               file(ArchiveIndexWriter::IndexFileName(segmentFileName));
+    ArchiveIndexHeader  header;
+    ArchiveIndexRecord  record;
+
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if (file.read((char *)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != ARCHIVE_INDEX_MAGIC ||
+        header.version != ARCHIVE_INDEX_VERSION)
+    {
+        ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "ArchiveIndex", "Invalid archive index file %s",
+                       file.fileName().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    pIndex->filePath = segmentFileName;
+    pIndex->startTime = header.startTime;
+    pIndex->keyFrames.clear();
+
+    // Incomplete last record (if any) is ignored
+    while (file.read((char *)&record, sizeof(record)) == sizeof(record))
+    {
+        ArchiveKeyframe keyFrame;
+
+        keyFrame.mediaMs = record.mediaMs;
+        keyFrame.byteOffset = record.byteOffset;
+        pIndex->keyFrames.insert(record.serverTime, keyFrame);
+    }
+    return CAMERA_PIPELINE_OK;
+}
@@ -0,0 +1,68 @@
+#ifndef ARCHIVEINDEX_H
+#define ARCHIVEINDEX_H
+
+#include <QMap>
+#include <QFile>
+#include <QString>
+
+#include "cameraPipelineCommon.h"
+
+#define  ARCHIVE_INDEX_MAGIC        0x5844494F  // "OIDX"
+#define  ARCHIVE_INDEX_VERSION      1
+#define  ARCHIVE_INDEX_EXTENSION    ".idx"
+
+/// Keyframe position inside archive segment
+struct ArchiveKeyframe
+{
+    int64_t     mediaMs;                /// Time from segment start
+    qint64      byteOffset;             /// Offset of fragment, started from this keyframe (-1 if unknown)
+};
+
+/// Keyframe index of archive segment
+struct ArchiveSegmentIndex
+{
+    QString                         shortFileName;  /// Archive file url (same as in NewFileOpened)
+    QString                         filePath;       /// Local path of segment file
+    int64_t                         startTime;      /// Server time of the first packet (ms)
+    QMap<int64_t, ArchiveKeyframe>  keyFrames;      /// Server time (ms) -> keyframe position
+};
+
+/// Sidecar index file layout (native byte order)
+struct ArchiveIndexHeader
+{
+    uint32_t    magic;
+    uint32_t    version;
+    int64_t     startTime;              /// Server time of the first packet (ms)
+};
+
+struct ArchiveIndexRecord
+{
+    int64_t     mediaMs;
+    int64_t     serverTime;
+    int64_t     byteOffset;
+};
+
+/*
+ * Incremental writer of archive segment sidecar index (<segment>.idx)
+ * Records are only appended, so index file is always consistent with data already written to segment
+ */
+class ArchiveIndexWriter
+{
+public:
+    ArchiveIndexWriter();
+    ~ArchiveIndexWriter();
+
+    ErrorCode   Open(QString segmentFileName, int64_t startTime);
+    ErrorCode   Append(int64_t serverTime, const ArchiveKeyframe& keyFrame);
+    void        Close();
+
+    static QString  IndexFileName(QString segmentFileName);
+
+private:
+    QFile       m_file;
+};
+
+/// Read sidecar index of archive segment
+ErrorCode ReadArchiveIndex(QString segmentFileName, ArchiveSegmentIndex* pIndex);
+
+#endif // ARCHIVEINDEX_H
@@ -13,7 +13,7 @@ CameraPipeline::CameraPipeline(QObject *parent) :
     avformat_network_init();
 
     // Probe input stream and replace invalid parameters if any
-    if (CAMERA_PIPELINE_OK != CheckParams())
+    if (CAMERA_PIPELINE_OK != CheckParams(DataDirectoryInstance::instance()->pipelineParams.inputStreamUrl))
     {
         ERROR_MESSAGE0(ERR_TYPE_ERROR, "CameraPipeline", "Failed to get parameters of input stream. Exiting...");
         return;
@@ -30,12 +30,14 @@ CameraPipeline::CameraPipeline(QObject *parent) :
     pCaptureThread = new QThread();
     pRecorderThread = new QThread();
     pStatisticThread = new QThread();
+    pDbWriterThread = new QThread();
     pProcessingThread = new QThread();
     pHealthCheckThread = new QThread();
 
     QObject::connect(pCaptureThread, SIGNAL(finished()), pCaptureThread, SLOT(deleteLater()));
     QObject::connect(pRecorderThread, SIGNAL(finished()), pRecorderThread, SLOT(deleteLater()));
     QObject::connect(pStatisticThread, SIGNAL(finished()), pStatisticThread, SLOT(deleteLater()));
+    QObject::connect(pDbWriterThread, SIGNAL(finished()), pDbWriterThread, SLOT(deleteLater()));
     QObject::connect(pProcessingThread, SIGNAL(finished()), pProcessingThread, SLOT(deleteLater()));
     QObject::connect(pHealthCheckThread, SIGNAL(finished()), pHealthCheckThread, SLOT(deleteLater()));
 
@@ -67,7 +69,10 @@ CameraPipeline::CameraPipeline(QObject *parent) :
     pSourceOutput->moveToThread(pProcessingThread);
     QObject::connect(pProcessingThread, SIGNAL(finished()), pSourceOutput, SLOT(deleteLater()));
 
-    pResultOutput = new ResultVideoOutput(pDataDirectory->pipelineParams.outputUrl);
+    pResultOutput = new ResultVideoOutput(pDataDirectory->pipelineParams.outputUrl,
+                                          pDataDirectory->pipelineParams.hlsAddress,
+                                          pDataDirectory->pipelineParams.hlsPort,
+                                          pDataDirectory->pipelineParams.hlsPartDurationMs);
     pResultOutput->moveToThread(pProcessingThread);
     QObject::connect(pProcessingThread, SIGNAL(finished()), pResultOutput, SLOT(deleteLater()));
 
@@ -114,6 +119,14 @@ CameraPipeline::CameraPipeline(QObject *parent) :
     QObject::connect(pStatisticThread, SIGNAL(finished()), pStatisticDBIntf, SLOT(deleteLater()));
     QObject::connect(pStatisticThread, SIGNAL(finished()), pStatisticThread, SLOT(deleteLater()));
 
+    // DB writer object
+    // Events and interval records are written in batches with own connection (reads are not blocked by writes)
+    pDbWriter = new DbWriter();
+    qRegisterMetaType<AnalysisRecordModel*>("AnalysisRecordModel*");
+    pDbWriter->moveToThread(pDbWriterThread);
+    QObject::connect(pDbWriterThread, SIGNAL(started()),  pDbWriter, SLOT(Open()));
+    QObject::connect(pDbWriterThread, SIGNAL(finished()), pDbWriter, SLOT(deleteLater()));
+
     // Stream recorder object
     // Writing archive and event files to HDD in separate thread
     pStreamRecorder = new StreamRecorder();
@@ -128,6 +141,48 @@ CameraPipeline::CameraPipeline(QObject *parent) :
     QObject::connect(pHealthCheckThread, SIGNAL(started()),  pHealthChecker,     SLOT(Start()));
     QObject::connect(pHealthCheckThread, SIGNAL(finished()), pHealthChecker,     SLOT(deleteLater()));
 
+    // Archive export
+    // Requests are handled in main thread, export itself is done in thread pool
+    pClipExporter = new ClipExporter(this);
+
+    // Archive playback server
+    // Connections are accepted in main thread and served by event loops of its own I/O threads
+    if (pDataDirectory->pipelineParams.archiveHttpPort > 0)
+    {
+        pArchiveServer = new ArchiveHttpServer(pDataDirectory->pipelineParams.archivePath,
+                                               pDataDirectory->pipelineParams.pipelineName,
+                                               pDataDirectory->pipelineParams.archiveHttpAddress,
+                                               pDataDirectory->pipelineParams.archiveHttpPort,
+                                               pDataDirectory->pipelineParams.archiveHttpThreads,
+                                               this);
+    }
+    else
+    {
+        pArchiveServer = NULL;
+    }
+
+    // Metrics endpoint (separate from media outputs)
+    if (pDataDirectory->pipelineParams.metricsPort > 0)
+    {
+        pMetricsServer = new MetricsServer(pDataDirectory->pipelineParams.metricsAddress,
+                                           pDataDirectory->pipelineParams.metricsPort,
+                                           this);
+    }
+    else
+    {
+        pMetricsServer = NULL;
+    }
+
+    // All muxers of the stream share parameter sets, tracked by its capture object
+    pSourceOutput->SetParameterSets(pRtspCapture->ParameterSets());
+    pResultOutput->SetParameterSets(pRtspCapture->ParameterSets());
+    pStreamRecorder->SetParameterSets(pRtspCapture->ParameterSets());
+
+    if (NULL != pSmallStreamOutput && NULL != pRtspSmallStreamCapture)
+    {
+        pSmallStreamOutput->SetParameterSets(pRtspSmallStreamCapture->ParameterSets());
+    }
+
     //
     // Connect all signals
     //
@@ -161,6 +216,11 @@ CameraPipeline::~CameraPipeline()
     if (!pStatisticThread->wait(500))
         pStatisticThread->terminate();
 
+    // Writer flushes queued entries before exit
+    pDbWriterThread->quit();
+    if (!pDbWriterThread->wait(2000))
+        pDbWriterThread->terminate();
+
     pRecorderThread->quit();
     if (!pRecorderThread->wait(500))
         pRecorderThread->terminate();
@@ -180,6 +240,14 @@ void CameraPipeline::ConnectSignals()
     QObject::connect(pVideoAnalyzer,   SIGNAL(Ping(const char*, int)), pHealthChecker, SLOT(Pong(const char*, int)));
     QObject::connect(pStatisticDBIntf, SIGNAL(Ping(const char*, int)), pHealthChecker, SLOT(Pong(const char*, int)));
 
+    // Interval records are written by DB writer (for both modes)
+    QObject::connect(pStatisticDBIntf, SIGNAL(RecordReady(AnalysisRecordModel*)),
+                     pDbWriter, SLOT(InsertRecord(AnalysisRecordModel*)));
+
+    // Baselines are updated only with records committed by DB writer
+    QObject::connect(pDbWriter, SIGNAL(RecordWritten(QDate, QTime, bool)),
+                     pStatisticDBIntf, SLOT(RecordWritten(QDate, QTime, bool)));
+
     QObject::connect(this, SIGNAL(ProcessingStopped()), pRtspCapture, SLOT(StopCapture()));
     QObject::connect(this, SIGNAL(ProcessingStopped()), pVideoAnalyzer, SLOT(StopAnalyze()));
     QObject::connect(this, SIGNAL(ProcessingStopped()), pSourceOutput, SLOT(Close()));
@@ -273,29 +341,67 @@ void CameraPipeline::ConnectSignals()
         QObject::connect(pVideoAnalyzer, SIGNAL(AnalysisFinished(VideoFrame*, AnalysisResults*)),
                          pEventHandler, SLOT(ProcessAnalysisResults(VideoFrame*,AnalysisResults*)));
 
+        // Detection results are sent along with result stream as timed metadata
+        QObject::connect(pEventHandler, SIGNAL(MetadataReady(double, QJsonObject)),
+                         pResultOutput, SLOT(WriteMetadata(double, QJsonObject)));
+
         // Inform DecisionMaker, that new period statistics received from DB
         QObject::connect(pStatisticDBIntf, SIGNAL(NewPeriodStatistics(QList<IntervalStatistics*>)),
                          pEventHandler, SLOT(ProcessIntervalStats(QList<IntervalStatistics*>)));
 
-        // Store all events in database
-        QObject::connect(pEventHandler,  SIGNAL(EventFinished(EventDescription)),
-                         pStatisticDBIntf, SLOT(StoreEvent(EventDescription)));
+        // Statistics for next interval are prefetched and applied by event handler exactly at the boundary
+        QObject::connect(pVideoStatistics, SIGNAL(NextStatisticPeriodExpected(QDateTime)),
+                         pStatisticDBIntf, SLOT(PerformPrefetchStatistic(QDateTime)));
+
+        QObject::connect(pStatisticDBIntf, SIGNAL(NextPeriodStatistics(QDateTime, QList<IntervalStatistics*>)),
+                         pEventHandler, SLOT(SetNextIntervalStats(QDateTime, QList<IntervalStatistics*>)));
+
+        QObject::connect(pVideoStatistics, SIGNAL(StatisticPeriodStarted(QDateTime)),
+                         pEventHandler, SLOT(IntervalStarted(QDateTime)));
+
+        // Store all events in database (with archive clip reference)
+        QObject::connect(pStreamRecorder, SIGNAL(EventArchived(EventDescription)),
+                         pDbWriter, SLOT(StoreEvent(EventDescription)));
 
         // Interaction between Event handler and frontend (via DataDirectory)
         qRegisterMetaType<EventDescription>("EventDescription");
         QObject::connect(pEventHandler,  SIGNAL(EventStarted(EventDescription)),
                          pDataDirectory, SLOT  (eventHandler(EventDescription)));
 
-        QObject::connect(pEventHandler,  SIGNAL(EventFinished(EventDescription)),
+        QObject::connect(pStreamRecorder, SIGNAL(EventArchived(EventDescription)),
                          pDataDirectory, SLOT  (eventHandler(EventDescription)));
 
         QObject::connect(pDataDirectory, SIGNAL(securityReactionEvent(EventDescription)),
                          pEventHandler,  SLOT  (SecurityReaction(EventDescription)));
 
-        // Interaction between Event handler and event notifier
+        // Analysis rate is kept at maximum while any event is open
+        QObject::connect(pEventHandler,  SIGNAL(EventStarted(EventDescription)),
+                         pVideoAnalyzer, SLOT(EventStarted(EventDescription)));
+        QObject::connect(pEventHandler,  SIGNAL(EventFinished(EventDescription)),
+                         pVideoAnalyzer, SLOT(EventFinished(EventDescription)));
+
+        // Interaction between Event handler and event notifier (finished events are passed to DB and frontend from here)
         QObject::connect(pEventHandler,  SIGNAL(EventFinished(EventDescription)),
                          pStreamRecorder, SLOT(WriteEventFile(EventDescription)));
+
+        // Archive is written only around events in event recording mode
+        QObject::connect(pEventHandler,  SIGNAL(EventStarted(EventDescription)),
+                         pStreamRecorder, SLOT(StartEventRecording(EventDescription)));
+        QObject::connect(pEventHandler,  SIGNAL(EventFinished(EventDescription)),
+                         pStreamRecorder, SLOT(StopEventRecording(EventDescription)));
     }
+
+    // Archive export commands from frontend (via DataDirectory)
+    QObject::connect(pDataDirectory, SIGNAL(commandReceived(QVariantMap)),
+                     pClipExporter,  SLOT  (HandleCommand(QVariantMap)));
+    QObject::connect(pClipExporter,  SIGNAL(ExportFinished(QVariantMap)),
+                     pDataDirectory, SLOT  (sendCommandResponse(QVariantMap)));
+
+    // Heatmaps are rendered from stored statistics on request
+    QObject::connect(pDataDirectory,   SIGNAL(commandReceived(QVariantMap)),
+                     pStatisticDBIntf, SLOT  (HandleCommand(QVariantMap)));
+    QObject::connect(pStatisticDBIntf, SIGNAL(CommandFinished(QVariantMap)),
+                     pDataDirectory,   SLOT  (sendCommandResponse(QVariantMap)));
 }
 
 void CameraPipeline::StopPipeline()
@@ -353,7 +459,7 @@ void CameraPipeline::CriticalErrorHappened(QString msg)
     QTimer::singleShot(10000, this, SLOT(StopPipeline()));
 }
 
-int CameraPipeline::CheckParams()
+int CameraPipeline::CheckParams(QString probeUrl)
 {
     DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
 
@@ -366,7 +472,7 @@ int CameraPipeline::CheckParams()
 
         ERROR_MESSAGE0(ERR_TYPE_MESSAGE, "CameraPipeline", "Probing stream fps and size...");
         ret = RTSPCapture::ProbeStreamParameters(
-                    pDataDirectory->pipelineParams.inputStreamUrl.toUtf8().constData(), &fps, &w, &h);
+                    probeUrl.toUtf8().constData(), &fps, &w, &h);
 
         if (ret != CAMERA_PIPELINE_OK)
         {
@@ -402,16 +508,19 @@ void CameraPipeline::CheckRequiredFolders()
     QString archiveFolder;
     QString imagesFolder;
     QString debugInfoFolder;
+    QString exportFolder;
 
     archiveFolder = pDataDirectory->pipelineParams.archivePath;
     archiveFolder += '/';
     archiveFolder += pDataDirectory->pipelineParams.pipelineName;
     imagesFolder = archiveFolder + QString("/alertFragments");
     debugInfoFolder = archiveFolder + QString("/debugImages");
+    exportFolder = archiveFolder + QString("/" EXPORT_FOLDER);
 
     QDir archiveDir(archiveFolder);
     QDir imagesDir(imagesFolder);
     QDir debugDir(debugInfoFolder);
+    QDir exportDir(exportFolder);
 
     if (!archiveDir.exists())
     {
@@ -427,6 +536,11 @@ void CameraPipeline::CheckRequiredFolders()
     {
         debugDir.mkpath(".");
     }
+
+    if (!exportDir.exists())
+    {
+        exportDir.mkpath(".");
+    }
 }
 
 void CameraPipeline::RunPipeline()
@@ -435,6 +549,7 @@ void CameraPipeline::RunPipeline()
     pHealthCheckThread->start();
     pProcessingThread->start();
     pStatisticThread->start();
+    pDbWriterThread->start();
     pRecorderThread->start();
     pCaptureThread->start();
 
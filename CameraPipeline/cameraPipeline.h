@@ -12,7 +12,11 @@
 #include "eventHandler.h"
 #include "videoEncoder.h"
 #include "healthChecker.h"
+#include "clipExporter.h"
+#include "archiveHttpServer.h"
+#include "metricsServer.h"
 #include "dbstat/intervalStatistics.h"
+#include "dbstat/dbWriter.h"
 #include "networkUtils/dataDirectory.h"
 
 class CameraPipeline : public QObject
@@ -30,18 +34,26 @@ public:
     VideoAnalyzer*          pVideoAnalyzer;         /// VideoAnalyzer object (works in processing thread)
     VideoStatistics*        pVideoStatistics;       /// Object for processing period statistics
     StatisticDBInterface*   pStatisticDBIntf;       /// Object for read/write statistics to DB
+    DbWriter*               pDbWriter;              /// Batched writer of events and interval records
     EventHandler*           pEventHandler;          /// Object for handling alert decisions and event-related stuff
     ResultVideoOutput*      pSourceOutput;          /// Object for source stream output
     ResultVideoOutput*      pResultOutput;          /// Object for stream output
     ResultVideoOutput*      pSmallStreamOutput;     /// Object for small stream output
     HealthChecker*          pHealthChecker;         /// Object that performs pipeline health check
+    ClipExporter*           pClipExporter;          /// Object for archive export requests (works in main thread)
+    ArchiveHttpServer*      pArchiveServer;         /// Archive playback server (NULL if disabled)
+    MetricsServer*          pMetricsServer;         /// Metrics endpoint (NULL if disabled)
 
     /// Frame buffer class for asynchronious frame exchange between Capture and Analyzer
     FrameCircularBuffer*    pFrameBuffer;
 
+    /// Probe stream (or file) for missing fps and downscale parameters
+    static int CheckParams(QString probeUrl);
+
     QThread*                pCaptureThread;         /// Interface for capture thread
     QThread*                pRecorderThread;        /// Interface for stream recorder thread
     QThread*                pStatisticThread;       /// Interface for statistic thread
+    QThread*                pDbWriterThread;        /// Interface for DB writer thread
     QThread*                pProcessingThread;      /// Interface for main processing thread
     QThread*                pHealthCheckThread;     /// Interface for health checker thread
 
@@ -61,7 +73,6 @@ public slots:
 private:
     bool    m_isRunning;                        /// Flag, if processing is currently active
 
-    int     CheckParams();
     void    ConnectSignals();
     void    DisconnectSignals();
     void    CheckRequiredFolders();             /// Check for archive folders exist and create if needed
@@ -1,5 +1,6 @@
 
 #include <stdio.h>
+#include <algorithm>
 #include <QMutex>
 #include <QDateTime>
 #include <QTextStream>
@@ -25,6 +26,7 @@ VideoFrame::VideoFrame()
     m_pSwsContext = NULL;
 
     nativeTimeInSeconds = 0.0;
+    presentationTimeInSeconds = 0.0;
     userTimestamp = 0;
     number = 0;
 }
@@ -62,6 +64,7 @@ void VideoFrame::CopyFromVideoFrame(VideoFrame* pSrcFrame)
     number = pSrcFrame->number;
     userTimestamp = pSrcFrame->userTimestamp;
     nativeTimeInSeconds = pSrcFrame->nativeTimeInSeconds;
+    presentationTimeInSeconds = pSrcFrame->presentationTimeInSeconds;
 }
 
 void VideoFrame::CopyFromAVFrame(AVFrame* pSrcFrame)
@@ -735,10 +738,16 @@ void AccumlatorBuffer::SetSize(int width, int height)
 
 void AccumlatorBuffer::Add(AccumlatorBuffer *pInBuffer, float weight)
 {
-    int     width = pInBuffer->GetWidth();
-    int     height = pInBuffer->GetHeight();
-    int     stride = pInBuffer->GetStride();
-    float*  pBuf = pInBuffer->GetPlaneData();
+    Add(pInBuffer->GetPlaneData(), pInBuffer->GetWidth(), pInBuffer->GetHeight(), pInBuffer->GetStride(), weight);
+}
+
+void AccumlatorBuffer::Add(const float* pBuf, int width, int height, int stride, float weight)
+{
+    if (NULL == pBuf)
+    {
+        width = 0;
+        height = 0;
+    }
 
     if (width != m_width || height != m_height)
     {
@@ -760,6 +769,17 @@ void AccumlatorBuffer::Add(AccumlatorBuffer *pInBuffer, float weight)
     m_count++;
 }
 
+void AccumlatorBuffer::Scale(float scale)
+{
+    for (int j = 0; j < m_height; j++)
+    {
+        for(int i = 0; i < m_width; i++)
+        {
+            m_pBuffer[j*m_stride + i] *= scale;
+        }
+    }
+}
+
 void AccumlatorBuffer::AddBuffer(VideoBuffer* pInBuffer, float weight)
 {
     unsigned char*  pBuf = pInBuffer->GetPlaneData();
@@ -875,69 +895,468 @@ AccumlatorBuffer::~AccumlatorBuffer()
 }
 
 
-void FillSPSPPS(AVCodecParameters* pCodecContext, AVPacket* pPacket)
+ParameterSetTracker::ParameterSetTracker() :
+    m_codecId(AV_CODEC_ID_NONE),
+    m_nalLengthSize(0),
+    m_inBandSets(false),
+    m_version(0)
+{
+
+}
+
+ParameterSetTracker::~ParameterSetTracker()
+{
+
+}
+
+void ParameterSetTracker::Reset(const AVCodecParameters* pCodecParams)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_codecId = pCodecParams->codec_id;
+    m_nalLengthSize = 0;
+    m_extradata.clear();
+    m_keyframePrefix.clear();
+    m_inBandSets = false;
+
+    for (int i = 0; i < PARAMETER_SET_TYPES; i++)
+    {
+        m_parameterSets[i].clear();
+    }
+
+    if (pCodecParams->extradata_size > 0)
+    {
+        // Configuration record (version 1) starts with 1, Annex B with start code
+        if (pCodecParams->extradata[0] == 1)
+        {
+            if (!ParseConfigRecord(pCodecParams->extradata, pCodecParams->extradata_size))
+            {
+                ERROR_MESSAGE0(ERR_TYPE_WARNING, "ParameterSetTracker", "Invalid avcC/hvcC extradata, parameter sets are not tracked");
+                m_nalLengthSize = 0;
+            }
+            m_extradata = QByteArray((const char *)pCodecParams->extradata, pCodecParams->extradata_size);
+        }
+        else if (ParseNalUnits(pCodecParams->extradata, pCodecParams->extradata_size, m_parameterSets))
+        {
+            m_extradata = BuildExtradata();
+        }
+        else
+        {
+            m_extradata = QByteArray((const char *)pCodecParams->extradata, pCodecParams->extradata_size);
+        }
+        m_keyframePrefix = PackNalUnits();
+    }
+    m_version++;
+}
+
+bool ParameterSetTracker::Update(const AVPacket* pPacket)
 {
-    int i;
-    int spsPpsDatalength = 0;
-    int spsPpsStart = -1;
-    int spsPpsEnd = -1;
+    QList<QByteArray> parameterSets[PARAMETER_SET_TYPES];
 
-    unsigned char* pCodedFrame = pPacket->data;
-    int frameLength = pPacket->size;
+    // Parameter sets are only expected in front of keyframes
+    if (!(pPacket->flags & AV_PKT_FLAG_KEY))
+    {
+        return false;
+    }
 
-    if (frameLength < 4)    // Frame is too short
+    bool found = ParseNalUnits(pPacket->data, pPacket->size, parameterSets);
+
+    QMutexLocker locker(&m_mutex);
+
+    // Consumers add parameter sets to keyframes only if stream does not carry them
+    m_inBandSets = !parameterSets[PARAMETER_SET_SPS].isEmpty() && !parameterSets[PARAMETER_SET_PPS].isEmpty();
+    if (!found)
+    {
+        return false;
+    }
+
+    bool changed = false;
+    for (int i = 0; i < PARAMETER_SET_TYPES; i++)
+    {
+        if (!parameterSets[i].isEmpty() && parameterSets[i] != m_parameterSets[i])
+        {
+            m_parameterSets[i] = parameterSets[i];
+            changed = true;
+        }
+    }
+
+    if (changed)
+    {
+        QByteArray extradata = BuildExtradata();
+
+        m_keyframePrefix = PackNalUnits();
+
+        // HEVC configuration record is not rebuilt (new sets go in-band with each keyframe)
+        if (!extradata.isEmpty() && extradata != m_extradata)
+        {
+            m_extradata = extradata;
+            m_version++;
+        }
+    }
+    return changed;
+}
+
+QByteArray ParameterSetTracker::KeyframePrefix()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_inBandSets || m_parameterSets[PARAMETER_SET_SPS].isEmpty() || m_parameterSets[PARAMETER_SET_PPS].isEmpty())
+    {
+        return QByteArray();
+    }
+    return m_keyframePrefix;
+}
+
+int ParameterSetTracker::Version()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_version;
+}
+
+QByteArray ParameterSetTracker::Extradata()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_extradata;
+}
+
+void ParameterSetTracker::ApplyTo(AVCodecParameters* pCodecParams, int* pVersion)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (NULL != pVersion)
+    {
+        *pVersion = m_version;
+    }
+
+    if (m_extradata.isEmpty())
     {
         return;
     }
 
-    // Find sps pps headers and mark their position
-    for(i = 0; i < frameLength - 3; i++)
+    // Extradata is freed by libav, so it should be allocated by av_malloc (with padding)
+    av_freep(&pCodecParams->extradata);
+    pCodecParams->extradata = (uint8_t *)av_mallocz(m_extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (NULL == pCodecParams->extradata)
     {
-        if ( (pCodedFrame[i + 0] == 0x0) &&
-             (pCodedFrame[i + 1] == 0x0) &&
-             (pCodedFrame[i + 2] == 0x1)
-           )
+        pCodecParams->extradata_size = 0;
+        return;
+    }
+    memcpy(pCodecParams->extradata, m_extradata.constData(), m_extradata.size());
+    pCodecParams->extradata_size = m_extradata.size();
+}
+
+bool ParameterSetTracker::ParseNalUnits(const uint8_t* pData, int size, QList<QByteArray> parameterSets[PARAMETER_SET_TYPES])
+{
+    bool    found = false;
+    int     nalStart = -1;
+
+    if (m_codecId != AV_CODEC_ID_H264 && m_codecId != AV_CODEC_ID_HEVC)
+    {
+        return false;
+    }
+
+    // Length-prefixed NAL units (format is known from avcC/hvcC extradata)
+    if (m_nalLengthSize > 0)
+    {
+        int pos = 0;
+
+        while (pos + m_nalLengthSize <= size)
         {
-            // NAL header found
+            int nalSize = 0;
 
-            if (pCodedFrame[i + 3] == 0x67) // SPS nal
+            for (int i = 0; i < m_nalLengthSize; i++)
             {
-                spsPpsStart = i;
+                nalSize = (nalSize << 8) | pData[pos + i];
             }
-            else
+            pos += m_nalLengthSize;
+
+            if (nalSize <= 0 || nalSize > size - pos || !AddNalUnit(&pData[pos], nalSize, parameterSets, &found))
+            {
+                break;
+            }
+            pos += nalSize;
+        }
+        return found;
+    }
+
+    for (int i = 0; i <= size; i++)
+    {
+        bool startCode = (i + 2 < size) && pData[i] == 0 && pData[i + 1] == 0 && pData[i + 2] == 1;
+
+        // Previous NAL unit ends at the next start code (or at the end of data)
+        if (startCode || i == size)
+        {
+            if (nalStart >= 0 && nalStart < i)
             {
-                if (pCodedFrame[i + 3] != 0x68) // PPS should be also included
+                int nalEnd = i;
+                while (nalEnd > nalStart && pData[nalEnd - 1] == 0)     // Leading zero of 4-byte start code
+                {
+                    nalEnd--;
+                }
+
+                if (!AddNalUnit(&pData[nalStart], nalEnd - nalStart, parameterSets, &found))
                 {
-                    spsPpsEnd = i;
+                    break;
                 }
             }
 
-            if ( spsPpsStart >= 0 && spsPpsEnd > 0)
+            if (i == size)
             {
-                break;  // Sps and pps found and can be copied to extradata
+                break;
             }
+
+            nalStart = i + 3;
+            i += 2;
+        }
+        else if (nalStart < 0 && i > 4)
+        {
+            // Data is not in Annex B format
+            return false;
         }
     }
+    return found;
+}
 
-    spsPpsDatalength = (spsPpsEnd - spsPpsStart);
+bool ParameterSetTracker::AddNalUnit(const uint8_t* pNal, int size, QList<QByteArray> parameterSets[PARAMETER_SET_TYPES], bool* pFound)
+{
+    bool    isHevc = (m_codecId == AV_CODEC_ID_HEVC);
+    int     setType = -1;
 
-    if ( (spsPpsEnd <= 0) || (spsPpsDatalength < 8))  // Invalid sps pps sequence size
+    if (size <= 0)
     {
-        return;
+        return true;
+    }
+
+    int  nalType = isHevc ? ((pNal[0] >> 1) & 0x3F) : (pNal[0] & 0x1F);
+    bool isVcl = isHevc ? (nalType < 32) : (nalType >= 1 && nalType <= 5);
+
+    // Slice data - no parameter sets after it
+    if (isVcl)
+    {
+        return false;
+    }
+
+    if (isHevc)
+    {
+        setType = (nalType == 32) ? PARAMETER_SET_VPS :
+                  (nalType == 33) ? PARAMETER_SET_SPS :
+                  (nalType == 34) ? PARAMETER_SET_PPS : -1;
+    }
+    else
+    {
+        setType = (nalType == 7) ? PARAMETER_SET_SPS :
+                  (nalType == 8) ? PARAMETER_SET_PPS : -1;
+    }
+
+    if (setType >= 0)
+    {
+        parameterSets[setType].append(QByteArray((const char *)pNal, size));
+        *pFound = true;
+    }
+    return true;
+}
+
+bool ParameterSetTracker::ParseConfigRecord(const uint8_t* pData, int size)
+{
+    bool    isHevc = (m_codecId == AV_CODEC_ID_HEVC);
+    int     pos;
+    int     arrays;
+
+    if (m_codecId != AV_CODEC_ID_H264 && !isHevc)
+    {
+        return false;
+    }
+
+    // avcC: 5 bytes header, SPS array, PPS array; hvcC: 22 bytes header, arrays of NAL units
+    if (size < (isHevc ? 23 : 7))
+    {
+        return false;
     }
 
-    if (pCodecContext->extradata_size != spsPpsDatalength)
+    m_nalLengthSize = (pData[isHevc ? 21 : 4] & 0x03) + 1;
+    pos = isHevc ? 23 : 5;
+    arrays = isHevc ? pData[22] : 2;
+
+    for (int a = 0; a < arrays; a++)
     {
-        if (NULL != pCodecContext->extradata)
+        int count;
+
+        if (pos >= size)
+        {
+            return false;
+        }
+
+        if (isHevc)
+        {
+            // Array header: NAL unit type and number of NAL units
+            if (pos + 3 > size)
+            {
+                return false;
+            }
+            count = (pData[pos + 1] << 8) | pData[pos + 2];
+            pos += 3;
+        }
+        else
+        {
+            count = (0 == a) ? (pData[pos] & 0x1F) : pData[pos];
+            pos++;
+        }
+
+        for (int i = 0; i < count; i++)
         {
-            free(pCodecContext->extradata);
+            bool    found = false;
+            int     nalSize;
+
+            if (pos + 2 > size)
+            {
+                return false;
+            }
+            nalSize = (pData[pos] << 8) | pData[pos + 1];
+            pos += 2;
+
+            if (nalSize > size - pos)
+            {
+                return false;
+            }
+            AddNalUnit(&pData[pos], nalSize, m_parameterSets, &found);
+            pos += nalSize;
         }
+    }
+    return true;
+}
 
-        pCodecContext->extradata = (unsigned char *)malloc(spsPpsDatalength);
-        pCodecContext->extradata_size = spsPpsDatalength;
-        memcpy(pCodecContext->extradata, &pCodedFrame[spsPpsStart], spsPpsDatalength);
+QByteArray ParameterSetTracker::PackNalUnits()
+{
+    QByteArray data;
+
+    for (int i = 0; i < PARAMETER_SET_TYPES; i++)
+    {
+        for (int j = 0; j < m_parameterSets[i].size(); j++)
+        {
+            const QByteArray&   nal = m_parameterSets[i].at(j);
+
+            if (m_nalLengthSize > 0)
+            {
+                for (int k = m_nalLengthSize - 1; k >= 0; k--)
+                {
+                    data.append((char)((nal.size() >> (8*k)) & 0xFF));
+                }
+            }
+            else
+            {
+                data.append("\x00\x00\x00\x01", 4);
+            }
+            data.append(nal);
+        }
+    }
+    return data;
+}
+
+QByteArray ParameterSetTracker::BuildExtradata()
+{
+    const QList<QByteArray>&    spsList = m_parameterSets[PARAMETER_SET_SPS];
+    const QList<QByteArray>&    ppsList = m_parameterSets[PARAMETER_SET_PPS];
+    QByteArray                  record;
+
+    // Annex B stream - parameter sets with start codes
+    if (0 == m_nalLengthSize)
+    {
+        return PackNalUnits();
+    }
+
+    // HEVC record needs profile data parsed from VPS/SPS, so it is kept from stream start
+    if (m_codecId != AV_CODEC_ID_H264 || spsList.isEmpty() || ppsList.isEmpty() || spsList.first().size() < 4)
+    {
+        return QByteArray();
+    }
+
+    // avcC: version, profile, compatibility and level (from SPS), NAL unit length size, SPS and PPS arrays
+    record.append((char)1);
+    record.append(spsList.first().mid(1, 3));
+    record.append((char)(0xFC | (m_nalLengthSize - 1)));
+    record.append((char)(0xE0 | std::min(spsList.size(), 31)));
+    for (int i = 0; i < std::min(spsList.size(), 31); i++)
+    {
+        record.append((char)((spsList.at(i).size() >> 8) & 0xFF));
+        record.append((char)(spsList.at(i).size() & 0xFF));
+        record.append(spsList.at(i));
+    }
+    record.append((char)std::min(ppsList.size(), 255));
+    for (int i = 0; i < std::min(ppsList.size(), 255); i++)
+    {
+        record.append((char)((ppsList.at(i).size() >> 8) & 0xFF));
+        record.append((char)(ppsList.at(i).size() & 0xFF));
+        record.append(ppsList.at(i));
+    }
+    return record;
+}
+
+ActivityGate::ActivityGate(double fps, int sleepDelaySec, double wakeRatio, double sleepRatio) :
+    m_sleepDelayMs(sleepDelaySec * 1000LL),
+    m_wakeRatio(wakeRatio),
+    m_sleepRatio(sleepRatio),
+    m_fastSize(0.0),
+    m_idleSize(0.0),
+    m_lastKeySize(0.0),
+    m_activityRatio(1.0),
+    m_staticSince(-1),
+    m_framesSinceKey(0),
+    m_gopLength(0),
+    m_sleeping(false)
+{
+    fps = std::max(fps, 1.0);
+    m_fastAlpha = 1.0 / std::max(1.0, fps * 0.5);
+    m_slowAlpha = 1.0 / (fps * 300.0);
+}
+
+bool ActivityGate::Update(const AVPacket* pPacket, int64_t timeMs)
+{
+    double  size = pPacket->size;
+    bool    keyChanged = false;
+
+    if (pPacket->flags & AV_PKT_FLAG_KEY)
+    {
+        // Keyframe size of static scene is almost constant
+        keyChanged = (m_lastKeySize > 0.0) && (size > m_lastKeySize * m_wakeRatio || size * m_wakeRatio < m_lastKeySize);
+        m_lastKeySize = size;
+        m_gopLength = m_framesSinceKey + 1;
+        m_framesSinceKey = 0;
+    }
+    else
+    {
+        m_framesSinceKey++;
+
+        if (m_fastSize <= 0.0)
+        {
+            m_fastSize = size;
+            m_idleSize = size;
+        }
+        m_fastSize += (size - m_fastSize) * m_fastAlpha;
+
+        // Idle level follows quieter scene immediately, but louder one very slowly
+        m_idleSize += (m_fastSize - m_idleSize) * ((m_fastSize < m_idleSize) ? m_fastAlpha : m_slowAlpha);
+        m_activityRatio = m_fastSize / std::max(m_idleSize, 1.0);
+    }
+
+    if (keyChanged || m_activityRatio >= m_sleepRatio)
+    {
+        m_staticSince = -1;
+    }
+    else if (m_staticSince < 0)
+    {
+        m_staticSince = timeMs;
+    }
+
+    if (m_sleeping)
+    {
+        m_sleeping = !(keyChanged || m_activityRatio >= m_wakeRatio);
+    }
+    else
+    {
+        m_sleeping = (m_staticSince >= 0) && (timeMs - m_staticSince >= m_sleepDelayMs);
     }
 
+    return !m_sleeping;
 }
 
 IntervalTimer::IntervalTimer(int intervalLengthSec) :
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <QList>
 #include <QMutex>
 #include <QObject>
+#include <QByteArray>
 #include <QImage>
 #include <QFile>
 #include <QTimeZone>
@@ -98,6 +100,7 @@ public:
     void        UpdateRGB();                    /// Convert current YUV data to RGB
 
     double      nativeTimeInSeconds;
+    double      presentationTimeInSeconds;  /// Frame pts (for timed metadata)
     int64_t     userTimestamp;
     int64_t     number;
 
@@ -193,6 +196,8 @@ public:
     void SetSize(int width, int height);
 
     void Add(AccumlatorBuffer* pInBuffer, float weight = 1.0f);
+    void Add(const float* pData, int width, int height, int stride, float weight = 1.0f);
+    void Scale(float scale);
     void AddBuffer(VideoBuffer* pInBuffer, float weight = 1.0f);
 
     void Blur(int radius = 3);
@@ -217,7 +222,80 @@ private:
 };
 
 /*
- *  Function for copy sps/pps data from nal unit to AVFormat codec parameters
+ * Tracker of H.264 (SPS/PPS) and HEVC (VPS/SPS/PPS) parameter sets of single input stream
+ * Owned by stream source, which updates it with keyframes. Only NAL units before the first slice are parsed,
+ * and extradata is rebuilt only if parameter sets are changed.
+ * Packet format is taken from initial extradata: avcC/hvcC record means length-prefixed NAL units (RTMP, files),
+ * otherwise packets are Annex B (RTSP). Extradata keeps the stream format, so all muxers of the stream
+ * share it and use version to detect changes. Keyframes without parameter sets get them in-band,
+ * so any keyframe (preroll, clip, live output start) can be decoded on its own.
  */
-void FillSPSPPS(AVCodecParameters* pCodecContext, AVPacket* pPacket);
+class ParameterSetTracker
+{
+public:
+    ParameterSetTracker();
+    ~ParameterSetTracker();
+
+    void        Reset(const AVCodecParameters* pCodecParams);   /// New stream (codec, initial extradata and packet format)
+    bool        Update(const AVPacket* pPacket);                /// Returns true if parameter sets were changed
+    QByteArray  KeyframePrefix();                               /// Parameter sets to prepend to keyframes (empty if they are in-band)
+
+    int         Version();                                      /// Incremented on each extradata change
+    QByteArray  Extradata();
+    void        ApplyTo(AVCodecParameters* pCodecParams, int* pVersion = NULL);
+
+private:
+    enum { PARAMETER_SET_VPS, PARAMETER_SET_SPS, PARAMETER_SET_PPS, PARAMETER_SET_TYPES };
+
+    QMutex              m_mutex;
+    AVCodecID           m_codecId;
+    int                 m_nalLengthSize;                            /// NAL unit length size of avcC/hvcC stream (0 - Annex B)
+    QList<QByteArray>   m_parameterSets[PARAMETER_SET_TYPES];       /// NAL units of each type (without start codes or lengths)
+    QByteArray          m_extradata;
+    QByteArray          m_keyframePrefix;                           /// Parameter sets in stream format (packed on change only)
+    bool                m_inBandSets;                               /// Last keyframe carried its own SPS and PPS
+    int                 m_version;
+
+    /// Collect parameter sets from packet data in stream format (up to the first VCL NAL unit)
+    bool        ParseNalUnits(const uint8_t* pData, int size, QList<QByteArray> parameterSets[PARAMETER_SET_TYPES]);
+    /// Store NAL unit if it is parameter set (returns false for VCL NAL unit - no parameter sets after it)
+    bool        AddNalUnit(const uint8_t* pNal, int size, QList<QByteArray> parameterSets[PARAMETER_SET_TYPES], bool* pFound);
+    bool        ParseConfigRecord(const uint8_t* pData, int size);  /// avcC / hvcC extradata
+    QByteArray  PackNalUnits();                                     /// All parameter sets in stream format
+    QByteArray  BuildExtradata();
+};
+
+/*
+ * Scene activity estimator working on compressed packets (before decoding)
+ * Inter frame sizes of fixed quality stream grow with scene activity, so their short-term average
+ * is compared with slowly adapted idle level. Keyframe size jumps (e.g. light changes) are also treated as activity.
+ * After static period gate goes to sleep (only keyframes need to be decoded) and wakes up on first activity rise.
+ */
+class ActivityGate
+{
+public:
+    ActivityGate(double fps, int sleepDelaySec, double wakeRatio, double sleepRatio);
+
+    bool    Update(const AVPacket* pPacket, int64_t timeMs);    /// Returns true if packet should be decoded (gate is open)
+
+    bool    IsSleeping() { return m_sleeping; }
+    double  ActivityRatio() { return m_activityRatio; }         /// Short-term inter frame size to idle level
+    int     GopLength() { return m_gopLength; }                 /// Last measured keyframe interval (in packets)
+
+private:
+    double  m_fastAlpha;            /// Short-term averaging (~0.5 sec)
+    double  m_slowAlpha;            /// Idle level adaptation to higher values (~5 min)
+    int64_t m_sleepDelayMs;
+    double  m_wakeRatio;
+    double  m_sleepRatio;
+
+    double  m_fastSize;             /// Short-term average of inter frame size
+    double  m_idleSize;             /// Inter frame size for static scene
+    double  m_lastKeySize;
+    double  m_activityRatio;
+    int64_t m_staticSince;          /// Time, when scene became static (-1 if active)
+    int     m_framesSinceKey;
+    int     m_gopLength;
+    bool    m_sleeping;
+};
 
@@ -0,0 +1,360 @@
+#include <QDir>
+#include <QFile>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
+
+#include "clipExporter.h"
+#include "pipelineMetrics.h"
+
+ClipExporter::ClipExporter(QObject* parent) :
+    QObject(parent)
+{
+    DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
+
+    m_archiveFolder = pDataDirectory->pipelineParams.archivePath;
+    m_archiveFolder += '/';
+    m_archiveFolder += pDataDirectory->pipelineParams.pipelineName;
+
+    m_shortArchiveFolder = '/';
+    m_shortArchiveFolder += pDataDirectory->pipelineParams.pipelineName;
+}
+
+ClipExporter::~ClipExporter()
+{
+
+}
+
+void ClipExporter::HandleCommand(QVariantMap command)
+{
+    if (command["command"].toString() != "export")
+    {
+        return;
+    }
+
+    qint64 startTime = command["start"].toLongLong();
+    qint64 endTime = command["end"].toLongLong();
+
+    if (endTime <= startTime)
+    {
+        QVariantMap result;
+
+        result.insert("command", "export");
+        result.insert("status", "error");
+        result.insert("error", "Invalid export range");
+        emit ExportFinished(result);
+        return;
+    }
+
+    ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "ClipExporter", "Export requested for %lld - %lld", startTime, endTime);
+
+    // Export can take a while for long periods
+    QtConcurrent::run(this, &ClipExporter::Export, startTime, endTime);
+}
+
+void ClipExporter::Export(qint64 startTime, qint64 endTime)
+{
+    QElapsedTimer   timer;
+    QVariantMap     result;
+    qint64          durationMs = 0;
+
+    timer.start();
+
+    result.insert("command", "export");
+    result.insert("start", startTime);
+    result.insert("end", endTime);
+
+    QList<ArchiveSegmentIndex> segments = FindSegments(startTime, endTime);
+
+    if (segments.isEmpty())
+    {
+        result.insert("status", "error");
+        result.insert("error", "No archive segments found for requested period");
+        emit ExportFinished(result);
+        return;
+    }
+
+    QString fileName = ReserveFileName(startTime, endTime);
+
+    if (fileName.isEmpty())
+    {
+        result.insert("status", "error");
+        result.insert("error", "Failed to create export file");
+        emit ExportFinished(result);
+        return;
+    }
+
+    if (CAMERA_PIPELINE_OK != CopyPackets(segments, startTime, endTime,
+                                          m_archiveFolder + '/' + EXPORT_FOLDER + '/' + fileName, &durationMs))
+    {
+        result.insert("status", "error");
+        result.insert("error", "Failed to copy archive packets");
+        emit ExportFinished(result);
+        return;
+    }
+
+    ERROR_MESSAGE4(ERR_TYPE_MESSAGE, "ClipExporter", "Exported %lld ms from %d segments in %lld ms to %s",
+                   durationMs, segments.size(), timer.elapsed(), fileName.toUtf8().constData());
+
+    PipelineMetrics::instance()->AddCounter("export_clips_total");
+
+    result.insert("status", "ok");
+    result.insert("file", m_shortArchiveFolder + '/' + EXPORT_FOLDER + '/' + fileName);
+    result.insert("duration_ms", durationMs);
+    result.insert("elapsed_ms", timer.elapsed());
+    emit ExportFinished(result);
+}
+
+QString ClipExporter::ReserveFileName(qint64 startTime, qint64 endTime)
+{
+    QMutexLocker    locker(&m_fileNameMutex);
+    QString         baseName = QString("export_%1_%2").arg(startTime).arg(endTime);
+    QString         exportFolder = m_archiveFolder + '/' + EXPORT_FOLDER + '/';
+
+    // Same range can be exported several times (also concurrently), earlier clips are not overwritten
+    for (int i = 0; i < EXPORT_MAX_NAME_SUFFIX; i++)
+    {
+        QString fileName = (0 == i) ? baseName + ".mp4" : QString("%1_%2.mp4").arg(baseName).arg(i);
+
+        if (QFile::exists(exportFolder + fileName) || QFile::exists(exportFolder + fileName + EXPORT_PART_SUFFIX))
+        {
+            continue;
+        }
+
+        // Empty temporary file holds the name until export is finished
+        QFile partFile(exportFolder + fileName + EXPORT_PART_SUFFIX);
+        if (!partFile.open(QIODevice::WriteOnly))
+        {
+            ERROR_MESSAGE1(ERR_TYPE_ERROR, "ClipExporter", "Failed to create %s",
+                           partFile.fileName().toUtf8().constData());
+            return QString();
+        }
+        return fileName;
+    }
+
+    ERROR_MESSAGE1(ERR_TYPE_ERROR, "ClipExporter", "No free file name for %s", baseName.toUtf8().constData());
+    return QString();
+}
+
+QList<ArchiveSegmentIndex> ClipExporter::FindSegments(qint64 startTime, qint64 endTime)
+{
+    QMap<qint64, QString>       candidates;
+    QList<ArchiveSegmentIndex>  segments;
+    QDir                        archiveDir(m_archiveFolder);
+
+    // Segment start time is encoded in file name ('dd_MM_yyyy___HH_mm_ss' before extension)
+    Q_FOREACH (const QString& name, archiveDir.entryList(QStringList() << "*.mp4", QDir::Files))
+    {
+        QString     timeStr = name.left(name.length() - 4);
+        QDateTime   fileTime;
+
+        timeStr.remove(0, timeStr.length() - 21);
+        fileTime = QDateTime::fromString(timeStr, "dd_MM_yyyy___HH_mm_ss");
+
+        if (fileTime.isValid())
+        {
+            candidates.insert(fileTime.toMSecsSinceEpoch(), archiveDir.filePath(name));
+        }
+    }
+
+    // Each segment lasts until the next one starts
+    for (QMap<qint64, QString>::const_iterator it = candidates.constBegin(); it != candidates.constEnd(); ++it)
+    {
+        QMap<qint64, QString>::const_iterator next = it + 1;
+
+        // File names have second precision, so 1 sec margin is used here
+        if ((it.key() - 1000 >= endTime) || (next != candidates.constEnd() && next.key() + 1000 <= startTime))
+        {
+            continue;
+        }
+
+        ArchiveSegmentIndex segment;
+
+        if (CAMERA_PIPELINE_OK != ReadArchiveIndex(it.value(), &segment))
+        {
+            ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "ClipExporter", "No keyframe index for %s",
+                           it.value().toUtf8().constData());
+            continue;
+        }
+
+        segments.append(segment);
+    }
+    return segments;
+}
+
+ErrorCode ClipExporter::CopyPackets(const QList<ArchiveSegmentIndex>& segments,
+                                    qint64 startTime,
+                                    qint64 endTime,
+                                    QString outputFileName,
+                                    qint64* pDurationMs)
+{
+    AVFormatContext*    pOutputCtx = NULL;
+    AVStream*           pOutStream = NULL;
+    AVPacket*           pPacket = av_packet_alloc();
+    QString             partFileName = outputFileName + EXPORT_PART_SUFFIX;
+    QByteArray          partName = partFileName.toUtf8();
+    int64_t             firstTime = -1;         /// Server time of the first exported keyframe
+    int64_t             lastDts = AV_NOPTS_VALUE;
+    bool                finished = false;
+    ErrorCode           result = CAMERA_PIPELINE_OK;
+
+    for (int i = 0; i < segments.size() && !finished && result == CAMERA_PIPELINE_OK; i++)
+    {
+        const ArchiveSegmentIndex&  segment = segments[i];
+        AVFormatContext*            pInputCtx = NULL;
+        QByteArray                  inputName = segment.filePath.toUtf8();
+
+        if (0 > avformat_open_input(&pInputCtx, inputName.constData(), NULL, NULL) ||
+            0 > avformat_find_stream_info(pInputCtx, NULL))
+        {
+            ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "ClipExporter", "Failed to open archive file %s", inputName.constData());
+            avformat_close_input(&pInputCtx);
+            continue;
+        }
+
+        int videoIndex = av_find_best_stream(pInputCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+        if (videoIndex < 0)
+        {
+            avformat_close_input(&pInputCtx);
+            continue;
+        }
+
+        AVStream* pInStream = pInputCtx->streams[videoIndex];
+
+        // Jump to the last keyframe before export start
+        if (firstTime < 0 && !segment.keyFrames.isEmpty())
+        {
+            QMap<int64_t, ArchiveKeyframe>::const_iterator it = segment.keyFrames.upperBound(startTime);
+            if (it != segment.keyFrames.constBegin())
+            {
+                --it;
+                av_seek_frame(pInputCtx, videoIndex,
+                              av_rescale_q(it.value().mediaMs, av_make_q(1, 1000), pInStream->time_base),
+                              AVSEEK_FLAG_BACKWARD);
+            }
+        }
+
+        // Output is created with parameters of the first segment
+        if (NULL == pOutputCtx)
+        {
+            // Muxer reopens output by its name to move index to the front, so temporary name is used here too
+            avformat_alloc_output_context2(&pOutputCtx, NULL, "mp4", partName.constData());
+            if (NULL == pOutputCtx || NULL == (pOutStream = avformat_new_stream(pOutputCtx, NULL)))
+            {
+                ERROR_MESSAGE0(ERR_TYPE_ERROR, "ClipExporter", "Failed to create output context");
+                avformat_close_input(&pInputCtx);
+                result = CAMERA_PIPELINE_ERROR;
+                break;
+            }
+
+            avcodec_parameters_copy(pOutStream->codecpar, pInStream->codecpar);
+            pOutStream->codecpar->codec_tag = 0;
+            pOutStream->time_base = av_make_q(1, DEFAULT_TIMEBASE);
+
+            AVDictionary* opts(0);
+            av_dict_set(&opts, "movflags", "faststart", 0);
+
+            if (0 > avio_open(&pOutputCtx->pb, partName.constData(), AVIO_FLAG_WRITE) ||
+                0 > avformat_write_header(pOutputCtx, &opts))
+            {
+                ERROR_MESSAGE1(ERR_TYPE_ERROR, "ClipExporter", "Failed to open %s for writing", partName.constData());
+                av_dict_free(&opts);
+                avformat_close_input(&pInputCtx);
+                result = CAMERA_PIPELINE_ERROR;
+                break;
+            }
+            av_dict_free(&opts);
+        }
+
+        while (0 <= av_read_frame(pInputCtx, pPacket))
+        {
+            if (pPacket->stream_index != videoIndex || AV_NOPTS_VALUE == pPacket->dts)
+            {
+                av_packet_unref(pPacket);
+                continue;
+            }
+
+            int64_t packetTime = segment.startTime + av_rescale_q(pPacket->dts, pInStream->time_base, av_make_q(1, 1000));
+
+            // Export starts from keyframe
+            if (firstTime < 0 && !(pPacket->flags & AV_PKT_FLAG_KEY))
+            {
+                av_packet_unref(pPacket);
+                continue;
+            }
+
+            if (packetTime > endTime)
+            {
+                av_packet_unref(pPacket);
+                finished = true;
+                break;
+            }
+
+            if (firstTime < 0)
+            {
+                firstTime = packetTime;
+            }
+
+            // Segments are placed on output timeline according to their server start time
+            int64_t offset = av_rescale_q(segment.startTime - firstTime, av_make_q(1, 1000), pOutStream->time_base);
+
+            av_packet_rescale_ts(pPacket, pInStream->time_base, pOutStream->time_base);
+            pPacket->dts += offset;
+            pPacket->pts += offset;
+            pPacket->stream_index = pOutStream->index;
+            pPacket->pos = -1;
+
+            // Keep dts monotonic on segment boundaries
+            if (AV_NOPTS_VALUE != lastDts && pPacket->dts <= lastDts)
+            {
+                int64_t shift = lastDts + 1 - pPacket->dts;
+                pPacket->dts += shift;
+                pPacket->pts += shift;
+            }
+            lastDts = pPacket->dts;
+            *pDurationMs = packetTime - firstTime;
+
+            if (0 > av_interleaved_write_frame(pOutputCtx, pPacket))
+            {
+                ERROR_MESSAGE0(ERR_TYPE_ERROR, "ClipExporter", "av_interleaved_write_frame() failed");
+                result = CAMERA_PIPELINE_ERROR;
+                break;
+            }
+        }
+        avformat_close_input(&pInputCtx);
+    }
+
+    if (NULL != pOutputCtx)
+    {
+        if (NULL != pOutputCtx->pb)
+        {
+            if (result == CAMERA_PIPELINE_OK && 0 > av_write_trailer(pOutputCtx))
+            {
+                ERROR_MESSAGE1(ERR_TYPE_ERROR, "ClipExporter", "Failed to finalize %s", partName.constData());
+                result = CAMERA_PIPELINE_ERROR;
+            }
+            avio_closep(&pOutputCtx->pb);
+        }
+        avformat_free_context(pOutputCtx);
+    }
+    av_packet_free(&pPacket);
+
+    if (firstTime < 0)
+    {
+        ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "ClipExporter", "No packets found for requested period");
+        result = CAMERA_PIPELINE_ERROR;
+    }
+
+    // Complete clip appears under its final name at once, incomplete one is not left in export folder
+    if (result == CAMERA_PIPELINE_OK && !QFile::rename(partFileName, outputFileName))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "ClipExporter", "Failed to rename %s", partName.constData());
+        result = CAMERA_PIPELINE_ERROR;
+    }
+
+    if (result != CAMERA_PIPELINE_OK)
+    {
+        QFile::remove(partFileName);
+    }
+    return result;
+}
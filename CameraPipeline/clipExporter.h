@@ -0,0 +1,53 @@
+#ifndef CLIPEXPORTER_H
+#define CLIPEXPORTER_H
+
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QVariantMap>
+
+#include "cameraPipelineCommon.h"
+#include "archiveIndex.h"
+
+#define  EXPORT_FOLDER           "exports"   // Subfolder of camera archive folder for exported clips
+#define  EXPORT_PART_SUFFIX      ".part"     // Clip is written under this suffix and renamed when complete
+#define  EXPORT_MAX_NAME_SUFFIX  1000        // Limit of numbered names for the same export range
+
+/*
+ * Export of archive time range to single mp4 file
+ * Packets are stream-copied (without decoding) from consecutive archive segments,
+ * segment start positions are found with keyframe index sidecars.
+ * Export is requested with {"command":"export","start":ms,"end":ms} via DataDirectory.
+ * Each export gets its own file name (suffix is added for repeated ranges), clip is written
+ * to temporary '.part' file and renamed only after trailer is written, so reported file is complete.
+ */
+class ClipExporter : public QObject
+{
+    Q_OBJECT
+public:
+    ClipExporter(QObject* parent = NULL);
+    ~ClipExporter();
+
+signals:
+    void    ExportFinished(QVariantMap result);         /// Emitted from worker thread
+
+public slots:
+    void    HandleCommand(QVariantMap command);
+
+private:
+    QString     m_archiveFolder;                        /// Full path to camera archive folder
+    QString     m_shortArchiveFolder;                   /// Archive folder url (same as for archive files)
+    QMutex      m_fileNameMutex;                        /// Exports run concurrently in thread pool
+
+    void        Export(qint64 startTime, qint64 endTime);
+    QString     ReserveFileName(qint64 startTime, qint64 endTime);
+    QList<ArchiveSegmentIndex>  FindSegments(qint64 startTime, qint64 endTime);
+    ErrorCode   CopyPackets(const QList<ArchiveSegmentIndex>& segments,
+                            qint64 startTime,
+                            qint64 endTime,
+                            QString outputFileName,
+                            qint64* pDurationMs);
+};
+
+#endif // CLIPEXPORTER_H
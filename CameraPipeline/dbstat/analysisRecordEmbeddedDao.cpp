@@ -0,0 +1,159 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+#include "analysisRecordEmbeddedDao.h"
+#include "pipelineConfig.h"
+
+AnalysisRecordEmbeddedDao::AnalysisRecordEmbeddedDao(QString connectionName, QString camName) :
+    AnalysisRecordDao(connectionName, camName)
+{
+
+}
+
+QString AnalysisRecordEmbeddedDao::DatabaseFileName()
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    QString         path = pDataDirectory->pipelineParams.databasePath;
+
+    if (QFileInfo(path).isAbsolute())
+    {
+        return path;
+    }
+    return QDir(pDataDirectory->pipelineParams.dataPath).absoluteFilePath(path + ".sqlite");
+}
+
+QString AnalysisRecordEmbeddedDao::DriverName()
+{
+    return QString("QSQLITE");
+}
+
+void AnalysisRecordEmbeddedDao::SetConnectionParams()
+{
+    QString fileName = DatabaseFileName();
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    // Several connections (statistics, writer, reanalysis workers) share the file
+    m_DB.setDatabaseName(fileName);
+    m_DB.setConnectOptions(QString("QSQLITE_BUSY_TIMEOUT=%1").arg(DB_SQLITE_BUSY_TIMEOUT_MSEC));
+}
+
+ErrorCode AnalysisRecordEmbeddedDao::ConfigureConnection()
+{
+    QSqlQuery   query(m_DB);
+    QStringList pragmas;
+    QStringList version;
+    int         versionNumber;
+
+    // Qt may be linked with system SQLite, which is too old for baselines UPSERT
+    if (!query.exec("SELECT sqlite_version()") || !query.next())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_CRITICAL,
+                       "AnalysisRecordDao",
+                       "Failed to get SQLite version: %s",
+                       query.lastError().text().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    version = query.value(0).toString().split('.');
+    versionNumber = version.value(0).toInt() * 1000000 + version.value(1).toInt() * 1000 + version.value(2).toInt();
+
+    if (versionNumber < DB_SQLITE_MIN_VERSION)
+    {
+        ERROR_MESSAGE3(ERR_TYPE_CRITICAL,
+                       "AnalysisRecordDao",
+                       "SQLite %s is not supported, %d.%d or newer is required",
+                       query.value(0).toString().toUtf8().constData(),
+                       DB_SQLITE_MIN_VERSION / 1000000,
+                       (DB_SQLITE_MIN_VERSION / 1000) % 1000);
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    // WAL: one writer and any number of readers work simultaneously, commit does not rewrite pages
+    // NORMAL synchronous mode is durable in WAL mode except last transactions on power loss
+    pragmas << "PRAGMA journal_mode=WAL"
+            << "PRAGMA synchronous=NORMAL"
+            << QString("PRAGMA mmap_size=%1").arg(DB_SQLITE_MMAP_SIZE)
+            << "PRAGMA temp_store=MEMORY";
+
+    for (int i = 0; i < pragmas.size(); i++)
+    {
+        if (!query.exec(pragmas.at(i)))
+        {
+            ERROR_MESSAGE2(ERR_TYPE_WARNING,
+                           "AnalysisRecordDao",
+                           "Failed to execute %s: %s",
+                           pragmas.at(i).toUtf8().constData(),
+                           query.lastError().text().toUtf8().constData());
+        }
+    }
+
+    return CAMERA_PIPELINE_OK;
+}
+
+void AnalysisRecordEmbeddedDao::UpdateSchema()
+{
+    QSqlQuery   query(m_DB);
+    QStringList statements;
+
+    // Same columns as server tables (records id and events id are autoincremented)
+    statements << "CREATE TABLE IF NOT EXISTS records ("
+                  "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                  "cam TEXT, "
+                  "date INTEGER, "
+                  "start_time INTEGER, "
+                  "end_time INTEGER, "
+                  "media_source TEXT, "
+                  "video_archive TEXT, "
+                  "heatmap TEXT, "
+                  "stats_data TEXT, "
+                  "stats_blob BLOB, "
+                  "start_posix_time INTEGER, "
+                  "end_posix_time INTEGER)"
+
+               << "CREATE INDEX IF NOT EXISTS records_cam_date_idx ON records (cam, date, start_time)"
+
+               << "CREATE TABLE IF NOT EXISTS events ("
+                  "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                  "cam TEXT, "
+                  "date INTEGER, "
+                  "start_timestamp INTEGER, "
+                  "end_timestamp INTEGER, "
+                  "type INTEGER, "
+                  "confidence INTEGER, "
+                  "reaction INTEGER, "
+                  "archive_file1 TEXT, "
+                  "archive_file2 TEXT, "
+                  "file_offset_sec INTEGER)"
+
+               << "CREATE INDEX IF NOT EXISTS events_cam_start_idx ON events (cam, start_timestamp)"
+
+               << "CREATE TABLE IF NOT EXISTS baselines ("
+                  "cam TEXT NOT NULL, "
+                  "slot INTEGER NOT NULL, "
+                  "day_of_week INTEGER NOT NULL, "
+                  "target_day INTEGER NOT NULL, "
+                  "weight_sum REAL NOT NULL, "
+                  "stats_blob BLOB, "
+                  "PRIMARY KEY (cam, slot, day_of_week))";
+
+    for (int i = 0; i < statements.size(); i++)
+    {
+        if (!query.exec(statements.at(i)))
+        {
+            ERROR_MESSAGE2(ERR_TYPE_ERROR,
+                           "AnalysisRecordDao",
+                           "Failed to update schema: %s\nSQL Error: %s",
+                           statements.at(i).toUtf8().constData(),
+                           query.lastError().text().toUtf8().constData());
+        }
+    }
+}
+
+QString AnalysisRecordEmbeddedDao::StatsColumnSql()
+{
+    // Embedded DB is created with binary statistics only
+    return QString("stats_blob");
+}
@@ -0,0 +1,29 @@
+#ifndef ANALYSISRECORDEMBEDDEDDAO_H
+#define ANALYSISRECORDEMBEDDEDDAO_H
+
+#include "analysisRecordSQliteDao.h"
+
+/*
+ * Embedded SQLite backend for standalone devices (no DB server)
+ * Database file is opened in WAL mode (readers are not blocked by writer thread)
+ * with memory mapped reads. All tables and indexes are created on open.
+ * File is kept in data path (outside of archive, which is served by archive HTTP server).
+ */
+class AnalysisRecordEmbeddedDao : public AnalysisRecordDao
+{
+    Q_OBJECT
+public:
+    AnalysisRecordEmbeddedDao(QString connectionName = QString(), QString camName = QString());
+
+    /// Database file: "Database Path" if absolute, otherwise <data path>/<Database Path>.sqlite
+    static QString DatabaseFileName();
+
+protected:
+    QString     DriverName();
+    void        SetConnectionParams();
+    ErrorCode   ConfigureConnection();  /// Fails if SQLite library is older than DB_SQLITE_MIN_VERSION
+    void        UpdateSchema();
+    QString     StatsColumnSql();
+};
+
+#endif // ANALYSISRECORDEMBEDDEDDAO_H
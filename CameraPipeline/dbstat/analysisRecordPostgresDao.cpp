@@ -0,0 +1,60 @@
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+#include "analysisRecordPostgresDao.h"
+
+AnalysisRecordPostgresDao::AnalysisRecordPostgresDao(QString connectionName, QString camName) :
+    AnalysisRecordDao(connectionName, camName)
+{
+
+}
+
+QString AnalysisRecordPostgresDao::DriverName()
+{
+    return QString("QPSQL");
+}
+
+void AnalysisRecordPostgresDao::SetConnectionParams()
+{
+    m_DB.setHostName("localhost");
+    m_DB.setPort(5432);
+    m_DB.setDatabaseName((DataDirectoryInstance::instance())->pipelineParams.databasePath);
+    m_DB.setUserName("va");
+    m_DB.setPassword("theorema");
+}
+
+void AnalysisRecordPostgresDao::UpdateSchema()
+{
+    QSqlQuery query(m_DB);
+
+    // Statistics are stored as raw bytes (stats_data keeps base64 text of older records)
+    if (!query.exec("ALTER TABLE records ADD COLUMN IF NOT EXISTS stats_blob bytea"))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR,
+                       "AnalysisRecordDao",
+                       "Failed to add stats_blob column: %s",
+                       query.lastError().text().toUtf8().constData());
+    }
+
+    // Rolling baselines (merged statistics of recent intervals for each slot and day of week)
+    if (!query.exec("CREATE TABLE IF NOT EXISTS baselines ("
+                    "cam text NOT NULL, "
+                    "slot integer NOT NULL, "
+                    "day_of_week integer NOT NULL, "
+                    "target_day integer NOT NULL, "
+                    "weight_sum double precision NOT NULL, "
+                    "stats_blob bytea, "
+                    "PRIMARY KEY (cam, slot, day_of_week))"))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR,
+                       "AnalysisRecordDao",
+                       "Failed to create baselines table: %s",
+                       query.lastError().text().toUtf8().constData());
+    }
+}
+
+QString AnalysisRecordPostgresDao::StatsColumnSql()
+{
+    // Old records have base64 text statistics only, they are decoded by server
+    return QString("COALESCE(stats_blob, decode(stats_data, 'base64'))");
+}
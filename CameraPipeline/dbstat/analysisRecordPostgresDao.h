@@ -0,0 +1,22 @@
+#ifndef ANALYSISRECORDPOSTGRESDAO_H
+#define ANALYSISRECORDPOSTGRESDAO_H
+
+#include "analysisRecordSQliteDao.h"
+
+/*
+ * PostgreSQL backend (shared server DB, records and events tables are created by server side)
+ */
+class AnalysisRecordPostgresDao : public AnalysisRecordDao
+{
+    Q_OBJECT
+public:
+    AnalysisRecordPostgresDao(QString connectionName = QString(), QString camName = QString());
+
+protected:
+    QString DriverName();
+    void    SetConnectionParams();
+    void    UpdateSchema();             /// Add binary statistics column and baselines table to old databases
+    QString StatsColumnSql();
+};
+
+#endif // ANALYSISRECORDPOSTGRESDAO_H
@@ -1,4 +1,6 @@
 
+#include <algorithm>
+
 #include <QDebug>
 
 #include <QBuffer>
@@ -13,22 +15,66 @@
 #include <QVariant>
 
 #include "analysisRecordSQliteDao.h"
+#include "analysisRecordPostgresDao.h"
+#include "analysisRecordEmbeddedDao.h"
+#include "pipelineConfig.h"
+#include "pipelineMetrics.h"
 
 #define ALIGN_TO_SEC(n)  (((n)/1000)*1000)
 
-AnalysisRecordDao::AnalysisRecordDao()
+AnalysisRecordDao::AnalysisRecordDao(QString connectionName, QString camName) :
+    m_pInsertRecordQuery(NULL),
+    m_pInsertEventsQuery(NULL),
+    m_insertEventsRows(0),
+    m_connectionName(connectionName),
+    m_camName(camName)
+{
+    DEBUG_MESSAGE0("AnalysisRecordDao", "AnalysisRecordDao() called");
+
+    if (m_camName.isEmpty())
+    {
+        m_camName = (DataDirectoryInstance::instance())->pipelineParams.pipelineName;
+    }
+    m_statsCamName = (DataDirectoryInstance::instance())->pipelineParams.pipelineName;
+}
+
+AnalysisRecordDao* AnalysisRecordDao::Create(QString connectionName, QString camName)
+{
+    QString             backend = (DataDirectoryInstance::instance())->pipelineParams.databaseBackend.toLower();
+    AnalysisRecordDao*  pDao;
+
+    if (backend == "sqlite")
+    {
+        pDao = new AnalysisRecordEmbeddedDao(connectionName, camName);
+    }
+    else
+    {
+        if (backend != "postgres")
+        {
+            ERROR_MESSAGE1(ERR_TYPE_WARNING, "AnalysisRecordDao", "Unknown database backend '%s', postgres is used",
+                           backend.toUtf8().constData());
+        }
+        pDao = new AnalysisRecordPostgresDao(connectionName, camName);
+    }
+
+    // DAO is returned even if DB is not available (connection is restored by Reopen())
+    pDao->Open();
+
+    return pDao;
+}
+
+ErrorCode AnalysisRecordDao::Open()
 {
-    DEBUG_MESSAGE0("AnalysisRecordSQLiteDao", "AnalysisRecordSQLiteDao() called");
-    m_DB = QSqlDatabase::addDatabase("QPSQL");
-    m_DB.setHostName("localhost");
-    m_DB.setPort(5432);
-    m_DB.setDatabaseName((DataDirectoryInstance::instance())->pipelineParams.databasePath);
-    m_DB.setUserName("va");
-    m_DB.setPassword("theorema");
+    if (m_connectionName.isEmpty())
+    {
+        m_DB = QSqlDatabase::addDatabase(DriverName());
+    }
+    else
+    {
+        m_DB = QSqlDatabase::addDatabase(DriverName(), m_connectionName);
+    }
+    SetConnectionParams();
     m_DB.open();
-    //m_DB = QSqlDatabase::addDatabase("QSQLITE");
-    //m_DB.setDatabaseName(m_dbFile.absoluteFilePath());
-    //m_DB.open();
 
     if (!m_DB.isOpen())
     {
@@ -36,28 +82,117 @@ AnalysisRecordDao::AnalysisRecordDao()
                        "AnalysisRecordDao",
                        "Failed to open database: %s",
                        m_DB.lastError().text().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
     }
+
+    if (CAMERA_PIPELINE_OK != ConfigureConnection())
+    {
+        m_DB.close();
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    UpdateSchema();
+
+    return CAMERA_PIPELINE_OK;
 }
 
 AnalysisRecordDao::~AnalysisRecordDao()
 {
     DEBUG_MESSAGE0("AnalysisRecordDao", "~AnalysisRecordDao() called");
+    ClearPreparedQueries();
     m_DB.close();
+
+    if (!m_connectionName.isEmpty())
+    {
+        m_DB = QSqlDatabase();  // Connection can be removed only when it is not used
+        QSqlDatabase::removeDatabase(m_connectionName);
+    }
     DEBUG_MESSAGE0("AnalysisRecordDao", "~AnalysisRecordDao() finished");
 }
 
+void AnalysisRecordDao::ClearPreparedQueries()
+{
+    SAFE_DELETE(m_pInsertRecordQuery);
+    SAFE_DELETE(m_pInsertEventsQuery);
+    m_insertEventsRows = 0;
+}
+
+bool AnalysisRecordDao::IsOpen()
+{
+    return m_DB.isOpen();
+}
+
+ErrorCode AnalysisRecordDao::Reopen()
+{
+    ClearPreparedQueries();
+    m_DB.close();
+
+    if (!m_DB.open())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE,
+                       "AnalysisRecordDao",
+                       "Failed to reopen database: %s",
+                       m_DB.lastError().text().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if (CAMERA_PIPELINE_OK != ConfigureConnection())
+    {
+        m_DB.close();
+        return CAMERA_PIPELINE_ERROR;
+    }
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode AnalysisRecordDao::BeginTransaction()
+{
+    if (!m_DB.transaction())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE,
+                       "AnalysisRecordDao",
+                       "Failed to start transaction: %s",
+                       m_DB.lastError().text().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode AnalysisRecordDao::CommitTransaction()
+{
+    if (!m_DB.commit())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE,
+                       "AnalysisRecordDao",
+                       "Failed to commit transaction: %s",
+                       m_DB.lastError().text().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+    return CAMERA_PIPELINE_OK;
+}
+
+void AnalysisRecordDao::RollbackTransaction()
+{
+    m_DB.rollback();
+}
+
 ErrorCode AnalysisRecordDao::InsertRecord(const AnalysisRecordModel& record)
 {
-    QSqlQuery   query;
     QByteArray  heatmap;
 
-    query.prepare("INSERT INTO records "
-                  "(cam, date, start_time, end_time, media_source, video_archive, heatmap, stats_data, start_posix_time, end_posix_time) "
-                  "VALUES "
-                  "(:cam, :date, :startTime, :endTime, :mediaSource, :videoArchive, :heatmap, :statsData, :startPosix, :endPosix)");
+    // Statement is prepared once and reused for all records
+    if (NULL == m_pInsertRecordQuery)
+    {
+        m_pInsertRecordQuery = new QSqlQuery(m_DB);
+        m_pInsertRecordQuery->prepare("INSERT INTO records "
+                                      "(cam, date, start_time, end_time, media_source, video_archive, heatmap, stats_data, stats_blob, start_posix_time, end_posix_time) "
+                                      "VALUES "
+                                      "(:cam, :date, :startTime, :endTime, :mediaSource, :videoArchive, :heatmap, :statsData, :statsBlob, :startPosix, :endPosix)");
+    }
+
+    QSqlQuery&  query = *m_pInsertRecordQuery;
 
     // Cam name
-    query.bindValue(":cam", (DataDirectoryInstance::instance())->pipelineParams.pipelineName.toUtf8().constData());
+    query.bindValue(":cam", m_camName.toUtf8().constData());
 
     // Frame thumbnail (full-size image)
     if (!record.heatmap.isNull())
@@ -68,12 +203,20 @@ ErrorCode AnalysisRecordDao::InsertRecord(const AnalysisRecordModel& record)
         heatmapBuffer.close();
         query.bindValue(":heatmap", QString(heatmap.toBase64()));
     }
+    else
+    {
+        query.bindValue(":heatmap", QVariant(QVariant::String));
+    }
 
     // Date
     if (record.date.isValid())
     {
         query.bindValue(":date", (int)record.date.toJulianDay());
     }
+    else
+    {
+        query.bindValue(":date", QVariant(QVariant::Int));
+    }
 
     // Start time
     if (record.startTime.isValid())
@@ -105,15 +248,16 @@ ErrorCode AnalysisRecordDao::InsertRecord(const AnalysisRecordModel& record)
     // Video archive path
     query.bindValue(":videoArchive", record.videoArchive);
 
-    // Statistics (blob)
+    // Statistics (binary blob, text column is left empty)
+    query.bindValue(":statsData", QString(""));
     if (!record.statsData.isNull())
     {
-        query.bindValue(":statsData", QString(record.statsData.toBase64()));
+        query.bindValue(":statsBlob", record.statsData);
     }
     else
     {
         QByteArray empty;
-        query.bindValue(":statsData", empty);
+        query.bindValue(":statsBlob", empty);
         DEBUG_MESSAGE0("AnalysisRecordSQLiteDao", "NULL stats data object inserted");
     }
 
@@ -139,13 +283,15 @@ ErrorCode AnalysisRecordDao::FindStatsForPeriod(
     const QDateTime&              curDateTime,
     int                           periodDays,
     int                           intervalSeconds,
-    QList<AnalysisRecordModel*>&  results
+    QList<IntervalStatistics*>&   results,
+    qint64*                       pFetchedBytes
     )
 {
     QDate       curDate = curDateTime.date();
     QTime       curTime = curDateTime.time();
-    QSqlQuery   query;
-    QString     sql = "SELECT * FROM records WHERE ";
+
+    // Heatmap and other columns are not needed for decision makers
+    QString     sql = "SELECT date, start_time, end_time, " + StatsColumnSql() + ", id FROM records WHERE ";
 
     DEBUG_MESSAGE1("AnalysisRecordSQLiteDao", "Get statistics called ThreadID = %p", QThread::currentThreadId());
 
@@ -153,8 +299,9 @@ ErrorCode AnalysisRecordDao::FindStatsForPeriod(
     // Please note, that at 00:00 - msecs since start of day is 0!!!
     // This time interval should be handled in separate way.
     // @TODO - add this feature in future
+    // Baseline is always taken from camera own statistics (even if records are written with another name)
     sql += "( cam = '";
-    sql += (DataDirectoryInstance::instance())->pipelineParams.pipelineName;
+    sql += m_statsCamName;
     sql += "' AND ";
 
     sql += " date >= ";
@@ -182,35 +329,190 @@ ErrorCode AnalysisRecordDao::FindStatsForPeriod(
 
     sql += " )";
 
-    // This "forward only" drastically increases results parsing speed
-    query.setForwardOnly(true);
+    return FetchStats(sql, QVariantMap(), results, pFetchedBytes);
+}
 
-    query.prepare(sql);
+ErrorCode AnalysisRecordDao::FindStatsForDays(
+    QDate                         firstDate,
+    QDate                         lastDate,
+    int                           firstStartMs,
+    int                           lastStartMs,
+    QList<IntervalStatistics*>&   results,
+    qint64*                       pFetchedBytes
+    )
+{
+    QVariantMap values;
+
+    values[":cam"] = m_statsCamName;
+    values[":firstDate"] = (int)firstDate.toJulianDay();
+    values[":lastDate"] = (int)lastDate.toJulianDay();
+    values[":firstStart"] = firstStartMs;
+    values[":lastStart"] = lastStartMs;
+
+    return FetchStats("SELECT date, start_time, end_time, " + StatsColumnSql() + ", id FROM records "
+                      "WHERE cam = :cam AND date >= :firstDate AND date <= :lastDate "
+                      "AND start_time >= :firstStart AND start_time <= :lastStart",
+                      values, results, pFetchedBytes);
+}
 
-    if (query.exec())
+ErrorCode AnalysisRecordDao::FetchStats(const QString& sql, const QVariantMap& values, QList<IntervalStatistics*>& results, qint64* pFetchedBytes)
+{
+    qint64      fetchedBytes = 0;
+    qint64      maxPageBytes = 0;
+    QVariant    lastDate;
+    QVariant    lastStart;
+    QVariant    lastId;
+    int         rows;
+
+    results.clear();
+
+    // Whole result set is buffered by driver (QPSQL), so records are read in pages:
+    // only one page of raw blobs is kept in memory, each row is decoded right after fetch.
+    // Pages are keyed by last (date, start_time, id) of previous page, so each page
+    // starts right at the index position instead of rescanning skipped rows.
+    do
     {
-        results.clear();
+        QSqlQuery   query(m_DB);
+        QString     pageSql = sql;
+        qint64      pageBytes = 0;
 
-        while(query.next())
+        if (lastId.isValid())
         {
-            AnalysisRecordModel* pRecord = new AnalysisRecordModel; // Memory must be deleted by user after usage
+            pageSql += " AND (date > :pageDate OR (date = :pageDate AND "
+                       "(start_time > :pageStart OR (start_time = :pageStart AND id > :pageId))))";
+        }
 
-            pRecord->id = query.value(0).toInt();                                               // id
-            pRecord->date = QDate::fromJulianDay(query.value(2).toInt());                       // date
-            pRecord->endDate = pRecord->date; // We don't use this here
-            pRecord->startTime = QTime::fromMSecsSinceStartOfDay(query.value(3).toInt());       // start_time
-            pRecord->endTime = QTime::fromMSecsSinceStartOfDay(query.value(4).toInt());         // end_time
-            pRecord->mediaSource = query.value(5).toString();                                   // media_source
-            pRecord->videoArchive = query.value(6).toString();                                  // video_archive
+        // This "forward only" drastically increases results parsing speed
+        query.setForwardOnly(true);
+        query.prepare(pageSql + QString(" ORDER BY date, start_time, id LIMIT %1").arg(STATS_FETCH_PAGE_ROWS));
 
-            pRecord->heatmap = QImage::fromData(QByteArray::fromBase64(query.value(7).toString().toUtf8()), "PNG");           // heatmap
+        for (QVariantMap::const_iterator it = values.constBegin(); it != values.constEnd(); ++it)
+        {
+            query.bindValue(it.key(), it.value());
+        }
 
-            pRecord->statsData = QByteArray::fromBase64(query.value(8).toString().toUtf8());            // stats_data
+        if (lastId.isValid())
+        {
+            query.bindValue(":pageDate", lastDate);
+            query.bindValue(":pageStart", lastStart);
+            query.bindValue(":pageId", lastId);
+        }
 
-            results.append(pRecord);
+        if (!query.exec())
+        {
+            ERROR_MESSAGE2(ERR_TYPE_DISPOSABLE,
+                           "AnalysisRecordSQLiteDao",
+                           "Failed to execute query: %s\nSQL Error: %s",
+                           query.lastQuery().toUtf8().constData(),
+                           query.lastError().text().toUtf8().constData());
+
+            qDeleteAll(results);
+            results.clear();
+            return CAMERA_PIPELINE_ERROR;
         }
+
+        for (rows = 0; query.next(); rows++)
+        {
+            IntervalStatistics* pStats = new IntervalStatistics; // Memory must be deleted by user after usage
+            QByteArray          statsData = query.value(3).toByteArray();                   // stats_blob (or decoded stats_data)
+
+            pStats->date = QDate::fromJulianDay(query.value(0).toInt());                    // date
+            pStats->endDate = pStats->date; // We don't use this here
+            pStats->startTime = QTime::fromMSecsSinceStartOfDay(query.value(1).toInt());    // start_time
+            pStats->endTime = QTime::fromMSecsSinceStartOfDay(query.value(2).toInt());      // end_time
+
+            lastDate = query.value(0);
+            lastStart = query.value(1);
+            lastId = query.value(4);                                                        // id
+            pageBytes += statsData.size();
+
+            if (CAMERA_PIPELINE_OK != pStats->FromByteArray(&statsData))
+            {
+                ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "AnalysisRecordSQLiteDao", "Unable to convert BLOB to interval statistics data");
+                delete pStats;
+                continue;
+            }
+            results.append(pStats);
+        }
+
+        fetchedBytes += pageBytes;
+        maxPageBytes = std::max(maxPageBytes, pageBytes);
     }
-    else
+    while (rows == STATS_FETCH_PAGE_ROWS);
+
+    PipelineMetrics::instance()->SetGauge("stats_fetch_page_bytes", maxPageBytes);
+
+    if (NULL != pFetchedBytes)
+    {
+        *pFetchedBytes = fetchedBytes;
+    }
+
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode AnalysisRecordDao::FindRecordStats(const QDateTime& dateTime, IntervalStatistics* pStats)
+{
+    QSqlQuery   query(m_DB);
+    QByteArray  statsData;
+
+    query.setForwardOnly(true);
+    query.prepare("SELECT date, start_time, end_time, " + StatsColumnSql() + " FROM records "
+                  "WHERE cam = :cam AND date = :date AND start_time <= :time "
+                  "ORDER BY start_time DESC LIMIT 1");
+
+    query.bindValue(":cam", m_camName);
+    query.bindValue(":date", (int)dateTime.date().toJulianDay());
+    query.bindValue(":time", dateTime.time().msecsSinceStartOfDay());
+
+    if (!query.exec())
+    {
+        ERROR_MESSAGE2(ERR_TYPE_DISPOSABLE,
+                       "AnalysisRecordSQLiteDao",
+                       "Failed to execute query: %s\nSQL Error: %s",
+                       query.lastQuery().toUtf8().constData(),
+                       query.lastError().text().toUtf8().constData());
+
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if (!query.next())
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    pStats->date = QDate::fromJulianDay(query.value(0).toInt());
+    pStats->endDate = pStats->date;
+    pStats->startTime = QTime::fromMSecsSinceStartOfDay(query.value(1).toInt());
+    pStats->endTime = QTime::fromMSecsSinceStartOfDay(query.value(2).toInt());
+    statsData = query.value(3).toByteArray();
+
+    return pStats->FromByteArray(&statsData);
+}
+
+ErrorCode AnalysisRecordDao::FindBaselines(int firstSlot, int lastSlot, int dayOfWeek, QList<BaselineRecord>& results)
+{
+    QSqlQuery   query(m_DB);
+    QString     sql = "SELECT slot, day_of_week, target_day, weight_sum, stats_blob "
+                      "FROM baselines WHERE cam = :cam AND slot >= :firstSlot AND slot <= :lastSlot";
+
+    if (dayOfWeek > 0)
+    {
+        sql += " AND day_of_week = :dayOfWeek";
+    }
+
+    query.setForwardOnly(true);
+    query.prepare(sql);
+
+    // Baselines are built from camera own statistics (as in FindStatsForPeriod())
+    query.bindValue(":cam", m_statsCamName);
+    query.bindValue(":firstSlot", firstSlot);
+    query.bindValue(":lastSlot", lastSlot);
+    if (dayOfWeek > 0)
+    {
+        query.bindValue(":dayOfWeek", dayOfWeek);
+    }
+
+    if (!query.exec())
     {
         ERROR_MESSAGE2(ERR_TYPE_DISPOSABLE,
                        "AnalysisRecordSQLiteDao",
@@ -221,65 +523,144 @@ ErrorCode AnalysisRecordDao::FindStatsForPeriod(
         return CAMERA_PIPELINE_ERROR;
     }
 
+    results.clear();
+
+    while(query.next())
+    {
+        BaselineRecord baseline;
+
+        baseline.slot       = query.value(0).toInt();
+        baseline.dayOfWeek  = query.value(1).toInt();
+        baseline.targetDay  = query.value(2).toInt();
+        baseline.weightSum  = query.value(3).toDouble();
+        baseline.statsData  = query.value(4).toByteArray();
+
+        results.append(baseline);
+    }
+
     return CAMERA_PIPELINE_OK;
 }
 
-void AnalysisRecordDao::storeEvent(EventDescription event)
+ErrorCode AnalysisRecordDao::StoreBaseline(const BaselineRecord& baseline)
+{
+    QSqlQuery   query(m_DB);
+
+    query.prepare("INSERT INTO baselines "
+                  "(cam, slot, day_of_week, target_day, weight_sum, stats_blob) "
+                  "VALUES "
+                  "(:cam, :slot, :dayOfWeek, :targetDay, :weightSum, :statsBlob) "
+                  "ON CONFLICT (cam, slot, day_of_week) DO UPDATE SET "
+                  "target_day = EXCLUDED.target_day, weight_sum = EXCLUDED.weight_sum, stats_blob = EXCLUDED.stats_blob");
+
+    query.bindValue(":cam", m_statsCamName);
+    query.bindValue(":slot", baseline.slot);
+    query.bindValue(":dayOfWeek", baseline.dayOfWeek);
+    query.bindValue(":targetDay", baseline.targetDay);
+    query.bindValue(":weightSum", baseline.weightSum);
+    query.bindValue(":statsBlob", baseline.statsData);
+
+    if (!query.exec())
+    {
+        ERROR_MESSAGE2(ERR_TYPE_DISPOSABLE,
+                       "AnalysisRecordSQLiteDao",
+                       "Failed to execute query: %s\nSQL Error: %s",
+                       query.lastQuery().toUtf8().constData(),
+                       query.lastError().text().toUtf8().constData());
+
+        return CAMERA_PIPELINE_ERROR;
+    }
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode AnalysisRecordDao::RemoveCamRecords()
+{
+    QSqlQuery   query(m_DB);
+    const char* tables[] = { "records", "events" };
+
+    for (int i = 0; i < 2; i++)
+    {
+        query.prepare(QString("DELETE FROM %1 WHERE cam = :cam").arg(tables[i]));
+        query.bindValue(":cam", m_camName);
+
+        if (!query.exec())
+        {
+            ERROR_MESSAGE2(ERR_TYPE_DISPOSABLE,
+                           "AnalysisRecordSQLiteDao",
+                           "Failed to execute query: %s\nSQL Error: %s",
+                           query.lastQuery().toUtf8().constData(),
+                           query.lastError().text().toUtf8().constData());
+
+            return CAMERA_PIPELINE_ERROR;
+        }
+    }
+    return CAMERA_PIPELINE_OK;
+}
+
+void AnalysisRecordDao::BindEvent(QSqlQuery* pQuery, int row, EventDescription event)
 {
-    QSqlQuery   query;
     QString     fileTimeStr;
     QDateTime   fileStartTime;
+    QString     n = QString::number(row);
 
-    fileTimeStr = event.archiveFileName1;
-    fileTimeStr.chop(4);    // remove file extension
-    fileTimeStr.remove(0, fileTimeStr.length() - 21); // we need only 'dd_MM_yyyy___HH_mm_ss' (21 character)
-    fileStartTime = QDateTime::fromString(fileTimeStr, "dd_MM_yyyy___HH_mm_ss");
-
-    DEBUG_MESSAGE0("AnalysisRecordSQLiteDao", "storeEvent() started");
+    // Archive file with event start from recorder keyframe index
+    if (event.clipOffsetMs >= 0 && !event.clipFileName.isEmpty())
+    {
+        event.archiveFileName1 = event.clipFileName;
+    }
 
-    query.prepare("INSERT INTO events "
-                  "(cam, date, start_timestamp,  end_timestamp, type, confidence, reaction, archive_file1, archive_file2, file_offset_sec)"
-                  " VALUES "
-                  "(:cam, :date, :start_timestamp, :end_timestamp, :type, :confidence, :reaction, :archive_file1, :archive_file2, :file_offset_sec)");
+    if (event.archiveStartTime > 0)
+    {
+        fileStartTime = QDateTime::fromMSecsSinceEpoch(event.archiveStartTime);
+    }
+    else
+    {
+        fileTimeStr = event.archiveFileName1;
+        fileTimeStr.chop(4);    // remove file extension
+        fileTimeStr.remove(0, fileTimeStr.length() - 21); // we need only 'dd_MM_yyyy___HH_mm_ss' (21 character)
+        fileStartTime = QDateTime::fromString(fileTimeStr, "dd_MM_yyyy___HH_mm_ss");
+    }
 
     // Cam name
-    query.bindValue(":cam", (DataDirectoryInstance::instance())->pipelineParams.pipelineName);
+    pQuery->bindValue(":cam" + n, m_camName);
 
     // Start time
     if (event.startTime.isValid())
     {
-        query.bindValue(":date", event.startTime.date().toJulianDay());
-        query.bindValue(":start_timestamp", event.startTime.toMSecsSinceEpoch());
+        pQuery->bindValue(":date" + n, event.startTime.date().toJulianDay());
+        pQuery->bindValue(":start_timestamp" + n, event.startTime.toMSecsSinceEpoch());
     }
     else
     {
         ERROR_MESSAGE0(ERR_TYPE_ERROR, "AnalysisRecordSQLiteDao", "Cannot insert record: ivalid start time parameter");
+        pQuery->bindValue(":date" + n, QVariant(QVariant::LongLong));
+        pQuery->bindValue(":start_timestamp" + n, QVariant(QVariant::LongLong));
     }
 
     // End time
     if (event.endTime.isValid())
     {
-        query.bindValue(":end_timestamp", event.endTime.toMSecsSinceEpoch());
+        pQuery->bindValue(":end_timestamp" + n, event.endTime.toMSecsSinceEpoch());
     }
     else
     {
         ERROR_MESSAGE0(ERR_TYPE_ERROR, "AnalysisRecordSQLiteDao", "Cannot insert record: ivalid end time parameter");
+        pQuery->bindValue(":end_timestamp" + n, QVariant(QVariant::LongLong));
     }
 
     // Event type
-    query.bindValue(":type", (int)event.eventType);
+    pQuery->bindValue(":type" + n, (int)event.eventType);
 
     // Event confidence
-    query.bindValue(":confidence", (int)event.confidence);
+    pQuery->bindValue(":confidence" + n, (int)event.confidence);
 
     // Security reaction (can be null)
-    query.bindValue(":reaction", (int)event.reaction);
+    pQuery->bindValue(":reaction" + n, (int)event.reaction);
 
     // Start file name
-    query.bindValue(":archive_file1", event.archiveFileName1);
+    pQuery->bindValue(":archive_file1" + n, event.archiveFileName1);
 
     // End file name (can be null)
-    query.bindValue(":archive_file2", event.archiveFileName2);
+    pQuery->bindValue(":archive_file2" + n, event.archiveFileName2);
 
     // Event offset from archive file start (in seconds)
     if (fileStartTime.isValid())
@@ -290,24 +671,69 @@ void AnalysisRecordDao::storeEvent(EventDescription event)
         {
             ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "AnalysisRecordSQLiteDao", "Negative event file offset: %d", offset);
         }
-        query.bindValue(":file_offset_sec", std::max(0, offset));
+        pQuery->bindValue(":file_offset_sec" + n, std::max(0, offset));
     }
     else
     {
-        query.bindValue(":file_offset_sec", 0);
+        pQuery->bindValue(":file_offset_sec" + n, 0);
+    }
+}
+
+ErrorCode AnalysisRecordDao::InsertEvents(const QList<EventDescription>& events)
+{
+    if (events.isEmpty())
+    {
+        return CAMERA_PIPELINE_OK;
+    }
+
+    DEBUG_MESSAGE1("AnalysisRecordSQLiteDao", "InsertEvents() started (%d events)", events.size());
+
+    // Multi-row statement is prepared again only when batch size changes
+    if (NULL == m_pInsertEventsQuery || m_insertEventsRows != events.size())
+    {
+        QString sql = "INSERT INTO events "
+                      "(cam, date, start_timestamp,  end_timestamp, type, confidence, reaction, archive_file1, archive_file2, file_offset_sec)"
+                      " VALUES ";
+
+        for (int i = 0; i < events.size(); i++)
+        {
+            QString n = QString::number(i);
+
+            sql += (i ? ", " : "");
+            sql += "(:cam" + n + ", :date" + n + ", :start_timestamp" + n + ", :end_timestamp" + n + ", :type" + n +
+                   ", :confidence" + n + ", :reaction" + n + ", :archive_file1" + n + ", :archive_file2" + n + ", :file_offset_sec" + n + ")";
+        }
+
+        SAFE_DELETE(m_pInsertEventsQuery);
+        m_pInsertEventsQuery = new QSqlQuery(m_DB);
+        m_pInsertEventsQuery->prepare(sql);
+        m_insertEventsRows = events.size();
+    }
+
+    for (int i = 0; i < events.size(); i++)
+    {
+        BindEvent(m_pInsertEventsQuery, i, events.at(i));
     }
 
     // Execute query
-    if (query.exec())
+    if (m_pInsertEventsQuery->exec())
     {
-        DEBUG_MESSAGE0("AnalysisRecordSQLiteDao", "Event record inserted successfully");
+        DEBUG_MESSAGE1("AnalysisRecordSQLiteDao", "%d event records inserted successfully", events.size());
     }
     else
     {
         ERROR_MESSAGE2(ERR_TYPE_DISPOSABLE,
                        "AnalysisRecordSQLiteDao",
-                       "Failed to execute query in storeEvent(): %s\nSQL Error: %s",
-                       query.lastQuery().toUtf8().constData(),
-                       query.lastError().text().toUtf8().constData());
+                       "Failed to execute query in InsertEvents(): %s\nSQL Error: %s",
+                       m_pInsertEventsQuery->lastQuery().left(512).toUtf8().constData(),
+                       m_pInsertEventsQuery->lastError().text().toUtf8().constData());
+
+        return CAMERA_PIPELINE_ERROR;
     }
+    return CAMERA_PIPELINE_OK;
+}
+
+void AnalysisRecordDao::storeEvent(EventDescription event)
+{
+    InsertEvents(QList<EventDescription>() << event);
 }
@@ -6,27 +6,91 @@
 #include <QDateTime>
 #include <QFileInfo>
 #include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlQuery>
 
 #include "cameraPipelineCommon.h"
+#include "pipelineCommonTypes.h"
 #include "analysisRecordModel.h"
 
+/// Pre-merged statistics for one time of day slot and day of week
+struct BaselineRecord
+{
+    int             slot;           /// Time of day slot (statistic interval index since 00:00)
+    int             dayOfWeek;      /// Day of week of the decision (1 - Monday)
+    int             targetDay;      /// Julian day of the latest merged decision date (for decay)
+    double          weightSum;      /// Sum of merged intervals weights (statistics are not normalized)
+    QByteArray      statsData;      /// Merged interval statistics
+};
+
+/*
+ * Records, events and baselines storage
+ * Queries are common for all backends (Qt SQL), backend classes open connection
+ * and create or update schema. Backend is selected by "Database Backend" parameter.
+ */
 class AnalysisRecordDao : public QObject
 {
     Q_OBJECT
 public:
-    AnalysisRecordDao();
-     ~AnalysisRecordDao();
+    /// Create DAO of configured backend and open connection
+    static AnalysisRecordDao* Create(QString connectionName = QString(), QString camName = QString());
+    virtual ~AnalysisRecordDao();
 
     ErrorCode   InsertRecord(const AnalysisRecordModel &record);
+    /// Events are inserted by one multi-row statement (prepared statement is kept for same rows count)
+    ErrorCode   InsertEvents(const QList<EventDescription>& events);
+    /// Only interval times and statistics blob are fetched, rows are decoded one by one
     ErrorCode   FindStatsForPeriod(const QDateTime& curDateTime,
                                    int periodDays,
                                    int intervalMinutes,
-                                   QList<AnalysisRecordModel*>& results);
+                                   QList<IntervalStatistics*>& results,
+                                   qint64* pFetchedBytes = NULL);
+    /// Statistics of records in dates range with start time in [firstStartMs, lastStartMs]
+    ErrorCode   FindStatsForDays(QDate firstDate,
+                                 QDate lastDate,
+                                 int firstStartMs,
+                                 int lastStartMs,
+                                 QList<IntervalStatistics*>& results,
+                                 qint64* pFetchedBytes = NULL);
+    /// Statistics of camera record, which contains given time
+    ErrorCode   FindRecordStats(const QDateTime& dateTime, IntervalStatistics* pStats);
+    /// Baselines of camera for given slots range (dayOfWeek = 0 for all days)
+    ErrorCode   FindBaselines(int firstSlot, int lastSlot, int dayOfWeek, QList<BaselineRecord>& results);
+    ErrorCode   StoreBaseline(const BaselineRecord& baseline);
+    ErrorCode   RemoveCamRecords();     /// Remove all records and events written with camera name of this DAO
+    void        SetStatisticsCamName(QString camName) { m_statsCamName = camName; }
+
+    bool        IsOpen();
+    ErrorCode   Reopen();           /// Reconnect after connection loss (prepared statements are dropped)
+    ErrorCode   BeginTransaction();
+    ErrorCode   CommitTransaction();
+    void        RollbackTransaction();
 public slots:
     void    storeEvent(EventDescription event);
 
-private:
+protected:
+    AnalysisRecordDao(QString connectionName, QString camName);
+
+    virtual QString     DriverName() = 0;
+    virtual void        SetConnectionParams() = 0;  /// Called before connection is opened
+    virtual ErrorCode   ConfigureConnection() { return CAMERA_PIPELINE_OK; }    /// Called after each (re)open
+    virtual void        UpdateSchema() = 0;         /// Create or update tables
+    virtual QString     StatsColumnSql() = 0;       /// Statistics blob column for selects
+
     QSqlDatabase    m_DB;
+
+private:
+    ErrorCode       Open();
+    void            ClearPreparedQueries();
+    void            BindEvent(QSqlQuery* pQuery, int row, EventDescription event);
+    /// Statistics rows of query (date, start, end, blob, id) read in pages of STATS_FETCH_PAGE_ROWS, keyed by last row
+    ErrorCode       FetchStats(const QString& sql, const QVariantMap& values, QList<IntervalStatistics*>& results, qint64* pFetchedBytes);
+
+    QSqlQuery*      m_pInsertRecordQuery;   /// Prepared on first use
+    QSqlQuery*      m_pInsertEventsQuery;   /// Prepared for m_insertEventsRows rows
+    int             m_insertEventsRows;
+    QString         m_connectionName;   /// Named connection (for DB access from several threads), empty for default
+    QString         m_camName;          /// Camera name for written records and events
+    QString         m_statsCamName;     /// Camera name for statistics and baselines (pipeline name by default)
 };
 
 #endif // ANALYSISRECORDSQLITEDAO_H
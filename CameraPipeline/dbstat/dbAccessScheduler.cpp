@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <QElapsedTimer>
+
+#include "dbAccessScheduler.h"
+#include "cameraPipelineCommon.h"
+#include "dataDirectoryInstance.h"
+#include "pipelineMetrics.h"
+
+DbAccessScheduler*  DbAccessScheduler::m_instance = NULL;
+QMutex              DbAccessScheduler::m_instanceMutex;
+
+DbAccessScheduler* DbAccessScheduler::instance()
+{
+    QMutexLocker locker(&m_instanceMutex);
+
+    // Used from statistics thread and reanalysis workers
+    if(!m_instance)
+    {
+        m_instance = new DbAccessScheduler();
+    }
+    return m_instance;
+}
+
+DbAccessScheduler::DbAccessScheduler()
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    int             slotCount = std::max(1, pDataDirectory->pipelineParams.dbAccessSlots);
+    int             writeSlotCount = std::max(1, pDataDirectory->pipelineParams.dbWriteSlots);
+
+    m_pSemaphore = new QSystemSemaphore(DB_ACCESS_SEMAPHORE_KEY, slotCount, QSystemSemaphore::Open);
+
+    if (m_pSemaphore->error() != QSystemSemaphore::NoError)
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "DbAccessScheduler", "Failed to open DB access semaphore: %s",
+                       m_pSemaphore->errorString().toUtf8().constData());
+    }
+
+    m_pWriteSemaphore = new QSystemSemaphore(DB_WRITE_SEMAPHORE_KEY, writeSlotCount, QSystemSemaphore::Open);
+
+    if (m_pWriteSemaphore->error() != QSystemSemaphore::NoError)
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "DbAccessScheduler", "Failed to open DB write semaphore: %s",
+                       m_pWriteSemaphore->errorString().toUtf8().constData());
+    }
+}
+
+DbAccessScheduler::~DbAccessScheduler()
+{
+    SAFE_DELETE(m_pSemaphore);
+    SAFE_DELETE(m_pWriteSemaphore);
+}
+
+void DbAccessScheduler::Acquire(DbAccessType type)
+{
+    QSystemSemaphore*   pSemaphore = (DB_ACCESS_WRITE == type) ? m_pWriteSemaphore : m_pSemaphore;
+    QElapsedTimer       waitTimer;
+
+    waitTimer.start();
+
+    if (!pSemaphore->acquire())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "DbAccessScheduler", "DB access semaphore acquire failed: %s",
+                       pSemaphore->errorString().toUtf8().constData());
+    }
+
+    PipelineMetrics::instance()->SetGauge((DB_ACCESS_WRITE == type) ? "db_write_wait_ms" : "db_access_wait_ms", waitTimer.elapsed());
+}
+
+void DbAccessScheduler::Release(DbAccessType type)
+{
+    ((DB_ACCESS_WRITE == type) ? m_pWriteSemaphore : m_pSemaphore)->release();
+}
@@ -0,0 +1,42 @@
+#ifndef DBACCESSSCHEDULER_H
+#define DBACCESSSCHEDULER_H
+
+#include <QMutex>
+#include <QSystemSemaphore>
+
+#define  DB_ACCESS_SEMAPHORE_KEY    "ocular_pi_db_access"
+#define  DB_WRITE_SEMAPHORE_KEY     "ocular_pi_db_write"
+
+enum DbAccessType
+{
+    DB_ACCESS_READ,                     /// Statistics reads and baseline updates (latency matters for decisions)
+    DB_ACCESS_WRITE                     /// Batched writes of DbWriter
+};
+
+/*
+ * Host-wide limit of simultaneous DB operations of all pipeline instances
+ * Slots are taken from system semaphores shared by all processInstance processes on the host
+ * (they are created by the first instance with configured number of slots).
+ * Writers have their own slots, so statistics reads are never queued behind write batches.
+ * Semaphore operations are undone by OS if process is terminated while holding a slot.
+ */
+class DbAccessScheduler
+{
+public:
+    static DbAccessScheduler* instance();
+    ~DbAccessScheduler();
+
+    void    Acquire(DbAccessType type = DB_ACCESS_READ);   /// Wait for free slot (blocks calling thread)
+    void    Release(DbAccessType type = DB_ACCESS_READ);
+
+private:
+    static DbAccessScheduler*   m_instance;
+    static QMutex               m_instanceMutex;
+
+    DbAccessScheduler();
+
+    QSystemSemaphore*           m_pSemaphore;               /// Read slots
+    QSystemSemaphore*           m_pWriteSemaphore;          /// Write slots
+};
+
+#endif // DBACCESSSCHEDULER_H
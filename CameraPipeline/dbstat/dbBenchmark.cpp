@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include <QElapsedTimer>
+
+#include "dbBenchmark.h"
+#include "analysisRecordSQliteDao.h"
+#include "pipelineConfig.h"
+
+#define  BENCHMARK_ACC_WIDTH    160     // Typical analysis accumulator size
+#define  BENCHMARK_ACC_HEIGHT   90
+#define  BENCHMARK_READS        48
+
+static bool CheckStep(ErrorCode result, const char* step, int index)
+{
+    if (CAMERA_PIPELINE_OK != result)
+    {
+        printf("%s failed at %d, benchmark is stopped (see log for DB error)\n", step, index);
+        return false;
+    }
+    return true;
+}
+
+static void PrintResult(const char* name, int count, qint64 elapsedMs)
+{
+    printf("%-24s %8d in %8lld ms, %10.1f per sec\n", name, count, (long long)elapsedMs,
+           (elapsedMs > 0) ? (count * 1000.0 / elapsedMs) : 0.0);
+}
+
+ErrorCode DbBenchmark::Run(int eventsCount, int days)
+{
+    DataDirectory*          pDataDirectory = DataDirectoryInstance::instance();
+    QString                 camName = pDataDirectory->pipelineParams.pipelineName + "_benchmark";
+    int                     intervalSeconds = pDataDirectory->pipelineParams.statisticIntervalSec;
+    int                     slotsCount = std::max(1, 24*3600 / std::max(1, intervalSeconds));
+    QDateTime               now = QDateTime::currentDateTime();
+    AnalysisRecordDao*      pDao;
+    IntervalStatistics      stats;
+    AnalysisRecordModel     record;
+    QElapsedTimer           timer;
+    qint64                  fetchedBytes = 0;
+    int                     fetchedRecords = 0;
+    bool                    ok = true;
+    int                     i;
+
+    pDao = AnalysisRecordDao::Create(QString("db_benchmark"), camName);
+    pDao->SetStatisticsCamName(camName);
+
+    if (!pDao->IsOpen())
+    {
+        printf("Failed to open %s database\n", pDataDirectory->pipelineParams.databaseBackend.toUtf8().constData());
+        delete pDao;
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    printf("Backend: %s, %d events, %d days of %d intervals\n",
+           pDataDirectory->pipelineParams.databaseBackend.toUtf8().constData(), eventsCount, days, slotsCount);
+
+    // Events (batches of DbWriter size)
+    timer.start();
+    for (i = 0; ok && i < eventsCount; )
+    {
+        QList<EventDescription> events;
+
+        while (i < eventsCount && events.size() < DB_WRITER_BATCH_EVENTS)
+        {
+            EventDescription event;
+
+            event.eventType = 1;
+            event.confidence = rand() % 100;
+            event.startTime = now.addSecs(-i);
+            event.endTime = event.startTime.addSecs(5);
+            event.archiveFileName1 = QString("benchmark_%1.mp4").arg(i);
+            events.append(event);
+            i++;
+        }
+
+        ok = CheckStep(pDao->BeginTransaction(), "Events transaction", i) &&
+             CheckStep(pDao->InsertEvents(events), "Events insert", i) &&
+             CheckStep(pDao->CommitTransaction(), "Events commit", i);
+    }
+    if (ok)
+    {
+        PrintResult("Events inserted", eventsCount, timer.elapsed());
+    }
+
+    // Interval records with real-size statistics (heatmap is not written)
+    stats.accBuffer.SetSize(BENCHMARK_ACC_WIDTH, BENCHMARK_ACC_HEIGHT);
+    for (i = 0; i < stats.accBuffer.GetStride() * stats.accBuffer.GetHeight(); i++)
+    {
+        stats.accBuffer.GetPlaneData()[i] = (float)(rand() % 1000);
+    }
+    stats.perFrameMovements.fill(1.0, 6000);
+    stats.ToByteArray(&record.statsData);
+
+    record.mediaSource = pDataDirectory->pipelineParams.inputStreamUrl;
+    record.videoArchive = QString("benchmark.mp4");
+
+    timer.restart();
+    for (i = 0; ok && i < days * slotsCount; i++)
+    {
+        record.date = now.date().addDays(-(i / slotsCount));
+        record.endDate = record.date;
+        record.startTime = QTime(0, 0).addSecs((i % slotsCount) * intervalSeconds);
+        record.endTime = record.startTime.addSecs(intervalSeconds);
+
+        // DbWriter writes up to DB_WRITER_BATCH_RECORDS records per transaction
+        if (0 == i % DB_WRITER_BATCH_RECORDS)
+        {
+            ok = CheckStep(pDao->BeginTransaction(), "Records transaction", i);
+        }
+        ok = ok && CheckStep(pDao->InsertRecord(record), "Record insert", i);
+        if (ok && ((DB_WRITER_BATCH_RECORDS - 1 == i % DB_WRITER_BATCH_RECORDS) || (days * slotsCount - 1 == i)))
+        {
+            ok = CheckStep(pDao->CommitTransaction(), "Records commit", i);
+        }
+    }
+    if (ok)
+    {
+        PrintResult("Records inserted", days * slotsCount, timer.elapsed());
+        printf("%-24s %8d bytes\n", "Statistics record size", record.statsData.size());
+    }
+
+    // Statistics selects for decisions (different times of day)
+    timer.restart();
+    for (i = 0; ok && i < BENCHMARK_READS; i++)
+    {
+        QList<IntervalStatistics*>  results;
+        qint64                      bytes = 0;
+        QDateTime                   dateTime(now.date(), QTime(0, 0).addSecs((i * 24*3600 / BENCHMARK_READS + 3600) % (24*3600)));
+
+        ok = CheckStep(pDao->FindStatsForPeriod(dateTime, days, intervalSeconds, results, &bytes), "Statistics select", i);
+
+        fetchedRecords += results.size();
+        fetchedBytes += bytes;
+        qDeleteAll(results);
+    }
+    if (ok)
+    {
+        PrintResult("Statistics selects", BENCHMARK_READS, timer.elapsed());
+        printf("%-24s %8d records, %lld KB\n", "Statistics fetched", fetchedRecords, (long long)(fetchedBytes / 1024));
+    }
+    else
+    {
+        // Failed batch must not stay open (benchmark records are removed below)
+        pDao->RollbackTransaction();
+    }
+
+    if (CAMERA_PIPELINE_OK != pDao->RemoveCamRecords())
+    {
+        printf("Failed to remove benchmark data of %s\n", camName.toUtf8().constData());
+        ok = false;
+    }
+    delete pDao;
+
+    return ok ? CAMERA_PIPELINE_OK : CAMERA_PIPELINE_ERROR;
+}
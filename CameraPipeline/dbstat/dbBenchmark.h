@@ -0,0 +1,18 @@
+#ifndef DBBENCHMARK_H
+#define DBBENCHMARK_H
+
+#include "cameraPipelineCommon.h"
+
+/*
+ * Throughput benchmark of configured DB backend
+ * Events and interval records are written the same way as DbWriter does (batches in transactions),
+ * then statistics are selected as for decisions. Data is written with separate camera name
+ * (<pipeline name>_benchmark) and removed after the run.
+ */
+class DbBenchmark
+{
+public:
+    static ErrorCode Run(int eventsCount, int days);
+};
+
+#endif // DBBENCHMARK_H
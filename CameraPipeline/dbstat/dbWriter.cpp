@@ -0,0 +1,218 @@
+#include <algorithm>
+
+#include <QThread>
+#include <QElapsedTimer>
+
+#include "dbWriter.h"
+#include "dbAccessScheduler.h"
+#include "pipelineConfig.h"
+#include "pipelineMetrics.h"
+
+DbWriter::DbWriter(QString connectionName) :
+    QObject(NULL),
+    m_pDAO(NULL),
+    m_connectionName(connectionName),
+    m_pFlushTimer(NULL),
+    m_retryDelayMs(0),
+    m_failedAttempts(0)
+{
+
+}
+
+DbWriter::~DbWriter()
+{
+    DEBUG_MESSAGE0("DbWriter", "~DbWriter() called");
+
+    // Last attempt to write queued entries
+    if (NULL != m_pDAO && m_pDAO->IsOpen())
+    {
+        Flush();
+    }
+
+    if (!m_events.isEmpty() || !m_records.isEmpty())
+    {
+        ERROR_MESSAGE2(ERR_TYPE_WARNING, "DbWriter", "%d events and %d records are not written to DB",
+                       m_events.size(), m_records.size());
+    }
+
+    qDeleteAll(m_records);
+    m_records.clear();
+
+    SAFE_DELETE(m_pFlushTimer);
+    SAFE_DELETE(m_pDAO);
+
+    DEBUG_MESSAGE0("DbWriter", "~DbWriter() finished");
+}
+
+void DbWriter::Open()
+{
+    DEBUG_MESSAGE1("DbWriter", "Open() called ThreadID = %p", QThread::currentThreadId());
+
+    // Separate connection, so writes do not share connection (and locks) with statistics reads
+    m_pDAO = AnalysisRecordDao::Create(m_connectionName);
+
+    // Timer should be created here, after object is moved to its thread
+    m_pFlushTimer = new QTimer;
+    m_pFlushTimer->setSingleShot(true);
+    QObject::connect(m_pFlushTimer, SIGNAL(timeout()), this, SLOT(Flush()));
+
+    if (!m_events.isEmpty() || !m_records.isEmpty())
+    {
+        ScheduleFlush(0);
+    }
+}
+
+void DbWriter::StoreEvent(EventDescription event)
+{
+    m_events.append(event);
+
+    // Memory is limited if DB is not available for a long time
+    if (m_events.size() > DB_WRITER_MAX_EVENTS)
+    {
+        m_events.removeFirst();
+        PipelineMetrics::instance()->AddCounter("db_writer_dropped_total", 1);
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "DbWriter", "Events queue is full (%d), oldest event dropped", DB_WRITER_MAX_EVENTS);
+    }
+
+    UpdateQueueMetrics();
+    ScheduleFlush((m_events.size() >= DB_WRITER_BATCH_EVENTS) ? 0 : DB_WRITER_FLUSH_MSEC);
+}
+
+void DbWriter::InsertRecord(AnalysisRecordModel* pRecord)
+{
+    if (NULL == pRecord)
+    {
+        return;
+    }
+
+    m_records.append(pRecord);
+
+    if (m_records.size() > DB_WRITER_MAX_RECORDS)
+    {
+        emit RecordWritten(m_records.first()->date, m_records.first()->startTime, false);
+        delete m_records.takeFirst();
+        PipelineMetrics::instance()->AddCounter("db_writer_dropped_total", 1);
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "DbWriter", "Records queue is full (%d), oldest record dropped", DB_WRITER_MAX_RECORDS);
+    }
+
+    UpdateQueueMetrics();
+    ScheduleFlush(0);
+}
+
+void DbWriter::ScheduleFlush(int delayMs)
+{
+    if (NULL == m_pFlushTimer)
+    {
+        return;
+    }
+
+    // Retry delay is not shortened by new entries
+    if (m_retryDelayMs > 0 && m_pFlushTimer->isActive())
+    {
+        return;
+    }
+
+    if (!m_pFlushTimer->isActive() || m_pFlushTimer->remainingTime() > delayMs)
+    {
+        m_pFlushTimer->start(delayMs);
+    }
+}
+
+void DbWriter::Flush()
+{
+    QElapsedTimer               flushTimer;
+    QList<EventDescription>     events = m_events.mid(0, DB_WRITER_BATCH_EVENTS);
+    int                         recordsCount = std::min(m_records.size(), DB_WRITER_BATCH_RECORDS);
+    bool                        connected;
+    bool                        written;
+    int                         i;
+
+    if (NULL == m_pDAO || (events.isEmpty() && 0 == recordsCount))
+    {
+        return;
+    }
+
+    flushTimer.start();
+
+    // Connection could be lost since last failure
+    if (m_retryDelayMs > 0 || !m_pDAO->IsOpen())
+    {
+        m_pDAO->Reopen();
+    }
+
+    DbAccessScheduler::instance()->Acquire(DB_ACCESS_WRITE);
+
+    // Whole batch is written in one transaction
+    connected = m_pDAO->IsOpen() && (CAMERA_PIPELINE_OK == m_pDAO->BeginTransaction());
+    written = connected && (CAMERA_PIPELINE_OK == m_pDAO->InsertEvents(events));
+
+    for (i = 0; written && i < recordsCount; i++)
+    {
+        written = (CAMERA_PIPELINE_OK == m_pDAO->InsertRecord(*m_records.at(i)));
+    }
+
+    written = written && (CAMERA_PIPELINE_OK == m_pDAO->CommitTransaction());
+
+    if (connected && !written)
+    {
+        m_pDAO->RollbackTransaction();
+    }
+
+    DbAccessScheduler::instance()->Release(DB_ACCESS_WRITE);
+
+    if (written)
+    {
+        DEBUG_MESSAGE3("DbWriter", "%d events and %d records written (%d ms)",
+                       events.size(), recordsCount, (int)flushTimer.elapsed());
+
+        m_events = m_events.mid(events.size());
+        for (i = 0; i < recordsCount; i++)
+        {
+            emit RecordWritten(m_records.first()->date, m_records.first()->startTime, true);
+            delete m_records.takeFirst();
+        }
+        m_retryDelayMs = 0;
+        m_failedAttempts = 0;
+
+        PipelineMetrics::instance()->SetGauge("db_writer_flush_ms", flushTimer.elapsed());
+    }
+    else if (connected && (++m_failedAttempts >= DB_WRITER_MAX_ATTEMPTS))
+    {
+        // DB is available, but batch is rejected (it would block the queue forever)
+        ERROR_MESSAGE3(ERR_TYPE_ERROR, "DbWriter", "%d events and %d records are rejected by DB %d times, dropped",
+                       events.size(), recordsCount, m_failedAttempts);
+
+        m_events = m_events.mid(events.size());
+        for (i = 0; i < recordsCount; i++)
+        {
+            emit RecordWritten(m_records.first()->date, m_records.first()->startTime, false);
+            delete m_records.takeFirst();
+        }
+        m_retryDelayMs = 0;
+        m_failedAttempts = 0;
+
+        PipelineMetrics::instance()->AddCounter("db_writer_dropped_total", events.size() + recordsCount);
+    }
+    else
+    {
+        // Exponential backoff, DB is not loaded with retries of all instances
+        m_retryDelayMs = std::min(std::max(2*m_retryDelayMs, DB_WRITER_FLUSH_MSEC), DB_WRITER_MAX_RETRY_MSEC);
+
+        PipelineMetrics::instance()->AddCounter("db_writer_retries_total", 1);
+        ERROR_MESSAGE3(ERR_TYPE_DISPOSABLE, "DbWriter", "Failed to write %d events and %d records, retry in %d ms",
+                       events.size(), recordsCount, m_retryDelayMs);
+    }
+
+    UpdateQueueMetrics();
+
+    if (!m_events.isEmpty() || !m_records.isEmpty())
+    {
+        m_pFlushTimer->start(m_retryDelayMs);
+    }
+}
+
+void DbWriter::UpdateQueueMetrics()
+{
+    PipelineMetrics::instance()->SetGauge("db_writer_queued_events", m_events.size());
+    PipelineMetrics::instance()->SetGauge("db_writer_queued_records", m_records.size());
+}
@@ -0,0 +1,50 @@
+#ifndef DBWRITER_H
+#define DBWRITER_H
+
+#include <QList>
+#include <QTimer>
+#include <QObject>
+#include <QDateTime>
+
+#include "analysisRecordSQliteDao.h"
+
+/*
+ * Asynchronous writer for events and interval records (works in separate thread)
+ * Writes are queued and flushed in batches: one transaction per flush, events are inserted
+ * by multi-row statements, prepared statements are reused. Failed batches are kept in queue
+ * and retried with growing delay (queue size is limited, oldest entries are dropped).
+ * Writer has its own DB connection and its own DbAccessScheduler slots, so statistics reads
+ * are not blocked behind writes. Each record is reported back when it is committed or dropped.
+ */
+class DbWriter : public QObject
+{
+    Q_OBJECT
+public:
+    DbWriter(QString connectionName = QString("db_writer"));
+    ~DbWriter();
+
+signals:
+    void    RecordWritten(QDate date, QTime startTime, bool stored);  /// Record is committed (or dropped if not stored)
+
+public slots:
+    void    Open();
+    void    StoreEvent(EventDescription event);
+    void    InsertRecord(AnalysisRecordModel* pRecord);         /// Record is deleted by writer
+
+private slots:
+    void    Flush();
+
+private:
+    AnalysisRecordDao*              m_pDAO;
+    QString                         m_connectionName;
+    QTimer*                         m_pFlushTimer;              /// Single shot (created in writer thread)
+    QList<EventDescription>         m_events;                   /// Events waiting for write
+    QList<AnalysisRecordModel*>     m_records;                  /// Records waiting for write
+    int                             m_retryDelayMs;             /// Delay before next retry (0 if last flush succeeded)
+    int                             m_failedAttempts;           /// Failed attempts of current batch with DB connected
+
+    void    ScheduleFlush(int delayMs);
+    void    UpdateQueueMetrics();
+};
+
+#endif // DBWRITER_H
@@ -1,12 +1,32 @@
 
 #include <QThread>
 #include <QTimer>
+#include <QBuffer>
 #include <QElapsedTimer>
 
+#include <math.h>
+
 #include "intervalStatistics.h"
+#include "dbAccessScheduler.h"
+#include "decisionMaker.h"
+#include "pipelineMetrics.h"
+
+#define  HEATMAP_THRESHOLD      (0.06f * 255.0f)    // ~16 in absoulute value, lower accumulated values are not coloured
+#define  HEATMAP_ALPHA          0.7                 // Weight of heat colour in blending with background
+#define  HEATMAP_LUT_STEPS      4                   // Colour table entries per unit of accumulated value
+#define  STATS_MAX_DIMENSION    16384               // Accumulator width/height limit for stored statistics (sanity check)
+
+IntervalStatistics::IntervalStatistics() :
+    weightScale(1.0f)
+{
+
+}
 
 void IntervalStatistics::Reset()
 {
+    m_view.Detach();
+    m_attachedData.clear();
+    weightScale = 1.0f;
     accBuffer.Reset();
     backgroundBuffer.SetVal(0);
     perFrameMovements.clear();
@@ -28,63 +48,106 @@ void IntervalStatistics::CopyFrom(IntervalStatistics& src)
     endDate = src.endDate;
     startTime = src.startTime;
     endTime = src.endTime;
+    weightScale = src.weightScale;
+
+    // Attached blob is shared
+    m_view.Detach();
+    m_attachedData = src.m_attachedData;
+    if (src.IsAttached())
+    {
+        m_view.Attach(m_attachedData.constData(), m_attachedData.size(), false);
+    }
 }
 
 ErrorCode IntervalStatistics::ToByteArray(QByteArray* bytes)
 {
-    unsigned int size;
-    unsigned int width;
-    unsigned int height;
-    unsigned int magic = 0xDEADBEEF;
-    unsigned int version = 0x00000001;
+    unsigned int    size;
+    unsigned int    width;
+    unsigned int    height;
+    unsigned int    magic = 0xDEADBEEF;
+    unsigned int    version = 0x00000002;
+    float           maxValue = 0.0f;
+    float           scale;
+    QByteArray      payload;
 
     if (NULL == bytes)
     {
         return CAMERA_PIPELINE_ERROR;
     }
 
+    width = accBuffer.GetWidth();
+    height = accBuffer.GetHeight();
+    size = perFrameMovements.size();
+
+    // Accumulator is quantized to 16 bit relative to its maximum value
+    for (unsigned int j = 0; j < height; j++)
+    {
+        float* pAcc = accBuffer.GetPlaneData() + j*accBuffer.GetStride();
+
+        for (unsigned int i = 0; i < width; i++)
+        {
+            maxValue = std::max(maxValue, pAcc[i]);
+        }
+    }
+    scale = (maxValue > 0.0f) ? (65535.0f / maxValue) : 0.0f;
+
     // Validation numbers
     bytes->append((char *)&magic,   sizeof(magic));
     bytes->append((char *)&version, sizeof(version));
 
-    // Accumulator buffer size and data
-    width = accBuffer.GetWidth();
-    height = accBuffer.GetHeight();
-
+    // Uncompressed header
     bytes->append((char *)&(width), sizeof(width));
     bytes->append((char *)&(height), sizeof(height));
+    bytes->append((char *)&(maxValue), sizeof(maxValue));
+    bytes->append((char *)&(size), sizeof(size));
 
-    bytes->append((char*)accBuffer.GetPlaneData(), width*height*sizeof(float));
+    // Accumulator rows are delta coded (neighbour pixels are close after blur)
+    payload.resize(width*height*sizeof(unsigned short) + size);
+    unsigned short* pQuant = (unsigned short*)payload.data();
 
-    // Validation numbers
-    magic = 0x00000000;
-    bytes->append((char *)&magic, sizeof(magic));
+    for (unsigned int j = 0; j < height; j++)
+    {
+        float*          pAcc = accBuffer.GetPlaneData() + j*accBuffer.GetStride();
+        unsigned short  prev = 0;
 
-    // Movements vector size and data
-    size = perFrameMovements.size();
-    bytes->append((char *)&(size), sizeof(size));
-    bytes->append((char *)(perFrameMovements.constData()), sizeof(perFrameMovements[0]) * size);
+        for (unsigned int i = 0; i < width; i++)
+        {
+            unsigned short val = (unsigned short)std::min(65535.0f, std::max(0.0f, pAcc[i] * scale + 0.5f));
+
+            *pQuant++ = (unsigned short)(val - prev);
+            prev = val;
+        }
+    }
+
+    // Movements are stored as percent (0..100) scaled to 0..255
+    unsigned char* pMovements = (unsigned char*)pQuant;
+
+    for (unsigned int i = 0; i < size; i++)
+    {
+        pMovements[i] = (unsigned char)std::min(255.0, std::max(0.0, perFrameMovements[i] * 2.55 + 0.5));
+    }
 
     // Motion map
-    motionMap.ToByteArray(bytes);
+    motionMap.ToByteArray(&payload);
+
+    // Fast zlib level (zlib is already linked with FFmpeg)
+    bytes->append(qCompress(payload, 1));
 
     return CAMERA_PIPELINE_OK;
 }
 
 ErrorCode IntervalStatistics::FromByteArray(QByteArray* bytes)
 {
-    unsigned int    size;
-    unsigned int    width;
-    unsigned int    height;
     unsigned int    magic;
     unsigned int    version;
-    QDataStream     in(bytes, QIODevice::ReadOnly);
 
     if (NULL == bytes)
     {
         return CAMERA_PIPELINE_ERROR;
     }
 
+    QDataStream     in(bytes, QIODevice::ReadOnly);
+
     // Validation numbers
     in.readRawData((char *)&magic, sizeof(magic));
     if (magic != 0xDEADBEEF)
@@ -93,14 +156,58 @@ ErrorCode IntervalStatistics::FromByteArray(QByteArray* bytes)
     }
 
     in.readRawData((char *)&version, sizeof(version));
-    if (version != 0x00000001)
+    if (version == STATS_BLOB_VERSION)
     {
-        return CAMERA_PIPELINE_ERROR;
+        StatisticsBlobView  view;
+
+        // Unaligned data is copied once (view requires aligned sections)
+        if ((quintptr)bytes->constData() & (sizeof(double) - 1))
+        {
+            QByteArray  aligned(bytes->constData(), bytes->size());
+
+            if (CAMERA_PIPELINE_OK != view.Attach(aligned.constData(), aligned.size()))
+            {
+                return CAMERA_PIPELINE_ERROR;
+            }
+            return FromBlobView(view);
+        }
+
+        if (CAMERA_PIPELINE_OK != view.Attach(bytes->constData(), bytes->size()))
+        {
+            return CAMERA_PIPELINE_ERROR;
+        }
+        return FromBlobView(view);
+    }
+    if (version == 0x00000001)
+    {
+        return FromDataStreamV1(in);
+    }
+    if (version == 0x00000002)
+    {
+        return FromDataStreamV2(in);
     }
+    return CAMERA_PIPELINE_ERROR;
+}
+
+ErrorCode IntervalStatistics::FromDataStreamV1(QDataStream& in)
+{
+    unsigned int    size;
+    unsigned int    width;
+    unsigned int    height;
+    unsigned int    magic;
 
     // Accumulator buffer size and data
     in.readRawData((char *)&(width), sizeof(width));
     in.readRawData((char *)&(height), sizeof(height));
+
+    // Sizes are checked against stream length before allocation (record can be damaged)
+    if ((in.status() != QDataStream::Ok) ||
+        (width > STATS_MAX_DIMENSION) || (height > STATS_MAX_DIMENSION) ||
+        ((quint64)width*height*sizeof(float) > (quint64)in.device()->bytesAvailable()))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
     accBuffer.SetSize(width, height);
     in.readRawData((char*)accBuffer.GetPlaneData(), width*height*sizeof(float));
 
@@ -113,15 +220,185 @@ ErrorCode IntervalStatistics::FromByteArray(QByteArray* bytes)
 
     // Movements vector size and data
     in.readRawData((char *)&(size), sizeof(size));
+    if ((in.status() != QDataStream::Ok) ||
+        ((quint64)size*sizeof(perFrameMovements[0]) > (quint64)in.device()->bytesAvailable()))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
     perFrameMovements.resize(size);
     in.readRawData((char *)perFrameMovements.data(), sizeof(perFrameMovements[0]) * size);
 
     // Motion map
-    motionMap.FromDataStream(in);
+    if (!motionMap.FromDataStream(in))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode IntervalStatistics::FromDataStreamV2(QDataStream& in)
+{
+    unsigned int    size;
+    unsigned int    width;
+    unsigned int    height;
+    float           maxValue;
+    QByteArray      compressed;
+    QByteArray      payload;
+
+    in.readRawData((char *)&(width), sizeof(width));
+    in.readRawData((char *)&(height), sizeof(height));
+    in.readRawData((char *)&(maxValue), sizeof(maxValue));
+    in.readRawData((char *)&(size), sizeof(size));
+
+    if ((in.status() != QDataStream::Ok) || (width > STATS_MAX_DIMENSION) || (height > STATS_MAX_DIMENSION))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    compressed = in.device()->readAll();
+    payload = qUncompress(compressed);
+
+    // Computed in 64 bit, damaged header can't wrap the check around
+    quint64 accSize = (quint64)width*height*sizeof(unsigned short);
+
+    if ((quint64)payload.size() < accSize + size)
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    // Accumulator (delta decoding and dequantization)
+    const unsigned short*   pQuant = (const unsigned short*)payload.constData();
+    float                   scale = maxValue / 65535.0f;
+
+    accBuffer.SetSize(width, height);
+
+    for (unsigned int j = 0; j < height; j++)
+    {
+        float*          pAcc = accBuffer.GetPlaneData() + j*accBuffer.GetStride();
+        unsigned short  val = 0;
+
+        for (unsigned int i = 0; i < width; i++)
+        {
+            val = (unsigned short)(val + *pQuant++);
+            pAcc[i] = val * scale;
+        }
+    }
+
+    // Movements
+    const unsigned char* pMovements = (const unsigned char*)pQuant;
+
+    perFrameMovements.resize(size);
+    for (unsigned int i = 0; i < size; i++)
+    {
+        perFrameMovements[i] = pMovements[i] / 2.55;
+    }
+
+    // Motion map
+    QByteArray  motionData = payload.mid((int)(accSize + size));
+    QDataStream motionStream(&motionData, QIODevice::ReadOnly);
+
+    if (!motionMap.FromDataStream(motionStream))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode IntervalStatistics::FromBlobView(const StatisticsBlobView& view)
+{
+    m_view.Detach();
+    m_attachedData.clear();
+
+    accBuffer.SetSize(view.AccWidth(), view.AccHeight());
+    accBuffer.Reset();
+    accBuffer.Add(view.AccData(), view.AccWidth(), view.AccHeight(), view.AccStride());
 
+    perFrameMovements.resize(view.MovementsCount());
+    if (view.MovementsCount())
+    {
+        memcpy(perFrameMovements.data(), view.Movements(), view.MovementsCount()*sizeof(double));
+    }
+
+    motionMap.CopyFrom(view.MotionModels(), view.MotionWidth(), view.MotionHeight(), view.MotionBlockSize());
+
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode IntervalStatistics::ToBlob(QByteArray* bytes)
+{
+    if (NULL == bytes)
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if (IsAttached())
+    {
+        *bytes = m_attachedData;
+        return CAMERA_PIPELINE_OK;
+    }
+
+    StatisticsBlobView::Write(bytes, &accBuffer, perFrameMovements, &motionMap);
     return CAMERA_PIPELINE_OK;
 }
 
+ErrorCode IntervalStatistics::Attach(const QByteArray& bytes)
+{
+    m_view.Detach();
+
+    // QByteArray data is shared, unaligned (raw) data is copied once
+    if ((quintptr)bytes.constData() & (sizeof(double) - 1))
+    {
+        m_attachedData = QByteArray(bytes.constData(), bytes.size());
+    }
+    else
+    {
+        m_attachedData = bytes;
+    }
+
+    if (CAMERA_PIPELINE_OK != m_view.Attach(m_attachedData.constData(), m_attachedData.size()))
+    {
+        m_attachedData.clear();
+        return CAMERA_PIPELINE_ERROR;
+    }
+    return CAMERA_PIPELINE_OK;
+}
+
+int IntervalStatistics::AccWidth()
+{
+    return IsAttached() ? m_view.AccWidth() : accBuffer.GetWidth();
+}
+
+int IntervalStatistics::AccHeight()
+{
+    return IsAttached() ? m_view.AccHeight() : accBuffer.GetHeight();
+}
+
+void IntervalStatistics::AddAccumulatorTo(AccumlatorBuffer* pDst, float weight)
+{
+    if (IsAttached())
+    {
+        pDst->Add(m_view.AccData(), m_view.AccWidth(), m_view.AccHeight(), m_view.AccStride(), weight * weightScale);
+    }
+    else
+    {
+        pDst->Add(&accBuffer, weight * weightScale);
+    }
+}
+
+void IntervalStatistics::AddMotionMapTo(MotionMap* pDst, float weight)
+{
+    if (IsAttached())
+    {
+        pDst->AddMap(m_view.MotionModels(), m_view.MotionWidth(), m_view.MotionHeight(), m_view.MotionBlockSize(), weight * weightScale);
+    }
+    else
+    {
+        pDst->AddMap(&motionMap, weight * weightScale);
+    }
+}
+
 VideoStatistics::VideoStatistics() :
     m_pCurrentFrame(NULL)
 {
@@ -143,6 +420,7 @@ void VideoStatistics::IntervalStarted(QDateTime currentDateTime)
     DEBUG_MESSAGE0("VideoStatistics", "Interval started");
     m_currentStats.Reset();
     emit StatisticPeriodStarted(currentDateTime);           // Get new period statistics for decision maker
+    emit NextStatisticPeriodExpected(currentDateTime.addSecs(DataDirectoryInstance::instance()->pipelineParams.processingIntervalSec));
 }
 
 void VideoStatistics::IntervalFinished(QDateTime currentDateTime)
@@ -152,6 +430,7 @@ void VideoStatistics::IntervalFinished(QDateTime currentDateTime)
 
     DEBUG_MESSAGE0("VideoStatistics", "Interval finished");
     emit StatisticPeriodStarted(currentDateTime);   // Get new period statistics
+    emit NextStatisticPeriodExpected(currentDateTime.addSecs(pDataDirectory->pipelineParams.processingIntervalSec));
 
     m_currentStats.date = currentRecordTime.date();
     m_currentStats.endDate = currentDateTime.date();
@@ -194,10 +473,16 @@ void VideoStatistics::ProcessAnalyzedFrame(VideoFrame *pCurrentFrame, AnalysisRe
         m_currentStats.accBuffer.SetSize(results->pDiffBuffer->GetWidth(), results->pDiffBuffer->GetHeight());
 
         //--- Accumulating interval statistics ---
+        // Frames analyzed at lower rate are weighted as all full rate frames they stand for
         if (pDataDirectory->analysisParams.differenceBasedAnalysis)
         {
-            m_currentStats.perFrameMovements.append(results->percentMotion);
-            m_currentStats.accBuffer.AddBuffer(results->pDiffBuffer);
+            int repeats = std::max(1, (int)(results->frameWeight + 0.5f));
+
+            for (int i = 0; i < repeats; i++)
+            {
+                m_currentStats.perFrameMovements.append(results->percentMotion);
+            }
+            m_currentStats.accBuffer.AddBuffer(results->pDiffBuffer, results->frameWeight);
         }
 
         if (pDataDirectory->analysisParams.motionBasedAnalysis)
@@ -205,7 +490,7 @@ void VideoStatistics::ProcessAnalyzedFrame(VideoFrame *pCurrentFrame, AnalysisRe
             // Update Motion map
             if (NULL != results->pCurFlow)
             {
-                m_currentStats.motionMap.Update(results->pCurFlow);
+                m_currentStats.motionMap.Update(results->pCurFlow, results->frameWeight);
             }
         }
         DEBUG_MESSAGE0("VideoStatistics", "ProcessAnalyzedFrame() finished");
@@ -239,12 +524,17 @@ void VideoStatistics::AddFalseEventDiffBuffer(VideoBuffer *buffer)
     DEBUG_MESSAGE0("VideoStatistics", "AddFalseEventDiffBuffer() finished");
 }
 
-StatisticDBInterface::StatisticDBInterface() : QObject(NULL), m_pDAO(NULL)
+StatisticDBInterface::StatisticDBInterface(QString connectionName, QString camName, bool immediate) :
+    QObject(NULL),
+    m_pDAO(NULL),
+    m_pCache(NULL),
+    m_connectionName(connectionName),
+    m_camName(camName),
+    m_immediate(immediate),
+    m_releaseCachedStatistic(false),
+    m_prefetchedCount(0)
 {
-    // Initialize random number generator with int value from pointer
-    // should be different for different application instances
-    size_t  seed = (size_t)this;
-    srand((unsigned int)seed);
+
 }
 
 StatisticDBInterface::~StatisticDBInterface()
@@ -257,6 +547,22 @@ StatisticDBInterface::~StatisticDBInterface()
     }
     m_currentPeriodStatistic.clear();
 
+    // Not executed writes are lost (as before with delayed writes)
+    while (!m_pendingOperations.isEmpty())
+    {
+        delete m_pendingOperations.takeFirst().pStats;
+    }
+
+    // Cached statistics can reference mapped cache file
+    while (!m_cachedStatistic.isEmpty())
+    {
+        delete m_cachedStatistic.takeFirst();
+    }
+
+    qDeleteAll(m_uncommittedStatistic);
+    m_uncommittedStatistic.clear();
+
+    SAFE_DELETE(m_pCache);
     SAFE_DELETE(m_pDAO);
 
     DEBUG_MESSAGE0("StatisticDBInterface", "~StatisticDBInterface() finished");
@@ -264,8 +570,32 @@ StatisticDBInterface::~StatisticDBInterface()
 
 void StatisticDBInterface::OpenDB()
 {
+    DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
+
     // Create new database access object
-    m_pDAO = new AnalysisRecordDao();
+    m_pDAO = AnalysisRecordDao::Create(m_connectionName, m_camName);
+
+    // Local cache is stored in data path (archive directory is served by archive HTTP server)
+    if (pDataDirectory->pipelineParams.statisticCache && IsLiveStatistics())
+    {
+        m_pCache = new StatisticsCache(QString("%1/%2.statcache")
+                                       .arg(pDataDirectory->pipelineParams.dataPath)
+                                       .arg(pDataDirectory->pipelineParams.pipelineName));
+        m_pCache->Load();
+    }
+
+    // Heatmaps on request are drawn over camera thumbnail until the first interval is written
+    if (IsLiveStatistics())
+    {
+        QString thumbFile = QString("%1/%2/thumb.jpg")
+                            .arg(pDataDirectory->pipelineParams.archivePath)
+                            .arg(pDataDirectory->pipelineParams.pipelineName);
+
+        if (CAMERA_PIPELINE_OK != m_lastBackground.LoadFromFile(thumbFile))
+        {
+            DEBUG_MESSAGE1("StatisticDBInterface", "No heatmap background in %s", thumbFile.toUtf8().constData());
+        }
+    }
 }
 
 void StatisticDBInterface::NewArchiveFileName(QString newFileName)
@@ -281,12 +611,16 @@ void StatisticDBInterface::StoreEvent(EventDescription event)
         ERROR_MESSAGE0(ERR_TYPE_ERROR, "StatisticDBInterface", "StoreEvent() failed: data access object is NULL");
         return;
     }
+
+    // Events are rare and short, they are not queued
+    DbAccessScheduler::instance()->Acquire();
     m_pDAO->storeEvent(event);
+    DbAccessScheduler::instance()->Release();
 }
 
 void StatisticDBInterface::PerformGetStatistic(QDateTime currentDateTime)
 {
-    int delay = (rand() % 6) * 10;
+    DbOperation operation;
 
     if (NULL == m_pDAO)
     {
@@ -294,84 +628,54 @@ void StatisticDBInterface::PerformGetStatistic(QDateTime currentDateTime)
         return;
     }
 
-    // Store time to be processed in delayed slot
-    m_statisticsToGetTime = currentDateTime;
-
-    ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "StatisticDBInterface",
-                   "GetStatistics() for %s will be called in %d seconds",
-                   m_statisticsToGetTime.toString("dd.MM.yyyy HH:mm:ss").toUtf8().constData(), delay);
-
-    QTimer::singleShot(delay*1000, this, SLOT(DelayedGet()));
-}
-
-void StatisticDBInterface::DelayedGet()
-{
-    DataDirectory*              pDataDirectory = DataDirectoryInstance::instance();
-    QElapsedTimer               processingTimer;
-    QList<AnalysisRecordModel*> recordsList;
-    int                         periodDays = pDataDirectory->pipelineParams.statisticPeriodDays;
-    int                         intervalSeconds = pDataDirectory->pipelineParams.statisticIntervalSec;
-
-    processingTimer.restart();
-    DEBUG_MESSAGE1("StatisticDBInterface", "DelayedGet() called ThreadID = %p", QThread::currentThreadId());
-
-    if(CAMERA_PIPELINE_OK != m_pDAO->FindStatsForPeriod(
-                m_statisticsToGetTime, periodDays, intervalSeconds, recordsList))
+    // Statistics prefetched during previous interval were already applied by event handler at the boundary
+    // (previous period statistic is kept until the next read)
+    if ((m_prefetchedCount > 0) &&
+        (qAbs(m_prefetchedTime.secsTo(currentDateTime)) < DataDirectoryInstance::instance()->pipelineParams.processingIntervalSec / 2))
     {
-        ERROR_MESSAGE0(ERR_TYPE_ERROR, "StatisticDBInterface", "Failed to get statistics for given period");
-    }
-
-    ERROR_MESSAGE4(ERR_TYPE_MESSAGE, "StatisticDBInterface",
-                   "%d records selected for period from %s to %s (%d ms)",
-                   recordsList.size(),
-                   m_statisticsToGetTime.addSecs(-(periodDays*24*3600 + intervalSeconds)).toString("dd.MM.yyyy HH:mm:ss").toUtf8().constData(),
-                   m_statisticsToGetTime.toString("dd.MM.yyyy HH:mm:ss").toUtf8().constData(),
-                   (int)processingTimer.elapsed());
+        m_prefetchedCount = 0;
 
-    //----------------------------------------------
-    //-- Converting records to intreval statistic --
-    //----------------------------------------------
+        PipelineMetrics::instance()->AddCounter("stats_prefetch_hits_total", 1);
+        emit Ping("ReadStatistics", 30*60*1000);
+        return;
+    }
 
-    while (!m_currentPeriodStatistic.isEmpty()) // Delete all previously allocated entries in stat list
+    if (!m_immediate)
     {
-        delete m_currentPeriodStatistic.takeFirst();
+        PipelineMetrics::instance()->AddCounter("stats_prefetch_misses_total", 1);
     }
-    m_currentPeriodStatistic.clear();
 
-    while (!recordsList.isEmpty())
+    // Decisions are started with cached statistics, DB is read as usual
+    if (NULL != m_pCache && m_currentPeriodStatistic.isEmpty() && m_cachedStatistic.isEmpty())
     {
-        IntervalStatistics*   pNewIntervalStats = new IntervalStatistics; // Memory must be deleted by user after usage
-        AnalysisRecordModel*  pRecord = recordsList.takeFirst();
-
-        pNewIntervalStats->date          = pRecord->date;
-        pNewIntervalStats->endDate       = pRecord->endDate;
-        pNewIntervalStats->startTime     = pRecord->startTime;
-        pNewIntervalStats->endTime       = pRecord->endTime;
+        GetCachedStatistic(currentDateTime);
+    }
 
-        if (CAMERA_PIPELINE_OK != pNewIntervalStats->FromByteArray(&pRecord->statsData))
-        {
-            ERROR_MESSAGE0(ERR_TYPE_ERROR, "StatisticDBInterface", "Unable to convert BLOB to interval statistics data");
-            delete pRecord;
-            return;
-        }
-        delete pRecord; // This memory was allocated in FindStatsForPeriod(), and should be deleted after usage
+    operation.type = DB_OPERATION_GET;
+    operation.dateTime = currentDateTime;
+    operation.pStats = NULL;
+    EnqueueOperation(operation);
+}
 
-        m_currentPeriodStatistic.append(pNewIntervalStats);  // Add new IntervalStatistics entry
-    }
+void StatisticDBInterface::PerformPrefetchStatistic(QDateTime nextDateTime)
+{
+    DbOperation operation;
 
-    if (m_currentPeriodStatistic.size())
+    // Archive reanalysis reads statistics right at the boundary
+    if (NULL == m_pDAO || m_immediate)
     {
-        DEBUG_MESSAGE0("StatisticDBInterface", "NewPeriodStatistics() emitted");
-        emit NewPeriodStatistics(m_currentPeriodStatistic); // Emit NewStatistics signal
+        return;
     }
 
-    // Send ping to health checker that read statistics is working
-    emit Ping("ReadStatistics", 30*60*1000); // Timeout = 30 min
+    operation.type = DB_OPERATION_PREFETCH;
+    operation.dateTime = nextDateTime;
+    operation.pStats = NULL;
+    EnqueueOperation(operation);
 }
 
 void StatisticDBInterface::PerformWriteStatistic(IntervalStatistics* stats)
 {
-    int delay = (rand() & 7) * 20 + 60;
+    DbOperation operation;
 
     if (NULL == m_pDAO)
     {
@@ -379,62 +683,777 @@ void StatisticDBInterface::PerformWriteStatistic(IntervalStatistics* stats)
         return;
     }
 
-    // Store current archive name (because it will be changed whe DelayedWrite() will be called)
-    stats->archiveFile = m_archiveFileName;
-
-    // Store time to be processed in delayed slot
-    m_statisticsToWritePtr = stats;
-
-    ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "StatisticDBInterface",
-                   "WriteStatistics() for %s will be called in %d seconds",
-                   stats->startTime.toString("HH:mm:ss").toUtf8().constData(),
-                   delay);
-
-    QTimer::singleShot(delay*1000, this, SLOT(DelayedWrite()));
+    // Queued statistics are copied, so next interval cannot overwrite them
+    operation.type = DB_OPERATION_WRITE;
+    operation.dateTime = QDateTime(stats->date, stats->startTime);
+    operation.pStats = new IntervalStatistics;
+    operation.pStats->CopyFrom(*stats);
+    operation.pStats->archiveFile = m_archiveFileName;
+    EnqueueOperation(operation);
 }
 
-void StatisticDBInterface::DelayedWrite()
+void StatisticDBInterface::EnqueueOperation(DbOperation operation)
 {
-    AnalysisRecordModel newRecord;
-    IntervalStatistics* stats = m_statisticsToWritePtr;
-    DataDirectory*      pDataDirectory = DataDirectoryInstance::instance();
-
-    DEBUG_MESSAGE1("StatisticDBInterface", "DelayedWrite() called ThreadID = %p", QThread::currentThreadId());
+    // Only the latest read of each type is useful
+    if (operation.type == DB_OPERATION_GET || operation.type == DB_OPERATION_PREFETCH)
+    {
+        for (int i = m_pendingOperations.size() - 1; i >= 0; i--)
+        {
+            if (m_pendingOperations.at(i).type == operation.type)
+            {
+                m_pendingOperations.removeAt(i);
+            }
+        }
+    }
 
-    if (pDataDirectory->analysisParams.differenceBasedAnalysis || pDataDirectory->analysisParams.motionBasedAnalysis)
+    // Offline processing is synchronous
+    if (m_immediate)
     {
-        // Blur accumulator buffer
-        stats->accBuffer.Blur(7);
+        ExecuteOperation(operation);
+        return;
     }
 
-    newRecord.id            = 0; // will be autoincremented in DB
-    newRecord.date          = stats->date;
-    newRecord.endDate       = stats->endDate;
-    newRecord.startTime     = stats->startTime;
-    newRecord.endTime       = stats->endTime;
-    newRecord.mediaSource   = pDataDirectory->pipelineParams.inputStreamUrl;
-    newRecord.videoArchive  = stats->archiveFile;
+    m_pendingOperations.append(operation);
+    PipelineMetrics::instance()->SetGauge("db_queue_length", m_pendingOperations.size());
 
-    if (pDataDirectory->analysisParams.differenceBasedAnalysis || pDataDirectory->analysisParams.motionBasedAnalysis)
+    if (m_pendingOperations.size() == 1)
     {
-        newRecord.heatmap = CreateHeatmap(&stats->backgroundBuffer, &stats->accBuffer);
-        if (CAMERA_PIPELINE_OK != stats->ToByteArray(&newRecord.statsData))
-        {
-            ERROR_MESSAGE0(ERR_TYPE_ERROR, "StatisticDBInterface", "Unable to convert collected statistics to BLOB");
+        QTimer::singleShot(0, this, SLOT(ProcessNextOperation()));
+    }
+}
+
+void StatisticDBInterface::ProcessNextOperation()
+{
+    if (m_pendingOperations.isEmpty())
+    {
+        return;
+    }
+
+    // One operation per event loop pass, so new requests are queued (and coalesced) in between
+    ExecuteOperation(m_pendingOperations.takeFirst());
+    PipelineMetrics::instance()->SetGauge("db_queue_length", m_pendingOperations.size());
+
+    if (!m_pendingOperations.isEmpty())
+    {
+        QTimer::singleShot(0, this, SLOT(ProcessNextOperation()));
+    }
+}
+
+void StatisticDBInterface::ExecuteOperation(DbOperation operation)
+{
+    // Cached statistics are replaced by DB statistics emitted earlier (event handler is done with them)
+    if (m_releaseCachedStatistic)
+    {
+        qDeleteAll(m_cachedStatistic);
+        m_cachedStatistic.clear();
+        m_releaseCachedStatistic = false;
+    }
+
+    // Host-wide limit of simultaneous DB operations (instead of random delays)
+    DbAccessScheduler::instance()->Acquire();
+
+    switch (operation.type)
+    {
+    case DB_OPERATION_GET:
+        GetStatistic(operation.dateTime);
+        break;
+    case DB_OPERATION_PREFETCH:
+        PrefetchStatistic(operation.dateTime);
+        break;
+    case DB_OPERATION_WRITE:
+        WriteStatistic(operation.pStats);
+        break;
+    case DB_OPERATION_BASELINE:
+        UpdateBaselines(operation.pStats);
+        break;
+    case DB_OPERATION_HEATMAP:
+        RenderHeatmap(operation.dateTime);
+        break;
+    }
+
+    DbAccessScheduler::instance()->Release();
+
+    SAFE_DELETE(operation.pStats);
+}
+
+void StatisticDBInterface::GetStatistic(QDateTime dateTime)
+{
+    DataDirectory*              pDataDirectory = DataDirectoryInstance::instance();
+    QElapsedTimer               processingTimer;
+    qint64                      fetchedBytes = 0;
+    int                         periodDays = pDataDirectory->pipelineParams.statisticPeriodDays;
+    int                         intervalSeconds = pDataDirectory->pipelineParams.statisticIntervalSec;
+
+    processingTimer.restart();
+    DEBUG_MESSAGE1("StatisticDBInterface", "GetStatistic() called ThreadID = %p", QThread::currentThreadId());
+
+    while (!m_currentPeriodStatistic.isEmpty()) // Delete all previously allocated entries in stat list
+    {
+        delete m_currentPeriodStatistic.takeFirst();
+    }
+    m_currentPeriodStatistic.clear();
+
+    FetchStatistics(dateTime, m_currentPeriodStatistic, &fetchedBytes);
+
+    ERROR_MESSAGE5(ERR_TYPE_MESSAGE, "StatisticDBInterface",
+                   "%d records selected for period from %s to %s (%d ms, %d KB)",
+                   m_currentPeriodStatistic.size(),
+                   dateTime.addSecs(-(periodDays*24*3600 + intervalSeconds)).toString("dd.MM.yyyy HH:mm:ss").toUtf8().constData(),
+                   dateTime.toString("dd.MM.yyyy HH:mm:ss").toUtf8().constData(),
+                   (int)processingTimer.elapsed(),
+                   (int)(fetchedBytes / 1024));
+
+    PipelineMetrics::instance()->SetGauge("stats_fetch_ms", processingTimer.elapsed());
+    PipelineMetrics::instance()->SetGauge("stats_fetch_bytes", fetchedBytes);
+    PipelineMetrics::instance()->SetGauge("stats_fetch_records", m_currentPeriodStatistic.size());
+
+    if (m_currentPeriodStatistic.size())
+    {
+        DEBUG_MESSAGE0("StatisticDBInterface", "NewPeriodStatistics() emitted");
+        emit NewPeriodStatistics(m_currentPeriodStatistic); // Emit NewStatistics signal
+
+        // Cached statistics could still be queued to event handler, they are deleted by next operation
+        m_releaseCachedStatistic = !m_cachedStatistic.isEmpty();
+    }
+
+    // Send ping to health checker that read statistics is working
+    emit Ping("ReadStatistics", 30*60*1000); // Timeout = 30 min
+}
+
+void StatisticDBInterface::FetchStatistics(QDateTime dateTime, QList<IntervalStatistics*>& results, qint64* pFetchedBytes)
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+
+    // Single pre-merged baseline is used when available
+    if (UseBaselines())
+    {
+        IntervalStatistics* pBaseline = new IntervalStatistics;
+
+        if (CAMERA_PIPELINE_OK == GetBaseline(dateTime, pBaseline, pFetchedBytes))
+        {
+            results.append(pBaseline);
+            return;
+        }
+        delete pBaseline;
+    }
+
+    // Records are converted to interval statistics inside DAO (row by row)
+    if(CAMERA_PIPELINE_OK != m_pDAO->FindStatsForPeriod(dateTime,
+                                                        pDataDirectory->pipelineParams.statisticPeriodDays,
+                                                        pDataDirectory->pipelineParams.statisticIntervalSec,
+                                                        results,
+                                                        pFetchedBytes))
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "StatisticDBInterface", "Failed to get statistics for given period");
+    }
+}
+
+void StatisticDBInterface::PrefetchStatistic(QDateTime nextDateTime)
+{
+    QElapsedTimer               processingTimer;
+    qint64                      fetchedBytes = 0;
+    QList<IntervalStatistics*>  records;
+
+    processingTimer.restart();
+
+    FetchStatistics(nextDateTime, records, &fetchedBytes);
+
+    // Records are merged here, so processing thread gets single interval
+    if (records.size() > 1)
+    {
+        IntervalStatistics* pMerged = new IntervalStatistics;
+        double              weightSum = 0.0;
+
+        MergeRecords(records, nextDateTime.date(), nextDateTime.time(), pMerged, &weightSum);
+
+        if (weightSum > 0.0)
+        {
+            pMerged->weightScale = 1.0f / weightSum;
+            pMerged->date = nextDateTime.date();
+            pMerged->endDate = pMerged->date;
+            pMerged->startTime = nextDateTime.time();
+            pMerged->endTime = pMerged->startTime.addSecs(DataDirectoryInstance::instance()->pipelineParams.statisticIntervalSec);
+            records.append(pMerged);
+        }
+        else
+        {
+            delete pMerged;
+        }
+    }
+
+    m_prefetchedCount = records.size();
+    m_prefetchedTime = nextDateTime;
+
+    ERROR_MESSAGE4(ERR_TYPE_MESSAGE, "StatisticDBInterface",
+                   "%d records prefetched for %s (%d ms, %d KB)",
+                   m_prefetchedCount,
+                   m_prefetchedTime.toString("dd.MM.yyyy HH:mm:ss").toUtf8().constData(),
+                   (int)processingTimer.elapsed(),
+                   (int)(fetchedBytes / 1024));
+
+    PipelineMetrics::instance()->SetGauge("stats_prefetch_ms", processingTimer.elapsed());
+
+    // Event handler takes ownership of prefetched records
+    if (m_prefetchedCount)
+    {
+        emit NextPeriodStatistics(m_prefetchedTime, records);
+        m_releaseCachedStatistic = !m_cachedStatistic.isEmpty();
+    }
+}
+
+void StatisticDBInterface::WriteStatistic(IntervalStatistics* stats)
+{
+    AnalysisRecordModel* pRecord = new AnalysisRecordModel;
+    DataDirectory*      pDataDirectory = DataDirectoryInstance::instance();
+    bool                recordStored = true;
+    bool                hasStats;
+
+    DEBUG_MESSAGE1("StatisticDBInterface", "WriteStatistic() called ThreadID = %p", QThread::currentThreadId());
+
+    if (pDataDirectory->analysisParams.differenceBasedAnalysis || pDataDirectory->analysisParams.motionBasedAnalysis)
+    {
+        // Blur accumulator buffer
+        stats->accBuffer.Blur(7);
+    }
+
+    pRecord->id            = 0; // will be autoincremented in DB
+    pRecord->date          = stats->date;
+    pRecord->endDate       = stats->endDate;
+    pRecord->startTime     = stats->startTime;
+    pRecord->endTime       = stats->endTime;
+    pRecord->mediaSource   = pDataDirectory->pipelineParams.inputStreamUrl;
+    pRecord->videoArchive  = stats->archiveFile;
+
+    if (pDataDirectory->analysisParams.differenceBasedAnalysis || pDataDirectory->analysisParams.motionBasedAnalysis)
+    {
+        // Heatmap is rendered from stored accumulator when it is requested (see HandleCommand())
+        if (pDataDirectory->pipelineParams.storeHeatmap)
+        {
+            pRecord->heatmap = CreateHeatmap(&stats->backgroundBuffer, &stats->accBuffer);
+        }
+        m_lastBackground.CopyFrom(&stats->backgroundBuffer);
+
+        if (CAMERA_PIPELINE_OK != stats->ToByteArray(&pRecord->statsData))
+        {
+            ERROR_MESSAGE0(ERR_TYPE_ERROR, "StatisticDBInterface", "Unable to convert collected statistics to BLOB");
         }
     }
     else
     {
-        newRecord.statsData = QByteArray();
-        newRecord.heatmap = QImage();
+        pRecord->statsData = QByteArray();
+        pRecord->heatmap = QImage();
     }
 
-    m_pDAO->InsertRecord(newRecord);
+    hasStats = !pRecord->statsData.isEmpty();
+
+    if (m_immediate)
+    {
+        recordStored = (CAMERA_PIPELINE_OK == m_pDAO->InsertRecord(*pRecord));
+        delete pRecord;
+
+        if (recordStored && hasStats && UseBaselines())
+        {
+            UpdateBaselines(stats);
+        }
+    }
+    else
+    {
+        // Record is written (and deleted) by DB writer, baselines are updated when writer reports commit
+        // (otherwise baselines would contain intervals, which are never stored and later subtracted)
+        if (hasStats && UseBaselines())
+        {
+            IntervalStatistics* pCopy = new IntervalStatistics;
+
+            pCopy->CopyFrom(*stats);
+            m_uncommittedStatistic.append(pCopy);
+
+            // Writer drops records over the same limit (and reports them)
+            if (m_uncommittedStatistic.size() > DB_WRITER_MAX_RECORDS)
+            {
+                delete m_uncommittedStatistic.takeFirst();
+            }
+        }
+
+        emit RecordReady(pRecord);
+    }
+
+    // Cache is updated even without DB (it is reconciled with DB on next read)
+    if (NULL != m_pCache && hasStats)
+    {
+        m_pCache->StoreInterval(stats);
+        m_pCache->Save();
+    }
 
     // Send ping to health checker that write statistics is working
     emit Ping("WriteStatistic", 30*60*1000); // Timeout = 30 min
 }
 
+void StatisticDBInterface::RecordWritten(QDate date, QTime startTime, bool stored)
+{
+    DbOperation operation;
+
+    for (int i = 0; i < m_uncommittedStatistic.size(); i++)
+    {
+        IntervalStatistics* pStats = m_uncommittedStatistic.at(i);
+
+        if (pStats->date != date || pStats->startTime != startTime)
+        {
+            continue;
+        }
+
+        m_uncommittedStatistic.removeAt(i);
+
+        if (!stored)
+        {
+            delete pStats;
+            return;
+        }
+
+        // Baselines update takes its turn in DB queue (statistics copy is owned by operation)
+        operation.type = DB_OPERATION_BASELINE;
+        operation.dateTime = QDateTime(date, startTime);
+        operation.pStats = pStats;
+        EnqueueOperation(operation);
+        return;
+    }
+}
+
+void StatisticDBInterface::HandleCommand(QVariantMap command)
+{
+    DbOperation operation;
+    QVariantMap result;
+    qint64      time = command["time"].toLongLong();
+
+    if (command["command"].toString() != "heatmap")
+    {
+        return;
+    }
+
+    if (NULL == m_pDAO || m_lastBackground.GetWidth() <= 0)
+    {
+        result.insert("command", "heatmap");
+        result.insert("time", time);
+        result.insert("status", "error");
+        result.insert("error", "Heatmap is not available yet");
+        emit CommandFinished(result);
+        return;
+    }
+
+    // Record is read in its turn with other DB operations (statistics thread is not blocked on DB slot)
+    operation.type = DB_OPERATION_HEATMAP;
+    operation.dateTime = QDateTime::fromMSecsSinceEpoch(time);
+    operation.pStats = NULL;
+    EnqueueOperation(operation);
+}
+
+void StatisticDBInterface::RenderHeatmap(QDateTime dateTime)
+{
+    IntervalStatistics  stats;
+    QVariantMap         result;
+
+    result.insert("command", "heatmap");
+    result.insert("time", dateTime.toMSecsSinceEpoch());
+
+    if (CAMERA_PIPELINE_OK != m_pDAO->FindRecordStats(dateTime, &stats))
+    {
+        result.insert("status", "error");
+        result.insert("error", "No statistics found for requested time");
+        emit CommandFinished(result);
+        return;
+    }
+
+    // Stored accumulator is drawn over last background (camera view is the same)
+    QImage      heatmap = CreateHeatmap(&m_lastBackground, &stats.accBuffer);
+    QByteArray  png;
+    QBuffer     pngBuffer(&png);
+
+    pngBuffer.open(QIODevice::WriteOnly);
+    heatmap.save(&pngBuffer, "PNG");
+    pngBuffer.close();
+
+    result.insert("status", "ok");
+    result.insert("start", QDateTime(stats.date, stats.startTime).toMSecsSinceEpoch());
+    result.insert("end", QDateTime(stats.date, stats.endTime).toMSecsSinceEpoch());
+    result.insert("heatmap", QString(png.toBase64()));
+    emit CommandFinished(result);
+}
+
+bool StatisticDBInterface::IsLiveStatistics()
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+
+    // Virtual date and archive reanalysis need statistics strictly before given date
+    // Baselines and cache are updated from camera own records only
+    return !pDataDirectory->analysisParams.useVirtualDate &&
+           !m_immediate &&
+           (m_camName.isEmpty() || m_camName == pDataDirectory->pipelineParams.pipelineName);
+}
+
+bool StatisticDBInterface::UseBaselines()
+{
+    return DataDirectoryInstance::instance()->pipelineParams.statisticBaselines && IsLiveStatistics();
+}
+
+int StatisticDBInterface::BaselineSlot(QTime time)
+{
+    int intervalMs = DataDirectoryInstance::instance()->pipelineParams.statisticIntervalSec * 1000;
+    int slotsCount = 86400000 / intervalMs;
+
+    return std::min(slotsCount - 1, (time.msecsSinceStartOfDay() + intervalMs / 2) / intervalMs);
+}
+
+void StatisticDBInterface::BaselineTimeRange(int slot, int* pFirstMs, int* pLastMs)
+{
+    int intervalMs = DataDirectoryInstance::instance()->pipelineParams.statisticIntervalSec * 1000;
+    int slotsCount = 86400000 / intervalMs;
+
+    // Own slot and both neighbours (the last slot takes the rest of the day)
+    *pFirstMs = std::max(0, (slot - 1) * intervalMs - intervalMs / 2);
+    *pLastMs = (slot + 1 >= slotsCount - 1) ? (86400000 - 1) : ((slot + 1) * intervalMs + intervalMs / 2 - 1);
+}
+
+float StatisticDBInterface::BaselineWeight(const BaselineRecord& baseline, QDate targetDate, IntervalStatistics* pStats)
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    int             intervalMs = pDataDirectory->pipelineParams.statisticIntervalSec * 1000;
+    int             offset = baseline.slot - BaselineSlot(pStats->startTime);
+
+    // Interval is merged into exactly its own slot and both neighbours, if it is inside the period
+    if ((offset < -1) || (offset > 1) ||
+        (pStats->date < targetDate.addDays(-pDataDirectory->pipelineParams.statisticPeriodDays)) ||
+        (pStats->date > targetDate))
+    {
+        return 0.0f;
+    }
+
+    // Decisions are made on the same time of day as the interval start (shifted to neighbour slot),
+    // not on slot grid time, so the same time rule works as for live intervals
+    QTime decisionTime = pStats->startTime.addMSecs(offset * intervalMs);
+
+    return DecisionMakerBase::IntervalWeight(targetDate, decisionTime, pStats->date, pStats->startTime);
+}
+
+void StatisticDBInterface::MergeBaselineRecords(QList<IntervalStatistics*>& records, BaselineRecord& baseline, QDate targetDate,
+                                                IntervalStatistics* pDst, float sign)
+{
+    while (!records.isEmpty())
+    {
+        IntervalStatistics* pRecord = records.takeFirst();
+        float               weight = BaselineWeight(baseline, targetDate, pRecord);
+
+        if (weight > 0.0f)
+        {
+            MergeStatistics(pDst, pRecord, sign * weight);
+            baseline.weightSum += sign * weight;
+        }
+        delete pRecord;
+    }
+}
+
+ErrorCode StatisticDBInterface::AdvanceBaseline(BaselineRecord& baseline, IntervalStatistics* pMerged, QDate targetDate)
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    int             periodDays = pDataDirectory->pipelineParams.statisticPeriodDays;
+    QDate           prevDate = QDate::fromJulianDay(baseline.targetDay);
+    int             days = targetDate.toJulianDay() - baseline.targetDay;
+
+    if (days <= 0)
+    {
+        return CAMERA_PIPELINE_OK;
+    }
+
+    if (pDataDirectory->pipelineParams.statisticBaselineDecay)
+    {
+        // Approximation: older intervals fade out with statistic period time constant
+        float decay = (float)exp(-(double)days / std::max(1, periodDays));
+
+        pMerged->accBuffer.Scale(decay);
+        pMerged->motionMap.Scale(decay);
+        baseline.weightSum *= decay;
+    }
+    else if (days <= periodDays)
+    {
+        QList<IntervalStatistics*>  records;
+        int                         firstMs;
+        int                         lastMs;
+
+        // Exact period window: intervals, which left the period, are subtracted with weights they were merged with
+        BaselineTimeRange(baseline.slot, &firstMs, &lastMs);
+        if (CAMERA_PIPELINE_OK != m_pDAO->FindStatsForDays(prevDate.addDays(-periodDays), targetDate.addDays(-periodDays - 1),
+                                                           firstMs, lastMs, records))
+        {
+            return CAMERA_PIPELINE_ERROR;
+        }
+
+        MergeBaselineRecords(records, baseline, prevDate, pMerged, -1.0f);
+        PipelineMetrics::instance()->AddCounter("stats_baseline_advances_total", 1);
+    }
+    else
+    {
+        // Whole period is out of window
+        baseline.weightSum = 0.0;
+    }
+
+    // Only rounding errors are left (weights are integer)
+    if (baseline.weightSum < 0.5)
+    {
+        pMerged->accBuffer.Reset();
+        pMerged->motionMap.Reset();
+        baseline.weightSum = 0.0;
+    }
+
+    baseline.targetDay = targetDate.toJulianDay();
+    return CAMERA_PIPELINE_OK;
+}
+
+void StatisticDBInterface::MergeStatistics(IntervalStatistics* pDst, IntervalStatistics* pSrc, float weight)
+{
+    if ((pDst->accBuffer.GetWidth() != pSrc->AccWidth()) ||
+        (pDst->accBuffer.GetHeight() != pSrc->AccHeight()))
+    {
+        pDst->accBuffer.SetSize(pSrc->AccWidth(), pSrc->AccHeight());
+    }
+
+    // Same accumulation as in decision makers ProcessStatistics()
+    pSrc->AddAccumulatorTo(&pDst->accBuffer, weight);
+    pSrc->AddMotionMapTo(&pDst->motionMap, weight);
+}
+
+void StatisticDBInterface::MergeRecords(QList<IntervalStatistics*>& records, QDate date, QTime time, IntervalStatistics* pDst, double* pWeightSum)
+{
+    *pWeightSum = 0.0;
+
+    while (!records.isEmpty())
+    {
+        IntervalStatistics* pRecord = records.takeFirst();
+        float               weight = DecisionMakerBase::IntervalWeight(date, time, pRecord->date, pRecord->startTime);
+
+        if (weight > 0.0f)
+        {
+            MergeStatistics(pDst, pRecord, weight);
+            *pWeightSum += weight;
+        }
+        delete pRecord;
+    }
+}
+
+ErrorCode StatisticDBInterface::GetBaseline(QDateTime dateTime, IntervalStatistics* pStats, qint64* pFetchedBytes)
+{
+    DataDirectory*              pDataDirectory = DataDirectoryInstance::instance();
+    QList<BaselineRecord>       baselines;
+    BaselineRecord              baseline;
+
+    baseline.slot = BaselineSlot(dateTime.time());
+    baseline.dayOfWeek = dateTime.date().dayOfWeek();
+
+    if (CAMERA_PIPELINE_OK != m_pDAO->FindBaselines(baseline.slot, baseline.slot, baseline.dayOfWeek, baselines))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if (!baselines.isEmpty())
+    {
+        baseline = baselines.first();
+        *pFetchedBytes = baseline.statsData.size();
+        PipelineMetrics::instance()->AddCounter("stats_baseline_hits_total", 1);
+
+        // Period was moved since the last update (no intervals were written for the slot meanwhile)
+        if (baseline.targetDay < dateTime.date().toJulianDay())
+        {
+            IntervalStatistics  merged;
+
+            if ((CAMERA_PIPELINE_OK != merged.FromByteArray(&baseline.statsData)) ||
+                (CAMERA_PIPELINE_OK != AdvanceBaseline(baseline, &merged, dateTime.date())))
+            {
+                return CAMERA_PIPELINE_ERROR;
+            }
+
+            baseline.statsData.clear();
+            merged.ToBlob(&baseline.statsData);
+            m_pDAO->StoreBaseline(baseline);
+        }
+    }
+    else
+    {
+        QList<IntervalStatistics*>  records;
+        IntervalStatistics          merged;
+        int                         firstMs;
+        int                         lastMs;
+
+        // No baseline yet - build it from records of the period (once), later it is updated on each write
+        BaselineTimeRange(baseline.slot, &firstMs, &lastMs);
+        if (CAMERA_PIPELINE_OK != m_pDAO->FindStatsForDays(
+                    dateTime.date().addDays(-pDataDirectory->pipelineParams.statisticPeriodDays), dateTime.date(),
+                    firstMs, lastMs, records, pFetchedBytes))
+        {
+            return CAMERA_PIPELINE_ERROR;
+        }
+
+        baseline.targetDay = dateTime.date().toJulianDay();
+        baseline.weightSum = 0.0;
+        MergeBaselineRecords(records, baseline, dateTime.date(), &merged, 1.0f);
+
+        if (baseline.weightSum <= 0.0)
+        {
+            return CAMERA_PIPELINE_ERROR;
+        }
+
+        merged.ToBlob(&baseline.statsData);
+        m_pDAO->StoreBaseline(baseline);
+        PipelineMetrics::instance()->AddCounter("stats_baseline_builds_total", 1);
+    }
+
+    if (CAMERA_PIPELINE_OK != LoadBaseline(baseline, dateTime, pStats))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if (NULL != m_pCache)
+    {
+        m_pCache->StoreBaseline(baseline);
+        m_pCache->Save();
+    }
+
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode StatisticDBInterface::LoadBaseline(const BaselineRecord& baseline, QDateTime dateTime, IntervalStatistics* pStats)
+{
+    QByteArray  statsData = baseline.statsData;
+
+    if (baseline.weightSum <= 0.0)
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    // Baseline is used in place (older rows are converted)
+    if ((CAMERA_PIPELINE_OK != pStats->Attach(statsData)) &&
+        (CAMERA_PIPELINE_OK != pStats->FromByteArray(&statsData)))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "StatisticDBInterface", "Unable to convert baseline %d to interval statistics data", baseline.slot);
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    // Normalize, so decision makers get weighted average of intervals
+    pStats->weightScale = 1.0f / baseline.weightSum;
+
+    // Merged interval gets requested date and time, so its own weight is not zero
+    pStats->date = dateTime.date();
+    pStats->endDate = pStats->date;
+    pStats->startTime = dateTime.time();
+    pStats->endTime = pStats->startTime.addSecs(DataDirectoryInstance::instance()->pipelineParams.statisticIntervalSec);
+
+    return CAMERA_PIPELINE_OK;
+}
+
+void StatisticDBInterface::GetCachedStatistic(QDateTime dateTime)
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    BaselineRecord  baseline;
+
+    if (UseBaselines() && m_pCache->FindBaseline(BaselineSlot(dateTime.time()), dateTime.date().dayOfWeek(), &baseline))
+    {
+        IntervalStatistics* pStats = new IntervalStatistics;
+
+        if (CAMERA_PIPELINE_OK == LoadBaseline(baseline, dateTime, pStats))
+        {
+            m_cachedStatistic.append(pStats);
+        }
+        else
+        {
+            delete pStats;
+        }
+    }
+
+    // Last written intervals (when baselines are not used or not cached yet)
+    if (m_cachedStatistic.isEmpty())
+    {
+        m_pCache->FindIntervals(dateTime,
+                                pDataDirectory->pipelineParams.statisticPeriodDays,
+                                pDataDirectory->pipelineParams.statisticIntervalSec,
+                                m_cachedStatistic);
+    }
+
+    if (m_cachedStatistic.size())
+    {
+        ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "StatisticDBInterface",
+                       "%d cached records used for %s until statistics are read from DB",
+                       m_cachedStatistic.size(),
+                       dateTime.toString("dd.MM.yyyy HH:mm:ss").toUtf8().constData());
+
+        PipelineMetrics::instance()->AddCounter("stats_cache_hits_total", 1);
+        emit NewPeriodStatistics(m_cachedStatistic);
+    }
+}
+
+void StatisticDBInterface::UpdateBaselines(IntervalStatistics* stats)
+{
+    DataDirectory*          pDataDirectory = DataDirectoryInstance::instance();
+    QList<BaselineRecord>   baselines;
+    int                     intervalMs = pDataDirectory->pipelineParams.statisticIntervalSec * 1000;
+    int                     ownSlot = BaselineSlot(stats->startTime);
+
+    // Interval is merged into its own slot and both neighbours (same slots as in baseline build)
+    int firstSlot = std::max(0, ownSlot - 1);
+    int lastSlot = std::min(86400000 / intervalMs - 1, ownSlot + 1);
+
+    // Only existing baselines are updated, missing ones are built from records on first request
+    if (CAMERA_PIPELINE_OK != m_pDAO->FindBaselines(firstSlot, lastSlot, 0, baselines))
+    {
+        return;
+    }
+
+    for (int i = 0; i < baselines.size(); i++)
+    {
+        BaselineRecord&     baseline = baselines[i];
+        IntervalStatistics  merged;
+
+        // Nearest decision date with baseline day of week (baseline can be already moved further)
+        QDate   targetDate = stats->date.addDays((baseline.dayOfWeek - stats->date.dayOfWeek() + 7) % 7);
+
+        if (targetDate.toJulianDay() < baseline.targetDay)
+        {
+            targetDate = QDate::fromJulianDay(baseline.targetDay);
+        }
+
+        float   weight = BaselineWeight(baseline, targetDate, stats);
+
+        if (weight <= 0.0f)
+        {
+            continue;
+        }
+
+        if ((CAMERA_PIPELINE_OK != merged.FromByteArray(&baseline.statsData)) ||
+            (CAMERA_PIPELINE_OK != AdvanceBaseline(baseline, &merged, targetDate)))
+        {
+            continue;
+        }
+
+        // Resolution was changed - start new baseline
+        if ((merged.accBuffer.GetWidth() != stats->accBuffer.GetWidth()) ||
+            (merged.accBuffer.GetHeight() != stats->accBuffer.GetHeight()))
+        {
+            merged.accBuffer.Reset();
+            merged.motionMap.Reset();
+            baseline.weightSum = 0.0;
+        }
+
+        MergeStatistics(&merged, stats, weight);
+        baseline.weightSum += weight;
+
+        baseline.statsData.clear();
+        merged.ToBlob(&baseline.statsData);
+        m_pDAO->StoreBaseline(baseline);
+
+        if (NULL != m_pCache)
+        {
+            m_pCache->StoreBaseline(baseline, true);
+        }
+    }
+
+    DEBUG_MESSAGE1("StatisticDBInterface", "%d baselines updated", baselines.size());
+}
+
 struct TColor
 {
     double r;
@@ -442,7 +1461,7 @@ struct TColor
     double b;
 };
 
-TColor GetColour(double v, double vmin, double vmax)
+static TColor GetColour(double v, double vmin, double vmax)
 {
     TColor c;
     c.r = 1.0;
@@ -476,8 +1495,33 @@ TColor GetColour(double v, double vmin, double vmax)
     return c;
 }
 
+/// Heatmap colours and background parts for blending (8.8 fixed point, sum is truncated as in double blending)
+struct HeatmapLut
+{
+    unsigned short  heat[255*HEATMAP_LUT_STEPS + 1][3]; /// Colour of accumulated value, multiplied by HEATMAP_ALPHA
+    unsigned short  background[256];                    /// Background value, multiplied by 1 - HEATMAP_ALPHA
+
+    HeatmapLut()
+    {
+        for (int v = 0; v <= 255*HEATMAP_LUT_STEPS; v++)
+        {
+            TColor c = GetColour(v / (255.0 * HEATMAP_LUT_STEPS), 0.0, 1.0);
+
+            heat[v][0] = (unsigned short)(HEATMAP_ALPHA * c.r * 255.0 * 256.0);
+            heat[v][1] = (unsigned short)(HEATMAP_ALPHA * c.g * 255.0 * 256.0);
+            heat[v][2] = (unsigned short)(HEATMAP_ALPHA * c.b * 255.0 * 256.0);
+        }
+        for (int v = 0; v < 256; v++)
+        {
+            background[v] = (unsigned short)((1.0 - HEATMAP_ALPHA) * v * 256.0);
+        }
+    }
+};
+
 QImage StatisticDBInterface::CreateHeatmap(VideoBuffer* pBkgrBuffer, AccumlatorBuffer* pAccBuffer)
 {
+    static const HeatmapLut lut;            // Built once (thread-safe static initialization)
+
     int     width = pBkgrBuffer->GetWidth();
     int     height = pBkgrBuffer->GetHeight();
     int     stride = pBkgrBuffer->GetStride();
@@ -488,49 +1532,45 @@ QImage StatisticDBInterface::CreateHeatmap(VideoBuffer* pBkgrBuffer, AccumlatorB
 
     if (width > 0 && height > 0 && accWidth > 0 && accHeight > 0)
     {
-        float   scale = (float)accWidth / (float)width;
-
-        float*         pAcc = pAccBuffer->GetPlaneData();
-        unsigned char* pBkg = pBkgrBuffer->GetPlaneData();
-
-        TColor  c;
-        double  val1;
-        double  val2;
-
-        QImage  res(width, height, QImage::Format_RGB888);
+        float           scale = (float)accWidth / (float)width;
+        const float*    pAcc = pAccBuffer->GetPlaneData();
+        unsigned char*  pBkg = pBkgrBuffer->GetPlaneData();
+        QVector<int>    accColumns(width);
+        QImage          res(width, height, QImage::Format_RGB888);
+
+        // Accumulator column of each output column is the same for all rows
+        for (int i = 0; i < width; i++)
+        {
+            accColumns[i] = std::min(accWidth, (int)(i*scale));
+        }
 
         for (int j = 0; j < height; j++)
         {
-            for (int i = 0; i < width; i++)
-            {
-                val1 = pAcc[std::min(accHeight, (int)(j*scale))*accStride + std::min(accWidth, (int)(i*scale))];
-                val2 = pBkg[j*stride + i];
+            const float*            pAccRow = pAcc + std::min(accHeight, (int)(j*scale))*accStride;
+            const unsigned char*    pBkgRow = pBkg + j*stride;
+            uchar*                  pDst = res.scanLine(j);
 
-                val1  = std::min(val1, 255.0) / 255.0;
-                val2 /= 255.0;
+            // Background is copied to all channels, heat colour is blended where accumulated value is high enough
+            for (int i = 0; i < width; i++, pDst += 3)
+            {
+                float           val = pAccRow[accColumns[i]];
+                unsigned char   bkg = pBkgRow[i];
 
-                if (val1 > 0.06)  // ~16 in absoulute value
+                if (val > HEATMAP_THRESHOLD)
                 {
-                    c = GetColour(val1, 0.0, 1.0); // Get coloured heatmap
+                    const unsigned short*   pHeat = lut.heat[(int)(std::min(val, 255.0f) * HEATMAP_LUT_STEPS)];
+                    unsigned short          bkgPart = lut.background[bkg];
 
-                    // Blend with background
-                    c.r = 0.7*c.r + 0.3*val2;
-                    c.g = 0.7*c.g + 0.3*val2;
-                    c.b = 0.7*c.b + 0.3*val2;
+                    pDst[0] = (pHeat[0] + bkgPart) >> 8;
+                    pDst[1] = (pHeat[1] + bkgPart) >> 8;
+                    pDst[2] = (pHeat[2] + bkgPart) >> 8;
                 }
                 else
                 {
-                    c.r = val2;
-                    c.g = val2;
-                    c.b = val2;
+                    pDst[0] = bkg;
+                    pDst[1] = bkg;
+                    pDst[2] = bkg;
                 }
-                // Set result pixel
-
-                int r = c.r * 255.0;
-                int g = c.g * 255.0;
-                int b = c.b * 255.0;
-
-                res.setPixel(i, j, qRgb(r, g, b));
             }
         }
         return res;
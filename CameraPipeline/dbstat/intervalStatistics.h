@@ -3,8 +3,10 @@
 #include <QList>
 #include <QDateTime>
 #include <QByteArray>
+#include <QVariantMap>
 
 #include "analysisRecordSQliteDao.h"
+#include "statisticsCache.h"
 #include "networkUtils/dataDirectory.h"
 #include "pipelineCommonTypes.h"
 
@@ -13,37 +15,94 @@ class StatisticDBInterface : public QObject
 {
     Q_OBJECT
 public:
-    StatisticDBInterface();
+    StatisticDBInterface(QString connectionName = QString(), QString camName = QString(), bool immediate = false);
     ~StatisticDBInterface();
 
     static QImage CreateHeatmap(VideoBuffer* pBkgrBuffer, AccumlatorBuffer* pAccBuffer);
 
 signals:
     void NewPeriodStatistics(QList<IntervalStatistics* > curStatsList);  /// Inform all about new statistics
+    void NextPeriodStatistics(QDateTime startTime, QList<IntervalStatistics* > nextStatsList);  /// Statistics prefetched for next interval (deleted by receiver)
+    void RecordReady(AnalysisRecordModel* pRecord);                      /// Interval record for DB writer (deleted by receiver)
     void Ping(const char* name, int timeoutMs);                          /// Ping signal for health checker
+    void CommandFinished(QVariantMap response);                          /// Response to frontend command
 
 public slots:
     void OpenDB();
     void PerformGetStatistic(QDateTime currentDateTime);
+    void PerformPrefetchStatistic(QDateTime nextDateTime);
     void PerformWriteStatistic(IntervalStatistics* stats);
     void NewArchiveFileName(QString newFileName);
-    void StoreEvent(EventDescription event);
+    void StoreEvent(EventDescription event);                             /// Synchronous write (live events go to DB writer)
+    void HandleCommand(QVariantMap command);                             /// "heatmap" command (rendered on request)
+    void RecordWritten(QDate date, QTime startTime, bool stored);        /// DB writer result (baselines are updated only for stored records)
 
 private slots:
-    // These functions need to avoid simultaneous DB access
-    // when several instances are working on a same server
-    // Read and write functions should be called with random delay
-    void  DelayedGet();
-    void  DelayedWrite();
+    // DB operations are queued and executed one by one, each of them takes
+    // a slot of host-wide DbAccessScheduler (several instances work on a same server)
+    void  ProcessNextOperation();
 
 private:
+    enum DbOperationType
+    {
+        DB_OPERATION_GET,
+        DB_OPERATION_PREFETCH,
+        DB_OPERATION_WRITE,
+        DB_OPERATION_BASELINE,
+        DB_OPERATION_HEATMAP
+    };
+
+    struct DbOperation
+    {
+        DbOperationType     type;
+        QDateTime           dateTime;
+        IntervalStatistics* pStats;                         /// Own copy of statistics to write (or merge into baselines)
+    };
+
     AnalysisRecordDao*          m_pDAO;
+    StatisticsCache*            m_pCache;                   /// Local statistics cache (NULL if disabled)
+    QString                     m_connectionName;           /// DB connection name (empty for default connection)
+    QString                     m_camName;                  /// Camera name for stored records (empty for pipeline name)
+    bool                        m_immediate;                /// Access DB synchronously, without queue (offline processing)
+    bool                        m_releaseCachedStatistic;   /// DB statistics were emitted, cached ones are not used anymore
 
     QList<IntervalStatistics *> m_currentPeriodStatistic;   /// Current period statistic
+    QList<IntervalStatistics *> m_cachedStatistic;          /// Statistic from local cache used on startup (until DB read)
+    QList<IntervalStatistics *> m_uncommittedStatistic;     /// Written intervals waiting for DB writer commit (baselines are updated after it)
     QString                     m_archiveFileName;          /// Actual archive file name from stream recorder
+    VideoBuffer                 m_lastBackground;           /// Background of last written interval or camera thumbnail (for heatmaps on request)
+
+    QList<DbOperation>          m_pendingOperations;        /// Operations waiting for DB access
+
+    int                         m_prefetchedCount;          /// Records passed to event handler by the last prefetch
+    QDateTime                   m_prefetchedTime;           /// Interval start of prefetched statistic
+
+    void        EnqueueOperation(DbOperation operation);
+    void        ExecuteOperation(DbOperation operation);
+    void        GetStatistic(QDateTime dateTime);
+    void        PrefetchStatistic(QDateTime nextDateTime);
+    void        WriteStatistic(IntervalStatistics* stats);
+    void        RenderHeatmap(QDateTime dateTime);              /// Heatmap of record, which contains given time (emits CommandFinished)
+    void        FetchStatistics(QDateTime dateTime, QList<IntervalStatistics*>& results, qint64* pFetchedBytes);
+
+    bool        IsLiveStatistics();
+
+    // Rolling baselines: each slot keeps weighted sum of recent intervals, so only one record is read
+    bool        UseBaselines();
+    int         BaselineSlot(QTime time);
+    void        BaselineTimeRange(int slot, int* pFirstMs, int* pLastMs);  /// Start times of intervals merged into slot
+    float       BaselineWeight(const BaselineRecord& baseline, QDate targetDate, IntervalStatistics* pStats);
+    void        MergeBaselineRecords(QList<IntervalStatistics*>& records, BaselineRecord& baseline, QDate targetDate,
+                                     IntervalStatistics* pDst, float sign);
+    ErrorCode   AdvanceBaseline(BaselineRecord& baseline, IntervalStatistics* pMerged, QDate targetDate);
+    ErrorCode   GetBaseline(QDateTime dateTime, IntervalStatistics* pStats, qint64* pFetchedBytes);
+    ErrorCode   LoadBaseline(const BaselineRecord& baseline, QDateTime dateTime, IntervalStatistics* pStats);
+    void        GetCachedStatistic(QDateTime dateTime);
+    void        UpdateBaselines(IntervalStatistics* stats);
 
-    QDateTime                   m_statisticsToGetTime;
-    IntervalStatistics*         m_statisticsToWritePtr;
+    static void MergeStatistics(IntervalStatistics* pDst, IntervalStatistics* pSrc, float weight);
+    /// Merge records (deleted after merge) with decision maker weights for given date and time
+    static void MergeRecords(QList<IntervalStatistics*>& records, QDate date, QTime time, IntervalStatistics* pDst, double* pWeightSum);
 };
 
 class VideoStatistics : public QObject
@@ -55,6 +114,7 @@ public:
 
 signals:
     void  StatisticPeriodStarted(QDateTime currentDateTime);
+    void  NextStatisticPeriodExpected(QDateTime nextDateTime);
     void  StatisticPeriodReady(IntervalStatistics* stats);
 
 public slots:
@@ -0,0 +1,204 @@
+#include <string.h>
+#include <zlib.h>
+
+#include "statisticsBlob.h"
+
+#define ALIGN_UP(n, a)  ((((n) + (a) - 1) / (a)) * (a))
+
+StatisticsBlobView::StatisticsBlobView() :
+    m_pData(NULL),
+    m_size(0),
+    m_pAcc(NULL),
+    m_pMovements(NULL),
+    m_pMotion(NULL)
+{
+
+}
+
+void StatisticsBlobView::Write(QByteArray* bytes, AccumlatorBuffer* pAccBuffer, const QVector<double>& movements, MotionMap* pMotionMap)
+{
+    StatsBlobHeader     header;
+    StatsBlobSection    sections[3];
+    quint64             offset;
+
+    memset(&header, 0, sizeof(header));
+    memset(sections, 0, sizeof(sections));
+
+    header.magic = STATS_BLOB_MAGIC;
+    header.version = STATS_BLOB_VERSION;
+    header.sectionsCount = 3;
+    header.headerSize = sizeof(StatsBlobHeader) + header.sectionsCount*sizeof(StatsBlobSection);
+
+    // Accumulator is stored with its stride, so it can be used without repacking
+    sections[0].type = STATS_SECTION_ACCUMULATOR;
+    sections[0].elementSize = sizeof(float);
+    sections[0].width = pAccBuffer->GetWidth();
+    sections[0].height = pAccBuffer->GetHeight();
+    sections[0].stride = pAccBuffer->GetStride();
+    sections[0].count = (NULL != pAccBuffer->GetPlaneData()) ? sections[0].stride * sections[0].height : 0;
+
+    sections[1].type = STATS_SECTION_MOVEMENTS;
+    sections[1].elementSize = sizeof(double);
+    sections[1].count = movements.size();
+
+    sections[2].type = STATS_SECTION_MOTION_MAP;
+    sections[2].elementSize = sizeof(MotionModel_t);
+    sections[2].width = pMotionMap->GetWidth();
+    sections[2].height = pMotionMap->GetHeight();
+    sections[2].stride = pMotionMap->GetBlockSize();
+    sections[2].count = (NULL != pMotionMap->GetModelPtr()) ? pMotionMap->GetBlocksCount() : 0;
+
+    offset = ALIGN_UP(header.headerSize, STATS_BLOB_ALIGNMENT);
+    for (int i = 0; i < 3; i++)
+    {
+        sections[i].offset = offset;
+        sections[i].size = (quint64)sections[i].count * sections[i].elementSize;
+        offset = ALIGN_UP(offset + sections[i].size, STATS_BLOB_ALIGNMENT);
+    }
+    header.totalSize = offset;
+
+    // Whole blob is allocated at once (padding is zero)
+    bytes->fill(0, header.totalSize);
+
+    char* pData = bytes->data();
+
+    memcpy(pData + sizeof(header), sections, sizeof(sections));
+    if (sections[0].size)
+    {
+        memcpy(pData + sections[0].offset, pAccBuffer->GetPlaneData(), sections[0].size);
+    }
+    if (sections[1].size)
+    {
+        memcpy(pData + sections[1].offset, movements.constData(), sections[1].size);
+    }
+    if (sections[2].size)
+    {
+        memcpy(pData + sections[2].offset, pMotionMap->GetModelPtr(), sections[2].size);
+    }
+
+    header.checksum = crc32(0L, (const Bytef*)(pData + sizeof(header)), header.totalSize - sizeof(header));
+    memcpy(pData, &header, sizeof(header));
+}
+
+bool StatisticsBlobView::IsBlob(const char* pData, qint64 size)
+{
+    StatsBlobHeader header;
+
+    if (NULL == pData || size < (qint64)sizeof(header))
+    {
+        return false;
+    }
+    memcpy(&header, pData, sizeof(header));
+
+    return (header.magic == STATS_BLOB_MAGIC) && (header.version == STATS_BLOB_VERSION);
+}
+
+bool StatisticsBlobView::CheckSection(const StatsBlobSection* pSection, quint64 totalSize)
+{
+    quint64 expectedSize = (quint64)pSection->count * pSection->elementSize;
+
+    if ((pSection->offset % STATS_BLOB_ALIGNMENT) ||
+        (pSection->offset > totalSize) ||
+        (pSection->size > totalSize - pSection->offset) ||
+        (pSection->size < expectedSize))
+    {
+        return false;
+    }
+
+    switch (pSection->type)
+    {
+    case STATS_SECTION_ACCUMULATOR:
+        return (pSection->elementSize == sizeof(float)) &&
+               (pSection->width >= 0) && (pSection->height >= 0) && (pSection->stride >= pSection->width) &&
+               ((pSection->count == 0) || ((quint64)pSection->count == (quint64)pSection->stride * pSection->height));
+
+    case STATS_SECTION_MOVEMENTS:
+        return (pSection->elementSize == sizeof(double));
+
+    case STATS_SECTION_MOTION_MAP:
+        // Non-empty map must have valid block size (it is used as divisor and step)
+        return (pSection->elementSize == sizeof(MotionModel_t)) &&
+               (pSection->width >= 0) && (pSection->height >= 0) &&
+               ((quint64)pSection->count == (quint64)pSection->width * pSection->height) &&
+               (pSection->stride >= 0) && (pSection->stride <= MAX_ME_BLOCK_SIZE) &&
+               ((pSection->count == 0) || (pSection->stride > 0));
+
+    default:
+        return true;    // Unknown sections are skipped
+    }
+}
+
+ErrorCode StatisticsBlobView::Attach(const char* pData, qint64 size, bool verifyChecksum)
+{
+    const StatsBlobHeader*  pHeader = (const StatsBlobHeader*)pData;
+
+    Detach();
+
+    // Sections are used in place, so blob start must be aligned for doubles
+    if (!IsBlob(pData, size) || ((quintptr)pData & (sizeof(double) - 1)))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if ((pHeader->sectionsCount > STATS_BLOB_MAX_SECTIONS) ||
+        (pHeader->headerSize != sizeof(StatsBlobHeader) + pHeader->sectionsCount*sizeof(StatsBlobSection)) ||
+        (pHeader->totalSize > (quint64)size) ||
+        (pHeader->headerSize > pHeader->totalSize))
+    {
+        ERROR_MESSAGE2(ERR_TYPE_DISPOSABLE, "StatisticsBlobView", "Invalid blob header (size %lld, declared %llu)",
+                       (long long)size, (unsigned long long)pHeader->totalSize);
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if (verifyChecksum &&
+        (pHeader->checksum != crc32(0L, (const Bytef*)(pData + sizeof(StatsBlobHeader)), pHeader->totalSize - sizeof(StatsBlobHeader))))
+    {
+        ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StatisticsBlobView", "Blob checksum mismatch");
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    const StatsBlobSection* pSections = (const StatsBlobSection*)(pData + sizeof(StatsBlobHeader));
+
+    for (quint32 i = 0; i < pHeader->sectionsCount; i++)
+    {
+        const StatsBlobSection* pSection = &pSections[i];
+
+        if (!CheckSection(pSection, pHeader->totalSize))
+        {
+            ERROR_MESSAGE1(ERR_TYPE_DISPOSABLE, "StatisticsBlobView", "Invalid blob section %d", (int)pSection->type);
+            m_pAcc = m_pMovements = m_pMotion = NULL;
+            return CAMERA_PIPELINE_ERROR;
+        }
+
+        switch (pSection->type)
+        {
+        case STATS_SECTION_ACCUMULATOR: m_pAcc = pSection;       break;
+        case STATS_SECTION_MOVEMENTS:   m_pMovements = pSection; break;
+        case STATS_SECTION_MOTION_MAP:  m_pMotion = pSection;    break;
+        default: break;
+        }
+    }
+
+    m_pData = pData;
+    m_size = pHeader->totalSize;
+
+    return CAMERA_PIPELINE_OK;
+}
+
+void StatisticsBlobView::Detach()
+{
+    m_pData = NULL;
+    m_size = 0;
+    m_pAcc = NULL;
+    m_pMovements = NULL;
+    m_pMotion = NULL;
+}
+
+const char* StatisticsBlobView::SectionData(const StatsBlobSection* pSection) const
+{
+    if (NULL == m_pData || NULL == pSection || 0 == pSection->count)
+    {
+        return NULL;
+    }
+    return m_pData + pSection->offset;
+}
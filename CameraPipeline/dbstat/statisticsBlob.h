@@ -0,0 +1,92 @@
+#ifndef STATISTICSBLOB_H
+#define STATISTICSBLOB_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <QByteArray>
+
+#include "cameraPipelineCommon.h"
+#include "motionTypes.h"
+
+#define  STATS_BLOB_MAGIC           0xDEADBEEF
+#define  STATS_BLOB_VERSION         0x00000003
+#define  STATS_BLOB_ALIGNMENT       64          // Sections are aligned to cache line (relative to blob start)
+#define  STATS_BLOB_MAX_SECTIONS    16
+
+enum StatsBlobSectionType
+{
+    STATS_SECTION_ACCUMULATOR = 1,              /// float[stride * height]
+    STATS_SECTION_MOVEMENTS   = 2,              /// double[count]
+    STATS_SECTION_MOTION_MAP  = 3               /// MotionModel_t[width * height], stride is block size
+};
+
+/// Fixed blob header (all fields are naturally aligned)
+struct StatsBlobHeader
+{
+    quint32     magic;
+    quint32     version;
+    quint32     headerSize;                     /// Fixed header and sections table
+    quint32     sectionsCount;
+    quint64     totalSize;                      /// Header, table and all sections with padding
+    quint32     checksum;                       /// CRC32 of everything after fixed header
+    quint32     reserved;
+};
+
+/// Sections table entry
+struct StatsBlobSection
+{
+    quint32     type;
+    quint32     elementSize;                    /// Size of one element (layout check between builds)
+    quint64     offset;                         /// Offset from blob start
+    quint64     size;                           /// Section size in bytes
+    qint32      width;
+    qint32      height;
+    qint32      stride;
+    quint32     count;                          /// Number of elements
+};
+
+/*
+ * Read-only view of statistics blob (version 3)
+ * Blob is self-describing: sections are found through the table, all offsets and sizes are checked
+ * on attach, so accessors return pointers directly into blob memory (fetched buffer or mapped file).
+ * Data must stay valid while view is attached.
+ */
+class StatisticsBlobView
+{
+public:
+    StatisticsBlobView();
+
+    /// Build blob from statistics buffers
+    static void     Write(QByteArray* bytes, AccumlatorBuffer* pAccBuffer, const QVector<double>& movements, MotionMap* pMotionMap);
+    /// Magic and version check only (to select parser)
+    static bool     IsBlob(const char* pData, qint64 size);
+
+    ErrorCode       Attach(const char* pData, qint64 size, bool verifyChecksum = true);
+    void            Detach();
+    bool            IsAttached() const { return (NULL != m_pData); }
+
+    int             AccWidth() const        { return (NULL != m_pAcc) ? m_pAcc->width : 0; }
+    int             AccHeight() const       { return (NULL != m_pAcc) ? m_pAcc->height : 0; }
+    int             AccStride() const       { return (NULL != m_pAcc) ? m_pAcc->stride : 0; }
+    const float*    AccData() const         { return (const float*)SectionData(m_pAcc); }
+
+    int             MovementsCount() const  { return (NULL != m_pMovements) ? (int)m_pMovements->count : 0; }
+    const double*   Movements() const       { return (const double*)SectionData(m_pMovements); }
+
+    int             MotionWidth() const     { return (NULL != m_pMotion) ? m_pMotion->width : 0; }
+    int             MotionHeight() const    { return (NULL != m_pMotion) ? m_pMotion->height : 0; }
+    int             MotionBlockSize() const { return (NULL != m_pMotion) ? m_pMotion->stride : 0; }
+    const MotionModel_t* MotionModels() const { return (const MotionModel_t*)SectionData(m_pMotion); }
+
+private:
+    const char*                 m_pData;
+    qint64                      m_size;
+    const StatsBlobSection*     m_pAcc;
+    const StatsBlobSection*     m_pMovements;
+    const StatsBlobSection*     m_pMotion;
+
+    const char*     SectionData(const StatsBlobSection* pSection) const;
+    bool            CheckSection(const StatsBlobSection* pSection, quint64 totalSize);
+};
+
+#endif // STATISTICSBLOB_H
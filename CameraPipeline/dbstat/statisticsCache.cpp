@@ -0,0 +1,308 @@
+#include <string.h>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include "statisticsCache.h"
+#include "pipelineConfig.h"
+
+#define  STATS_CACHE_MAGIC      0x43545350      // 'PSTC'
+#define  STATS_CACHE_VERSION    1
+
+#define ALIGN_UP(n, a)  ((((n) + (a) - 1) / (a)) * (a))
+
+enum StatsCacheEntryType
+{
+    STATS_CACHE_BASELINE = 1,
+    STATS_CACHE_INTERVAL = 2
+};
+
+struct StatsCacheHeader
+{
+    quint32     magic;
+    quint32     version;
+    quint32     entriesCount;
+    quint32     reserved;
+};
+
+struct StatsCacheEntry
+{
+    qint32      type;
+    qint32      slot;               /// Baseline slot
+    qint32      dayOfWeek;          /// Baseline day of week
+    qint32      targetDay;          /// Baseline target day
+    qint32      date;               /// Interval date (julian day)
+    qint32      startMs;            /// Interval start time
+    qint32      endMs;              /// Interval end time
+    qint32      reserved;
+    double      weightSum;          /// Baseline weight
+    quint64     offset;             /// Blob offset from file start (aligned)
+    quint64     size;
+};
+
+StatisticsCache::StatisticsCache(QString fileName) :
+    m_fileName(fileName),
+    m_changed(false)
+{
+
+}
+
+StatisticsCache::~StatisticsCache()
+{
+    // Blobs can reference mapped memory
+    m_baselines.clear();
+    m_intervals.clear();
+    m_mappedFile.close();
+}
+
+ErrorCode StatisticsCache::Load()
+{
+    StatsCacheHeader    header;
+    uchar*              pData;
+    qint64              size;
+
+    m_mappedFile.setFileName(m_fileName);
+    if (!m_mappedFile.open(QIODevice::ReadOnly))
+    {
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    size = m_mappedFile.size();
+    pData = (size > (qint64)sizeof(header)) ? m_mappedFile.map(0, size) : NULL;
+
+    if (NULL == pData)
+    {
+        m_mappedFile.close();
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    memcpy(&header, pData, sizeof(header));
+
+    if ((header.magic != STATS_CACHE_MAGIC) ||
+        (header.version != STATS_CACHE_VERSION) ||
+        (header.entriesCount > STATS_CACHE_BASELINES + STATS_CACHE_INTERVALS) ||
+        ((qint64)(sizeof(header) + header.entriesCount*sizeof(StatsCacheEntry)) > size))
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "StatisticsCache", "Invalid cache file %s", m_fileName.toUtf8().constData());
+        m_mappedFile.close();
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    for (quint32 i = 0; i < header.entriesCount; i++)
+    {
+        StatsCacheEntry entry;
+
+        memcpy(&entry, pData + sizeof(header) + i*sizeof(entry), sizeof(entry));
+
+        if ((entry.offset > (quint64)size) || (entry.size > (quint64)size - entry.offset))
+        {
+            ERROR_MESSAGE1(ERR_TYPE_WARNING, "StatisticsCache", "Invalid entry in cache file %s", m_fileName.toUtf8().constData());
+            continue;
+        }
+
+        // Blobs are not copied, they are checked when statistics are attached
+        QByteArray statsData = QByteArray::fromRawData((const char*)pData + entry.offset, entry.size);
+
+        if (entry.type == STATS_CACHE_BASELINE)
+        {
+            BaselineRecord baseline;
+
+            baseline.slot = entry.slot;
+            baseline.dayOfWeek = entry.dayOfWeek;
+            baseline.targetDay = entry.targetDay;
+            baseline.weightSum = entry.weightSum;
+            baseline.statsData = statsData;
+            m_baselines.append(baseline);
+        }
+        else if (entry.type == STATS_CACHE_INTERVAL)
+        {
+            CachedInterval interval;
+
+            interval.date = QDate::fromJulianDay(entry.date);
+            interval.startTime = QTime::fromMSecsSinceStartOfDay(entry.startMs);
+            interval.endTime = QTime::fromMSecsSinceStartOfDay(entry.endMs);
+            interval.statsData = statsData;
+            m_intervals.append(interval);
+        }
+    }
+
+    ERROR_MESSAGE3(ERR_TYPE_MESSAGE, "StatisticsCache", "%d baselines and %d intervals loaded from %s",
+                   m_baselines.size(), m_intervals.size(), m_fileName.toUtf8().constData());
+
+    return CAMERA_PIPELINE_OK;
+}
+
+ErrorCode StatisticsCache::Save()
+{
+    QSaveFile           file(m_fileName);
+    StatsCacheHeader    header;
+    QByteArray          table;
+    quint64             offset;
+    int                 i;
+
+    if (!m_changed)
+    {
+        return CAMERA_PIPELINE_OK;
+    }
+
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        ERROR_MESSAGE2(ERR_TYPE_WARNING, "StatisticsCache", "Cannot write cache file %s: %s",
+                       m_fileName.toUtf8().constData(), file.errorString().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = STATS_CACHE_MAGIC;
+    header.version = STATS_CACHE_VERSION;
+    header.entriesCount = m_baselines.size() + m_intervals.size();
+
+    // Entries table
+    offset = ALIGN_UP(sizeof(header) + header.entriesCount*sizeof(StatsCacheEntry), STATS_BLOB_ALIGNMENT);
+
+    for (i = 0; i < m_baselines.size() + m_intervals.size(); i++)
+    {
+        StatsCacheEntry entry;
+
+        memset(&entry, 0, sizeof(entry));
+
+        if (i < m_baselines.size())
+        {
+            const BaselineRecord& baseline = m_baselines.at(i);
+
+            entry.type = STATS_CACHE_BASELINE;
+            entry.slot = baseline.slot;
+            entry.dayOfWeek = baseline.dayOfWeek;
+            entry.targetDay = baseline.targetDay;
+            entry.weightSum = baseline.weightSum;
+            entry.size = baseline.statsData.size();
+        }
+        else
+        {
+            const CachedInterval& interval = m_intervals.at(i - m_baselines.size());
+
+            entry.type = STATS_CACHE_INTERVAL;
+            entry.date = interval.date.toJulianDay();
+            entry.startMs = interval.startTime.msecsSinceStartOfDay();
+            entry.endMs = interval.endTime.msecsSinceStartOfDay();
+            entry.size = interval.statsData.size();
+        }
+        entry.offset = offset;
+        offset = ALIGN_UP(offset + entry.size, STATS_BLOB_ALIGNMENT);
+
+        table.append((const char*)&entry, sizeof(entry));
+    }
+
+    file.write((const char*)&header, sizeof(header));
+    file.write(table);
+
+    // Blobs (aligned, so they can be used from mapped file in place)
+    for (i = 0; i < m_baselines.size() + m_intervals.size(); i++)
+    {
+        const QByteArray& statsData = (i < m_baselines.size()) ? m_baselines.at(i).statsData :
+                                                                 m_intervals.at(i - m_baselines.size()).statsData;
+
+        file.write(QByteArray(ALIGN_UP(file.pos(), STATS_BLOB_ALIGNMENT) - file.pos(), 0));
+        file.write(statsData);
+    }
+
+    if (!file.commit())
+    {
+        ERROR_MESSAGE2(ERR_TYPE_WARNING, "StatisticsCache", "Cannot write cache file %s: %s",
+                       m_fileName.toUtf8().constData(), file.errorString().toUtf8().constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    m_changed = false;
+    return CAMERA_PIPELINE_OK;
+}
+
+void StatisticsCache::StoreBaseline(const BaselineRecord& baseline, bool replaceOnly)
+{
+    for (int i = 0; i < m_baselines.size(); i++)
+    {
+        if (m_baselines.at(i).slot == baseline.slot && m_baselines.at(i).dayOfWeek == baseline.dayOfWeek)
+        {
+            m_baselines.removeAt(i);
+            m_baselines.prepend(baseline);
+            m_changed = true;
+            return;
+        }
+    }
+
+    if (!replaceOnly)
+    {
+        m_baselines.prepend(baseline);
+        while (m_baselines.size() > STATS_CACHE_BASELINES)
+        {
+            m_baselines.removeLast();
+        }
+        m_changed = true;
+    }
+}
+
+void StatisticsCache::StoreInterval(IntervalStatistics* stats)
+{
+    CachedInterval interval;
+
+    interval.date = stats->date;
+    interval.startTime = stats->startTime;
+    interval.endTime = stats->endTime;
+    stats->ToBlob(&interval.statsData);
+
+    m_intervals.prepend(interval);
+    while (m_intervals.size() > STATS_CACHE_INTERVALS)
+    {
+        m_intervals.removeLast();
+    }
+    m_changed = true;
+}
+
+bool StatisticsCache::FindBaseline(int slot, int dayOfWeek, BaselineRecord* pBaseline)
+{
+    for (int i = 0; i < m_baselines.size(); i++)
+    {
+        if (m_baselines.at(i).slot == slot && m_baselines.at(i).dayOfWeek == dayOfWeek)
+        {
+            *pBaseline = m_baselines.at(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void StatisticsCache::FindIntervals(const QDateTime& curDateTime, int periodDays, int intervalSeconds, QList<IntervalStatistics*>& results)
+{
+    QDate   curDate = curDateTime.date();
+    int     curMs = curDateTime.time().msecsSinceStartOfDay();
+    int     rangeMs = intervalSeconds * 1100;
+
+    for (int i = 0; i < m_intervals.size(); i++)
+    {
+        const CachedInterval&   interval = m_intervals.at(i);
+        int                     startMs = interval.startTime.msecsSinceStartOfDay();
+
+        if ((interval.date < curDate.addDays(-periodDays)) || (interval.date > curDate) ||
+            (startMs < curMs - rangeMs) || (startMs > curMs + rangeMs))
+        {
+            continue;
+        }
+
+        IntervalStatistics* pStats = new IntervalStatistics;
+
+        if (CAMERA_PIPELINE_OK != pStats->Attach(interval.statsData))
+        {
+            delete pStats;
+            continue;
+        }
+
+        pStats->date = interval.date;
+        pStats->endDate = interval.date;
+        pStats->startTime = interval.startTime;
+        pStats->endTime = interval.endTime;
+        results.append(pStats);
+    }
+}
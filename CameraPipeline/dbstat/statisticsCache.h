@@ -0,0 +1,51 @@
+#ifndef STATISTICSCACHE_H
+#define STATISTICSCACHE_H
+
+#include <QList>
+#include <QFile>
+#include <QString>
+#include <QDateTime>
+#include <QByteArray>
+
+#include "analysisRecordSQliteDao.h"
+
+/*
+ * Local persistent statistics cache (one file per camera)
+ * Keeps recently used baselines and last written intervals as version 3 blobs,
+ * so decisions can be made right after restart, before statistics are read from DB.
+ * File is mapped on load and blobs are used in place; updates are written to new file
+ * which atomically replaces the old one (old mapping stays valid until cache is deleted).
+ */
+class StatisticsCache
+{
+public:
+    StatisticsCache(QString fileName);
+    ~StatisticsCache();
+
+    ErrorCode   Load();
+    ErrorCode   Save();                                         /// Write file if cache was changed
+
+    void        StoreBaseline(const BaselineRecord& baseline, bool replaceOnly = false);
+    void        StoreInterval(IntervalStatistics* stats);
+
+    bool        FindBaseline(int slot, int dayOfWeek, BaselineRecord* pBaseline);
+    /// Same selection as AnalysisRecordDao::FindStatsForPeriod() (attached statistics must be deleted by user)
+    void        FindIntervals(const QDateTime& curDateTime, int periodDays, int intervalSeconds, QList<IntervalStatistics*>& results);
+
+private:
+    struct CachedInterval
+    {
+        QDate       date;
+        QTime       startTime;
+        QTime       endTime;
+        QByteArray  statsData;
+    };
+
+    QString                 m_fileName;
+    QFile                   m_mappedFile;                   /// Loaded file (mapped while cache exists)
+    QList<BaselineRecord>   m_baselines;                    /// Most recently used first
+    QList<CachedInterval>   m_intervals;                    /// Most recent first
+    bool                    m_changed;
+};
+
+#endif // STATISTICSCACHE_H
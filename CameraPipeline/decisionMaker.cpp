@@ -1,11 +1,13 @@
 
 #include <stdio.h>
+#include <QtConcurrent/QtConcurrent>
 
 #include "decisionMaker.h"
 
 DecisionMakerBase::DecisionMakerBase() :
     QObject(NULL),
-    m_validStatPresent(0)
+    m_validStatPresent(0),
+    m_lastResultsTime(0)
 {
 
 }
@@ -21,6 +23,7 @@ bool DecisionMakerBase::ProcessAnalysisResults(AnalysisResults* pResults)
     decision.alertType = 0;
     decision.confidence = 0.0f;
     decision.timestamp = pResults->timestamp;
+    m_lastResultsTime = pResults->timestamp;
     decision.pInfoBuffer = pResults->pDiffBuffer;
     decision.objects = pResults->objects;
 
@@ -91,6 +94,29 @@ static bool IsSameWorkingDay(QDate date1, QDate date2)
     return false;
 }
 
+float DecisionMakerBase::IntervalWeight(QDate curDate, QTime curTime, QDate date, QTime startTime)
+{
+    if (curDate.dayOfWeek() == date.dayOfWeek())
+    {
+        if (startTime.secsTo(curTime) < 60)
+        {
+            // Same day and same time
+            return 3.0f;
+        }
+        // Same day, but +- 10 minutes
+        return 2.0f;
+    }
+
+    if (IsSameWorkingDay(curDate, date))
+    {
+        // Not same day, but working day (or holiday) as well
+        return 1.0f;
+    }
+
+    // Not same day, and not same working day (nor holiday)
+    return 0.0f;
+}
+
 void DecisionMakerBase::GetIntervalWeights(QList<IntervalStatistics *> statsList, float *weights)
 {
     int     i;
@@ -98,8 +124,10 @@ void DecisionMakerBase::GetIntervalWeights(QList<IntervalStatistics *> statsList
 
     DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
 
-    QDate curDate = QDateTime::currentDateTime().date();
-    QTime curTime = QDateTime::currentDateTime().time();
+    // Intervals are weighted relative to analyzed video time (it differs from clock for archive reanalysis)
+    QDateTime curDateTime = (m_lastResultsTime > 0) ? QDateTime::fromMSecsSinceEpoch(m_lastResultsTime) : QDateTime::currentDateTime();
+    QDate curDate = curDateTime.date();
+    QTime curTime = curDateTime.time();
 
     DEBUG_MESSAGE0("DecisionMakerBase", "GetIntervalWeights() called");
 
@@ -119,32 +147,7 @@ void DecisionMakerBase::GetIntervalWeights(QList<IntervalStatistics *> statsList
     {
         IntervalStatistics* pIntervalStats = statsList.at(i);
 
-        if (curDate.dayOfWeek() == pIntervalStats->date.dayOfWeek())
-        {
-            if (pIntervalStats->startTime.secsTo(curTime) < 60)
-            {
-                // Same day and same time
-                weights[i] = 3.0f;
-            }
-            else
-            {
-                // Same day, but +- 10 minutes
-                weights[i] = 2.0f;
-            }
-        }
-        else
-        {
-            if( IsSameWorkingDay(curDate, pIntervalStats->date))
-            {
-                // Not same day, but working day (or holiday) as well
-                weights[i] = 1.0f;
-            }
-            else
-            {
-                // Not same day, and not same working day (nor holiday)
-                weights[i] = 0.0f;
-            }
-        }
+        weights[i] = IntervalWeight(curDate, curTime, pIntervalStats->date, pIntervalStats->startTime);
         totalWeight += weights[i];
     }
 
@@ -204,14 +207,14 @@ void AreaDecisionMaker::ProcessStatistics(QList<IntervalStatistics *> statsList,
 
     if (statsList.size())
     {
-        m_totalAccBuffer.SetSize(statsList.at(0)->accBuffer.GetWidth(),
-                                 statsList.at(0)->accBuffer.GetHeight());
+        m_totalAccBuffer.SetSize(statsList.at(0)->AccWidth(),
+                                 statsList.at(0)->AccHeight());
 
         // Accumulate interval's heatmap
         for (i = 0; i < statsList.size(); i++)
         {
             IntervalStatistics* pIntervalStats = statsList.at(i);
-            m_totalAccBuffer.Add(&pIntervalStats->accBuffer, weights[i]);
+            pIntervalStats->AddAccumulatorTo(&m_totalAccBuffer, weights[i]);
         }
 
         // Draw collected heatmap for debug
@@ -304,21 +307,32 @@ void AreaDecisionMaker::CreateDebugImages()
     thumbFile += (DataDirectoryInstance::instance())->pipelineParams.pipelineName;
     thumbFile += "/thumb.jpg";
 
+    // Make file name corresponding to number of its 10-minute period
+    int64_t currentMsec = QDateTime::currentDateTime().time().msecsSinceStartOfDay();
+    int number = int(currentMsec / (1000 * pDataDirectory->pipelineParams.processingIntervalSec));
+
+    QString outputFile = QString("%1/heatmap_%2.png").arg(debugFolder).arg(number);
+
+    // Only accumulator is copied in processing thread, thumbnail reading, rendering and PNG encoding are done in pool
+    AccumlatorBuffer* pAccCopy = new AccumlatorBuffer;
+    pAccCopy->CopyFrom(&m_totalAccBuffer);
+
+    QtConcurrent::run(&AreaDecisionMaker::SaveDebugHeatmap, pAccCopy, thumbFile, outputFile);
+}
+
+void AreaDecisionMaker::SaveDebugHeatmap(AccumlatorBuffer* pAccBuffer, QString thumbFile, QString outputFile)
+{
     // Read thumbnail image for background
     VideoBuffer bkgr;
 
     if (CAMERA_PIPELINE_OK == bkgr.LoadFromFile(thumbFile))
     {
-        // Make file name corresponding to number of its 10-minute period
-        int64_t currentMsec = QDateTime::currentDateTime().time().msecsSinceStartOfDay();
-        int number = int(currentMsec / (1000 * pDataDirectory->pipelineParams.processingIntervalSec));
-
-        QString outputFile = QString("%1/heatmap_%2.png").arg(debugFolder).arg(number);
-
-        QImage res = StatisticDBInterface::CreateHeatmap(&bkgr, &m_totalAccBuffer);
+        QImage res = StatisticDBInterface::CreateHeatmap(&bkgr, pAccBuffer);
 
         res.save(outputFile);
     }
+
+    delete pAccBuffer;
 }
 
 ///
@@ -351,7 +365,7 @@ void MotionDecisionMaker::ProcessStatistics(QList<IntervalStatistics *> statsLis
     for (int i = 0; i < statsList.size(); i++)
     {
         IntervalStatistics* pIntervalStats = statsList.at(i);
-        m_motionMap.AddMap(&pIntervalStats->motionMap, weights[i]);
+        pIntervalStats->AddMotionMapTo(&m_motionMap, weights[i]);
     }
 
     // Draw collected motion map for debug
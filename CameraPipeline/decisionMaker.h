@@ -18,8 +18,12 @@ public:
     void    ProcessStats(QList<IntervalStatistics*> curStatsList);
     bool    ProcessAnalysisResults(AnalysisResults* pResults);
 
+    /// Weight of interval with given start for decision at current date and time (not normalized)
+    static float IntervalWeight(QDate curDate, QTime curTime, QDate date, QTime startTime);
+
 private:
     int     m_validStatPresent;   /// Indicates, that we have good period statistics and can process new frames
+    int64_t m_lastResultsTime;    /// Timestamp of the last analyzed frame (media time for archive reanalysis)
 
     /// Weight of given statistic interval
     void GetIntervalWeights(QList<IntervalStatistics *> statsList, float* weights);
@@ -51,6 +55,9 @@ private:
 
     /// Output debug images to hardcoded folder
     void  CreateDebugImages();
+
+    /// Render and save heatmap (in thread pool, accumulator copy is deleted)
+    static void SaveDebugHeatmap(AccumlatorBuffer* pAccBuffer, QString thumbFile, QString outputFile);
 };
 
 
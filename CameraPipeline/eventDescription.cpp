@@ -15,6 +15,13 @@ QVariantMap EventDescription::toVariant()
     toReturn.insert("archiveEndHint"  , archiveFileName2);
     toReturn.insert("file_offset_sec"  , offset);
 
+    if (clipOffsetMs >= 0)
+    {
+        toReturn.insert("clip_file", clipFileName);
+        toReturn.insert("clip_offset_ms", clipOffsetMs);
+        toReturn.insert("clip_byte_offset", clipByteOffset);
+    }
+
     if (isActive)
     {
         toReturn.insert("isStarted", true);
@@ -23,7 +23,10 @@ public:
         reaction(REACTION_UNSET),
         archiveFileName1("empty"),
         archiveFileName2("empty"),
-        offset(0)
+        offset(0),
+        archiveStartTime(0),
+        clipOffsetMs(-1),
+        clipByteOffset(-1)
     { }
 
     int                         id;
@@ -38,6 +41,12 @@ public:
     QString                     archiveFileName2;   /// Archive file, where event finished
     qlonglong                   offset;
 
+    // Event clip reference inside archive (filled by StreamRecorder)
+    QString                     clipFileName;       /// Archive file with keyframe before event start
+    qlonglong                   archiveStartTime;   /// Server time of archive file start (ms, 0 if unknown)
+    qlonglong                   clipOffsetMs;       /// Keyframe time from archive file start (-1 if unknown)
+    qlonglong                   clipByteOffset;     /// Keyframe fragment offset in archive file (-1 if unknown)
+
     QVariantMap toVariant();
 };
 
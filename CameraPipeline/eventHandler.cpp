@@ -29,6 +29,7 @@ EventHandler::EventHandler() :
 EventHandler::~EventHandler()
 {
     DEBUG_MESSAGE0("EventHandler", "~EventHandler() called");
+    qDeleteAll(m_nextStatsList);
     SAFE_DELETE(pAreaEventHandler);
     SAFE_DELETE(pMotionEventHandler);
     SAFE_DELETE(pCalibEventHandler);
@@ -39,9 +40,6 @@ void EventHandler::ProcessAnalysisResults(VideoFrame *pCurrentFrame, AnalysisRes
 {
     DEBUG_MESSAGE0("EventHandler", "ProcessAnalysisResults() started");
 
-    // Make a frame copy because we should not draw on input frames
-    m_outputFrame.CopyFromVideoFrame(pCurrentFrame);
-
     // Check for calibration errors
     pCalibEventHandler->ProcessResults(pResults);
 
@@ -52,8 +50,69 @@ void EventHandler::ProcessAnalysisResults(VideoFrame *pCurrentFrame, AnalysisRes
     pMotionEventHandler->ProcessResults(pResults);
 
     DEBUG_MESSAGE0("EventHandler", "ProcessAnalysisResults() finished. Emitting signal");
-    // Send marked frame to encoder
-    emit ResultsProcessed(&m_outputFrame);
+    // Send detection results as timed metadata (video itself is passed through without changes)
+    if (receivers(SIGNAL(MetadataReady(double, QJsonObject))) > 0)
+    {
+        emit MetadataReady(pCurrentFrame->presentationTimeInSeconds, CreateMetadata(pCurrentFrame, pResults));
+    }
+}
+
+QJsonObject EventHandler::CreateMetadata(VideoFrame* pFrame, AnalysisResults* pResults)
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    QJsonObject     metadata;
+    QJsonArray      objects;
+    QJsonArray      alerts;
+
+    // Objects are detected on downscaled frame (the same size as in VideoAnalyzer::ProcessFrame)
+    int     scaledWidth  = (int)(pFrame->GetWidth() * pDataDirectory->analysisParams.downscaleCoeff + 0.5f) & 0xFFFFFFFE;
+    int     scaledHeight = (int)(pFrame->GetHeight() * pDataDirectory->analysisParams.downscaleCoeff + 0.5f) & 0xFFFFFFFE;
+    double  scaleX = (scaledWidth > 0) ? (double)pFrame->GetWidth() / scaledWidth : 1.0;
+    double  scaleY = (scaledHeight > 0) ? (double)pFrame->GetHeight() / scaledHeight : 1.0;
+
+    // Motion decision maker marks objects with invalid motion
+    const DecisionResults& motionDecision = pMotionEventHandler->Decision();
+    bool    motionChecked = (motionDecision.timestamp == pResults->timestamp) &&
+                            (motionDecision.objects.size() == pResults->objects.size());
+
+    for (int k = 0; k < pResults->objects.size(); k++)
+    {
+        const DetectedObject&   object = pResults->objects[k];
+        QJsonObject             jsonObject;
+
+        jsonObject["id"]    = object.id;
+        jsonObject["x"]     = qRound(object.coordX * scaleX);
+        jsonObject["y"]     = qRound(object.coordY * scaleY);
+        jsonObject["w"]     = qRound(object.sizeX * scaleX);
+        jsonObject["h"]     = qRound(object.sizeY * scaleY);
+        jsonObject["alert"] = motionChecked && !motionDecision.objects[k].isValid;
+        objects.append(jsonObject);
+    }
+
+    SingleEventHandlerBase* handlers[3] = { pCalibEventHandler, pAreaEventHandler, pMotionEventHandler };
+
+    for (int i = 0; i < 3; i++)
+    {
+        const DecisionResults& decision = handlers[i]->Decision();
+
+        // Decision could be skipped for current frame (no valid statistics)
+        if (decision.timestamp == pResults->timestamp && decision.alertType > 0 && decision.alertType < 20)
+        {
+            QJsonObject alert;
+
+            alert["type"]       = EvenTypeStr[decision.alertType];
+            alert["confidence"] = decision.confidence;
+            alerts.append(alert);
+        }
+    }
+
+    metadata["timestamp"] = (double)pResults->timestamp;
+    metadata["width"]     = pFrame->GetWidth();
+    metadata["height"]    = pFrame->GetHeight();
+    metadata["objects"]   = objects;
+    metadata["alerts"]    = alerts;
+
+    return metadata;
 }
 
 void EventHandler::ProcessIntervalStats(QList<IntervalStatistics *> curStatsList)
@@ -64,6 +123,47 @@ void EventHandler::ProcessIntervalStats(QList<IntervalStatistics *> curStatsList
     pCalibEventHandler->ProcessStats(curStatsList);
 }
 
+void EventHandler::SetNextIntervalStats(QDateTime startTime, QList<IntervalStatistics*> nextStatsList)
+{
+    DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
+
+    DEBUG_MESSAGE1("EventHandler", "Statistics for %s prefetched", startTime.toString("HH:mm:ss").toUtf8().constData());
+
+    // Older prefetch is overtaken by this one
+    qDeleteAll(m_nextStatsList);
+    m_nextStatsList.clear();
+
+    // Prefetch was finished after interval boundary - apply it right now
+    if (m_intervalStartTime.isValid() &&
+        (qAbs(m_intervalStartTime.secsTo(startTime)) < pDataDirectory->pipelineParams.processingIntervalSec / 2))
+    {
+        ProcessIntervalStats(nextStatsList);
+        qDeleteAll(nextStatsList);
+        return;
+    }
+
+    m_nextStatsTime = startTime;
+    m_nextStatsList = nextStatsList;
+}
+
+void EventHandler::IntervalStarted(QDateTime startTime)
+{
+    DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
+
+    m_intervalStartTime = startTime;
+
+    // Prefetched statistics are valid only for the interval they were requested for
+    if (!m_nextStatsList.isEmpty() &&
+        (qAbs(m_nextStatsTime.secsTo(startTime)) < pDataDirectory->pipelineParams.processingIntervalSec / 2))
+    {
+        ProcessIntervalStats(m_nextStatsList);
+    }
+
+    // Decision makers do not keep statistics, so prefetched ones are not needed any more
+    qDeleteAll(m_nextStatsList);
+    m_nextStatsList.clear();
+}
+
 void EventHandler::SecurityReaction(EventDescription event)
 {
     ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "EventHandler",
@@ -2,6 +2,8 @@
 #define EVENTHANDLER_H
 
 #include <QObject>
+#include <QJsonArray>
+#include <QJsonObject>
 
 #include "decisionMaker.h"
 #include "eventDescription.h"
@@ -23,6 +25,8 @@ public:
 
     virtual void ProcessResults(AnalysisResults* pResults);
 
+    const DecisionResults& Decision() { return m_pDecisionMaker->decision; }   /// Last frame decision
+
     void ProcessStats(QList<IntervalStatistics*> curStatsList) { m_pDecisionMaker->ProcessStats(curStatsList); }
     void SecurityReaction(EventDescription event);
 
@@ -106,7 +110,7 @@ public:
     CalibEventHandler*      pCalibEventHandler;
 
 signals:
-    void    ResultsProcessed(VideoFrame* pFrame);
+    void    MetadataReady(double frameTime, QJsonObject metadata);  /// Detections for frame with given presentation time
     void    EventStarted(EventDescription eventDescription);
     void    EventFinished(EventDescription eventDescription);
     void    NeedWriteEventFile(int64_t startTime, QString fileName);
@@ -115,6 +119,8 @@ signals:
 public slots:
     void    ProcessAnalysisResults(VideoFrame* pCurrentFrame, AnalysisResults* pResults);
     void    ProcessIntervalStats(QList<IntervalStatistics*> curStatsList);
+    void    SetNextIntervalStats(QDateTime startTime, QList<IntervalStatistics*> nextStatsList);  /// Prefetched statistics for next interval (taken over)
+    void    IntervalStarted(QDateTime startTime);          /// Apply prefetched statistics at interval boundary
     void    SecurityReaction(EventDescription eventDescription);
     void    NewArchiveFileName(QString newFileName);    /// Receive file name from StreamRecorder
     void    OpenEvent(EventDescription* event);
@@ -125,10 +131,11 @@ private slots:
 
 private:
     int                         m_continiousEventId;    /// Events should have continious numeration in DB
+    QDateTime                   m_intervalStartTime;    /// Start of current statistics interval
+    QDateTime                   m_nextStatsTime;        /// Start of interval for prefetched statistics
+    QList<IntervalStatistics*>  m_nextStatsList;        /// Prefetched statistics (owned, deleted after use or when overtaken)
 
-    VideoFrame                  m_outputFrame;          /// Copy of frame to draw results and send it to output
-
-    void  DrawRedPoint(VideoFrame* pFrame);             /// Draw red point indicator on output frames
+    QJsonObject CreateMetadata(VideoFrame* pFrame, AnalysisResults* pResults);   /// Objects and alerts description
 };
 
 #endif // EVENTHANDLER_H
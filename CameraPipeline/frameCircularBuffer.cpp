@@ -10,6 +10,7 @@ FrameCircularBuffer::FrameCircularBuffer(int size) : QObject(NULL)
     m_totalWritten = 0;
     m_totalRead = 0;
     m_firstFrameTime = -1.0;
+    m_useMediaTime = false;
 }
 
 FrameCircularBuffer::~FrameCircularBuffer()
@@ -55,8 +56,8 @@ void FrameCircularBuffer::GetFrame(VideoFrame** pCurrentFrame)
     if (numFramesInBuf > 0)
     {
         *pCurrentFrame  = (m_pFrameBuffer + m_readIndex);
-        // Set user timestamp to current msec from epoch
-        (*pCurrentFrame)->userTimestamp = currentMsec;
+        // Set user timestamp to current msec from epoch (or to frame time for archive processing)
+        (*pCurrentFrame)->userTimestamp = m_useMediaTime ? (int64_t)((*pCurrentFrame)->nativeTimeInSeconds * 1000) : currentMsec;
 
         m_readIndex = (m_readIndex + 1) % m_size;
         m_totalRead++;
@@ -82,7 +83,7 @@ void FrameCircularBuffer::GetFrame(VideoFrame** pCurrentFrame)
     m_mutex.unlock();
 }
 
-void FrameCircularBuffer::AddFrame(AVFrame* pNewFrame, double time)
+void FrameCircularBuffer::AddFrame(AVFrame* pNewFrame, double time, double presentationTime)
 {
     DEBUG_MESSAGE0("FrameCircularBuffer", "AddFrame() called");
 
@@ -90,6 +91,7 @@ void FrameCircularBuffer::AddFrame(AVFrame* pNewFrame, double time)
     m_mutex.lock();
     m_pFrameBuffer[m_writeIndex].CopyFromAVFrame(pNewFrame);
     m_pFrameBuffer[m_writeIndex].nativeTimeInSeconds = time;
+    m_pFrameBuffer[m_writeIndex].presentationTimeInSeconds = presentationTime;
     m_pFrameBuffer[m_writeIndex].number = m_totalWritten;
     // Move to next position
     m_writeIndex = (m_writeIndex + 1) % m_size;
@@ -18,7 +18,8 @@ public:
     ~FrameCircularBuffer();
 
     void    GetFrame(VideoFrame** pFrame);
-    void    AddFrame(AVFrame* pNewFrame, double time);
+    void    AddFrame(AVFrame* pNewFrame, double time, double presentationTime);
+    void    SetUseMediaTime(bool on) { m_useMediaTime = on; }  /// Timestamp frames with their native time instead of clock
 
 signals:
     void    FrameAdded();
@@ -30,6 +31,7 @@ private:
     unsigned int m_totalWritten;    /// How many frames already written
     unsigned int m_totalRead;       /// How many frames has been read
     double       m_firstFrameTime;  /// Native timestamp of first frame (in seconds)
+    bool         m_useMediaTime;    /// Native time is absolute (seconds since epoch) and used as user timestamp
 
     VideoFrame*  m_pFrameBuffer;    /// Buffer with allocated frames
     QMutex       m_mutex;
@@ -4,10 +4,12 @@
 #include "errorHandler.h"
 #include "pipelineConfig.h"
 #include "cameraPipelineCommon.h"
+#include "pipelineMetrics.h"
 
 HealthChecker::HealthChecker(QObject *parent) :
     QObject(parent),
-    m_pCheckTimer(NULL)
+    m_pCheckTimer(NULL),
+    m_lastMetricsLog(0)
 {
 
 }
@@ -80,6 +82,18 @@ void HealthChecker::CheckHealth()
             emit TimeoutDetected(pEntry->message);
         }
     }
+
+    // Dump pipeline metrics
+    if ((currentTime - m_lastMetricsLog) > METRICS_LOG_INTERVAL_SEC * 1000)
+    {
+        QByteArray metrics = PipelineMetrics::instance()->ToText();
+
+        m_lastMetricsLog = currentTime;
+        if (!metrics.isEmpty())
+        {
+            ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "HealthChecker", "Pipeline metrics:\n%s", metrics.constData());
+        }
+    }
 }
 
 void HealthChecker::CheckStartPipelineTimeout()
@@ -31,6 +31,7 @@ private slots:
 
 private:
     QTimer*     m_pCheckTimer;
+    int64_t     m_lastMetricsLog;                   /// When metrics were dumped to log last time
 
     class HealthCheckEntry
     {
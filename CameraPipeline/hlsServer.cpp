@@ -0,0 +1,484 @@
+#include <math.h>
+#include <algorithm>
+#include <QDateTime>
+#include <QRegularExpression>
+
+#include "hlsServer.h"
+#include "errorHandler.h"
+
+HlsServer::HlsServer(QString address, int port, int partDurationMs, QObject* parent) :
+    QObject(parent),
+    m_partTarget(partDurationMs / 1000.0),
+    m_maxPartDuration(0.0),
+    m_nextSequence(0)
+{
+    QHostAddress hostAddress(address);
+
+    m_pTcpServer = new QTcpServer(this);
+    connect(m_pTcpServer, SIGNAL(newConnection()), this, SLOT(OnConnected()));
+
+    if (hostAddress.isNull())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "HlsServer", "Invalid address %s, listening on localhost",
+                       address.toUtf8().constData());
+        hostAddress = QHostAddress::LocalHost;
+    }
+
+    if (m_pTcpServer->listen(hostAddress, port))
+    {
+        ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "HlsServer", "HLS server listening on %s:%d",
+                       hostAddress.toString().toUtf8().constData(), port);
+    }
+    else
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "HlsServer", "Failed to run HLS server on port %d", port);
+    }
+
+    // Blocked requests are checked for timeout regulary
+    m_pPendingTimer = new QTimer(this);
+    m_pPendingTimer->setInterval(500);
+    connect(m_pPendingTimer, SIGNAL(timeout()), this, SLOT(CheckPendingRequests()));
+    m_pPendingTimer->start();
+}
+
+HlsServer::~HlsServer()
+{
+    DEBUG_MESSAGE0("HlsServer", "~HlsServer() called");
+    m_pPendingTimer->stop();
+    m_pTcpServer->close();
+    DEBUG_MESSAGE0("HlsServer", "~HlsServer() finished");
+}
+
+void HlsServer::SetInitSegment(const QByteArray& initSegment)
+{
+    m_initSegment = initSegment;
+}
+
+void HlsServer::AddPart(const QByteArray& data, double duration, bool independent)
+{
+    HlsPart part;
+
+    part.data = data;
+    part.duration = duration;
+    part.independent = independent;
+
+    // Each segment starts with independent (keyframe) part
+    if (independent && (m_segments.isEmpty() || !m_segments.last().parts.isEmpty()))
+    {
+        if (!m_segments.isEmpty())
+        {
+            m_segments.last().complete = true;
+        }
+
+        HlsSegment segment;
+        segment.sequence = m_nextSequence++;
+        segment.duration = 0.0;
+        segment.complete = false;
+        m_segments.append(segment);
+
+        while (m_segments.size() > HLS_SEGMENTS_TO_KEEP + 1)
+        {
+            m_segments.removeFirst();
+        }
+    }
+
+    // Waiting for the first keyframe
+    if (m_segments.isEmpty())
+    {
+        return;
+    }
+
+    m_segments.last().parts.append(part);
+    m_segments.last().duration += duration;
+    m_maxPartDuration = std::max(m_maxPartDuration, duration);
+
+    // Some of blocked requests can be served now
+    ServePending(false);
+}
+
+void HlsServer::OnConnected()
+{
+    while (m_pTcpServer->hasPendingConnections())
+    {
+        QTcpSocket* pSocket = m_pTcpServer->nextPendingConnection();
+
+        m_inputBuffers.insert(pSocket, QByteArray());
+        connect(pSocket, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+        connect(pSocket, SIGNAL(disconnected()), this, SLOT(OnDisconnected()));
+    }
+}
+
+void HlsServer::OnDisconnected()
+{
+    QTcpSocket* pSocket = qobject_cast<QTcpSocket *>(sender());
+
+    if (NULL == pSocket)
+    {
+        return;
+    }
+
+    for (int i = m_pending.size() - 1; i >= 0; i--)
+    {
+        if (m_pending[i].pSocket == pSocket)
+        {
+            m_pending.removeAt(i);
+        }
+    }
+    m_inputBuffers.remove(pSocket);
+    pSocket->deleteLater();
+}
+
+void HlsServer::OnReadyRead()
+{
+    QTcpSocket* pSocket = qobject_cast<QTcpSocket *>(sender());
+
+    if (NULL == pSocket || !m_inputBuffers.contains(pSocket))
+    {
+        return;
+    }
+
+    m_inputBuffers[pSocket].append(pSocket->readAll());
+
+    // Requests are processed one by one, next one only after previous is answered
+    while (!IsPending(pSocket) && pSocket->state() == QAbstractSocket::ConnectedState)
+    {
+        HttpRequest request;
+        QByteArray& input = m_inputBuffers[pSocket];
+        int         consumed = request.Parse(input);
+
+        if (consumed == 0)
+        {
+            break;
+        }
+
+        if (consumed < 0)
+        {
+            SendResponse(pSocket, 400, "text/plain", QByteArray("Bad request"), false, false);
+            break;
+        }
+
+        input.remove(0, consumed);
+        ProcessRequest(pSocket, request);
+    }
+}
+
+void HlsServer::ProcessRequest(QTcpSocket* pSocket, const HttpRequest& request)
+{
+    static const QRegularExpression segmentRe("^/seg(\\d+)\\.m4s$");
+    static const QRegularExpression partRe("^/seg(\\d+)\\.(\\d+)\\.m4s$");
+
+    bool keepAlive = request.KeepAlive();
+
+    if (request.method != "GET")
+    {
+        SendResponse(pSocket, 405, "text/plain", QByteArray("Method not allowed"), false, false);
+        return;
+    }
+
+    if (m_initSegment.isEmpty() || m_segments.isEmpty())
+    {
+        SendResponse(pSocket, 503, "text/plain", QByteArray("Stream is not ready yet"), keepAlive, false);
+        return;
+    }
+
+    if (request.path == "/init.mp4")
+    {
+        SendResponse(pSocket, 200, "video/mp4", m_initSegment, keepAlive, true);
+        return;
+    }
+
+    if (request.path == "/live.m3u8")
+    {
+        PendingRequest pending;
+
+        pending.pSocket = pSocket;
+        pending.type = PENDING_PLAYLIST;
+        pending.sequence = request.query.queryItemValue("_HLS_msn").toLongLong();
+        pending.part = request.query.hasQueryItem("_HLS_part") ? request.query.queryItemValue("_HLS_part").toInt() : -1;
+        pending.keepAlive = keepAlive;
+        pending.deadline = QDateTime::currentMSecsSinceEpoch() + HLS_BLOCKING_TIMEOUT_MS;
+
+        // Blocking playlist reload
+        if (request.query.hasQueryItem("_HLS_msn") && !IsPartAvailable(pending.sequence, pending.part))
+        {
+            m_pending.append(pending);
+            return;
+        }
+
+        SendResponse(pSocket, 200, "application/vnd.apple.mpegurl", CreatePlaylist(), keepAlive, false);
+        return;
+    }
+
+    QRegularExpressionMatch match = partRe.match(request.path);
+    if (match.hasMatch())
+    {
+        int64_t     sequence = match.captured(1).toLongLong();
+        int         part = match.captured(2).toInt();
+        HlsSegment* pSegment = FindSegment(sequence);
+
+        if (NULL != pSegment && part < pSegment->parts.size())
+        {
+            SendResponse(pSocket, 200, "video/mp4", pSegment->parts[part].data, keepAlive, true);
+            return;
+        }
+
+        // Part announced in preload hint will be sent as soon as it is ready
+        if (sequence >= m_segments.last().sequence && sequence <= m_nextSequence)
+        {
+            PendingRequest pending;
+
+            pending.pSocket = pSocket;
+            pending.type = PENDING_PART;
+            pending.sequence = sequence;
+            pending.part = part;
+            pending.keepAlive = keepAlive;
+            pending.deadline = QDateTime::currentMSecsSinceEpoch() + HLS_BLOCKING_TIMEOUT_MS;
+            m_pending.append(pending);
+            return;
+        }
+
+        SendResponse(pSocket, 404, "text/plain", QByteArray("Part not found"), keepAlive, false);
+        return;
+    }
+
+    match = segmentRe.match(request.path);
+    if (match.hasMatch())
+    {
+        int64_t     sequence = match.captured(1).toLongLong();
+        HlsSegment* pSegment = FindSegment(sequence);
+
+        if (NULL != pSegment && pSegment->complete)
+        {
+            QByteArray extraHeaders = "Cache-Control: max-age=60\r\n";
+            qint64     size = 0;
+
+            Q_FOREACH (const HlsPart& part, pSegment->parts)
+            {
+                size += part.data.size();
+            }
+
+            // Parts are written one by one to avoid segment data concatenation
+            pSocket->write(HttpRequest::ResponseHeader(200, "video/mp4", size, keepAlive, extraHeaders));
+            Q_FOREACH (const HlsPart& part, pSegment->parts)
+            {
+                pSocket->write(part.data);
+            }
+            FinishRequest(pSocket, keepAlive);
+            return;
+        }
+
+        // Segment in progress (or the next one) - partial data would look like whole segment if stream stalls
+        if (sequence >= m_segments.last().sequence && sequence <= m_nextSequence)
+        {
+            QByteArray body("Segment is not complete yet");
+            QByteArray extraHeaders = "Cache-Control: no-cache\r\nRetry-After: " +
+                                      QByteArray::number(RetryAfterSec(sequence)) + "\r\n";
+
+            pSocket->write(HttpRequest::ResponseHeader(503, "text/plain", body.size(), keepAlive, extraHeaders));
+            pSocket->write(body);
+            FinishRequest(pSocket, keepAlive);
+            return;
+        }
+
+        SendResponse(pSocket, 404, "text/plain", QByteArray("Segment not found"), keepAlive, false);
+        return;
+    }
+
+    SendResponse(pSocket, 404, "text/plain", QByteArray("Not found"), keepAlive, false);
+}
+
+void HlsServer::CheckPendingRequests()
+{
+    ServePending(true);
+}
+
+void HlsServer::ServePending(bool timeout)
+{
+    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+
+    for (int i = 0; i < m_pending.size(); i++)
+    {
+        PendingRequest& pending = m_pending[i];
+        bool            expired = timeout && (currentTime > pending.deadline);
+        bool            finished = false;
+
+        switch (pending.type)
+        {
+            case PENDING_PLAYLIST:
+                if (expired || IsPartAvailable(pending.sequence, pending.part))
+                {
+                    SendResponse(pending.pSocket, 200, "application/vnd.apple.mpegurl",
+                                 CreatePlaylist(), pending.keepAlive, false);
+                    finished = true;
+                }
+                break;
+
+            case PENDING_PART:
+            {
+                HlsSegment* pSegment = FindSegment(pending.sequence);
+
+                if (NULL != pSegment && pending.part < pSegment->parts.size())
+                {
+                    SendResponse(pending.pSocket, 200, "video/mp4",
+                                 pSegment->parts[pending.part].data, pending.keepAlive, true);
+                    finished = true;
+                }
+                else if (expired || (NULL != pSegment && pSegment->complete))
+                {
+                    SendResponse(pending.pSocket, 404, "text/plain",
+                                 QByteArray("Part not found"), pending.keepAlive, false);
+                    finished = true;
+                }
+                break;
+            }
+        }
+
+        if (finished)
+        {
+            QTcpSocket* pSocket = pending.pSocket;
+
+            m_pending.removeAt(i--);
+
+            // Continue with pipelined requests from this client (if any)
+            if (m_inputBuffers.contains(pSocket) && !m_inputBuffers[pSocket].isEmpty())
+            {
+                QMetaObject::invokeMethod(pSocket, "readyRead", Qt::QueuedConnection);
+            }
+        }
+    }
+}
+
+void HlsServer::SendResponse(QTcpSocket* pSocket, int code, const char* contentType,
+                             const QByteArray& body, bool keepAlive, bool cacheable)
+{
+    QByteArray extraHeaders = cacheable ? "Cache-Control: max-age=60\r\n" : "Cache-Control: no-cache\r\n";
+
+    pSocket->write(HttpRequest::ResponseHeader(code, contentType, body.size(), keepAlive, extraHeaders));
+    pSocket->write(body);
+    FinishRequest(pSocket, keepAlive);
+}
+
+
+void HlsServer::FinishRequest(QTcpSocket* pSocket, bool keepAlive)
+{
+    if (!keepAlive)
+    {
+        pSocket->disconnectFromHost();
+    }
+}
+
+bool HlsServer::IsPending(QTcpSocket* pSocket)
+{
+    Q_FOREACH (const PendingRequest& pending, m_pending)
+    {
+        if (pending.pSocket == pSocket)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+HlsServer::HlsSegment* HlsServer::FindSegment(int64_t sequence)
+{
+    for (int i = 0; i < m_segments.size(); i++)
+    {
+        if (m_segments[i].sequence == sequence)
+        {
+            return &m_segments[i];
+        }
+    }
+    return NULL;
+}
+
+bool HlsServer::IsPartAvailable(int64_t sequence, int part)
+{
+    HlsSegment* pSegment = FindSegment(sequence);
+
+    // Segment is complete or already gone (newer one is started), request is answered at once
+    if (m_segments.isEmpty() || sequence < m_segments.last().sequence)
+    {
+        return true;
+    }
+
+    if (NULL == pSegment)
+    {
+        return false;
+    }
+
+    // Without part index - whole segment is required
+    return (part < 0) ? pSegment->complete : (part < pSegment->parts.size());
+}
+
+double HlsServer::TargetDuration()
+{
+    double targetDuration = 1.0;
+
+    Q_FOREACH (const HlsSegment& segment, m_segments)
+    {
+        if (segment.complete)
+        {
+            targetDuration = std::max(targetDuration, segment.duration);
+        }
+    }
+    return targetDuration;
+}
+
+int HlsServer::RetryAfterSec(int64_t sequence)
+{
+    double  targetDuration = TargetDuration();
+    double  remaining = std::max(0.0, targetDuration - m_segments.last().duration);
+
+    // Next segment is started only after the current one
+    if (sequence > m_segments.last().sequence)
+    {
+        remaining += targetDuration;
+    }
+    return std::max(1, (int)ceil(remaining));
+}
+
+QByteArray HlsServer::CreatePlaylist()
+{
+    QByteArray  playlist;
+    double      targetDuration = TargetDuration();
+    double      partTarget = std::max(m_partTarget, m_maxPartDuration);
+
+    playlist += "#EXTM3U\n";
+    playlist += "#EXT-X-VERSION:9\n";
+    playlist += "#EXT-X-TARGETDURATION:" + QByteArray::number((int)ceil(targetDuration)) + "\n";
+    playlist += "#EXT-X-PART-INF:PART-TARGET=" + QByteArray::number(partTarget, 'f', 3) + "\n";
+    playlist += "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=" + QByteArray::number(3.0 * partTarget, 'f', 3) + "\n";
+    playlist += "#EXT-X-MEDIA-SEQUENCE:" + QByteArray::number((qlonglong)m_segments.first().sequence) + "\n";
+    playlist += "#EXT-X-INDEPENDENT-SEGMENTS\n";
+    playlist += "#EXT-X-MAP:URI=\"init.mp4\"\n";
+
+    for (int i = 0; i < m_segments.size(); i++)
+    {
+        const HlsSegment& segment = m_segments[i];
+        QByteArray        name = "seg" + QByteArray::number((qlonglong)segment.sequence);
+
+        // Parts are listed only for the last segments (required for low latency playback)
+        if (i >= m_segments.size() - 1 - HLS_SEGMENTS_WITH_PARTS)
+        {
+            for (int p = 0; p < segment.parts.size(); p++)
+            {
+                playlist += "#EXT-X-PART:DURATION=" + QByteArray::number(segment.parts[p].duration, 'f', 3);
+                playlist += ",URI=\"" + name + "." + QByteArray::number(p) + ".m4s\"";
+                playlist += segment.parts[p].independent ? ",INDEPENDENT=YES\n" : "\n";
+            }
+        }
+
+        if (segment.complete)
+        {
+            playlist += "#EXTINF:" + QByteArray::number(segment.duration, 'f', 3) + ",\n";
+            playlist += name + ".m4s\n";
+        }
+    }
+
+    // Next expected part
+    const HlsSegment& last = m_segments.last();
+    playlist += "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"seg" + QByteArray::number((qlonglong)last.sequence) +
+                "." + QByteArray::number(last.parts.size()) + ".m4s\"\n";
+
+    return playlist;
+}
@@ -0,0 +1,101 @@
+#ifndef HLSSERVER_H
+#define HLSSERVER_H
+
+#include <QMap>
+#include <QList>
+#include <QTimer>
+#include <QObject>
+#include <QByteArray>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "networkUtils/httpRequest.h"
+
+#define  HLS_SEGMENTS_TO_KEEP       6       // Complete segments kept in memory and listed in playlist
+#define  HLS_SEGMENTS_WITH_PARTS    2       // Number of last complete segments listed with their parts
+#define  HLS_BLOCKING_TIMEOUT_MS    6000    // Maximum time to hold blocking playlist and part requests
+
+/*
+ * Local HTTP server for low-latency HLS (CMAF) output
+ * Receives ready fMP4 fragments from ResultVideoOutput, groups them in parts and segments,
+ * and serves playlist, init segment, parts and segments from memory.
+ * Segment is served only when it is complete (503 with Retry-After while it is written),
+ * so truncated segment is never sent as a whole one; low latency clients load its parts.
+ */
+class HlsServer : public QObject
+{
+    Q_OBJECT
+public:
+    HlsServer(QString address, int port, int partDurationMs, QObject* parent = NULL);
+    ~HlsServer();
+
+    bool    IsListening() { return m_pTcpServer->isListening(); }
+
+    void    SetInitSegment(const QByteArray& initSegment);              /// ftyp + moov
+    void    AddPart(const QByteArray& data, double duration, bool independent);  /// moof + mdat
+
+private slots:
+    void    OnConnected();
+    void    OnReadyRead();
+    void    OnDisconnected();
+    void    CheckPendingRequests();                                     /// Timeouts for blocked requests
+
+private:
+    struct HlsPart
+    {
+        QByteArray  data;
+        double      duration;
+        bool        independent;
+    };
+
+    struct HlsSegment
+    {
+        int64_t         sequence;
+        double          duration;
+        bool            complete;
+        QList<HlsPart>  parts;
+    };
+
+    enum PendingType
+    {
+        PENDING_PLAYLIST,       /// Blocking playlist reload (_HLS_msn, _HLS_part)
+        PENDING_PART            /// Part from preload hint
+    };
+
+    struct PendingRequest
+    {
+        QTcpSocket*     pSocket;
+        PendingType     type;
+        int64_t         sequence;
+        int             part;           /// Part index (-1 for whole segment)
+        bool            keepAlive;
+        qint64          deadline;
+    };
+
+    QTcpServer*                     m_pTcpServer;
+    QTimer*                         m_pPendingTimer;
+    double                          m_partTarget;       /// Part target duration (seconds)
+    double                          m_maxPartDuration;  /// Longest part received (can exceed target)
+
+    QByteArray                      m_initSegment;
+    QList<HlsSegment>               m_segments;         /// Last segment can be incomplete
+    int64_t                         m_nextSequence;
+
+    QMap<QTcpSocket*, QByteArray>   m_inputBuffers;     /// Incoming request data for each client
+    QList<PendingRequest>           m_pending;
+
+    void        ProcessRequest(QTcpSocket* pSocket, const HttpRequest& request);
+    void        SendResponse(QTcpSocket* pSocket, int code, const char* contentType,
+                             const QByteArray& body, bool keepAlive, bool cacheable);
+    void        FinishRequest(QTcpSocket* pSocket, bool keepAlive);
+
+    QByteArray  CreatePlaylist();
+    double      TargetDuration();                                       /// Longest complete segment (at least 1 second)
+    int         RetryAfterSec(int64_t sequence);                        /// Expected time until segment is complete
+    HlsSegment* FindSegment(int64_t sequence);
+    bool        IsPartAvailable(int64_t sequence, int part);
+    bool        IsPending(QTcpSocket* pSocket);
+    void        ServePending(bool timeout);
+};
+
+#endif // HLSSERVER_H
@@ -0,0 +1,108 @@
+#include "metricsServer.h"
+#include "errorHandler.h"
+#include "pipelineMetrics.h"
+
+MetricsServer::MetricsServer(QString address, int port, QObject* parent) :
+    QObject(parent)
+{
+    QHostAddress hostAddress(address);
+
+    m_pTcpServer = new QTcpServer(this);
+    connect(m_pTcpServer, SIGNAL(newConnection()), this, SLOT(OnConnected()));
+
+    if (hostAddress.isNull())
+    {
+        ERROR_MESSAGE1(ERR_TYPE_WARNING, "MetricsServer", "Invalid address %s, listening on localhost",
+                       address.toUtf8().constData());
+        hostAddress = QHostAddress::LocalHost;
+    }
+
+    if (m_pTcpServer->listen(hostAddress, port))
+    {
+        ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "MetricsServer", "Metrics are served on %s:%d",
+                       hostAddress.toString().toUtf8().constData(), port);
+    }
+    else
+    {
+        ERROR_MESSAGE2(ERR_TYPE_ERROR, "MetricsServer", "Failed to listen on port %d: %s",
+                       port, m_pTcpServer->errorString().toUtf8().constData());
+    }
+}
+
+MetricsServer::~MetricsServer()
+{
+    m_pTcpServer->close();
+}
+
+void MetricsServer::OnConnected()
+{
+    while (m_pTcpServer->hasPendingConnections())
+    {
+        QTcpSocket* pSocket = m_pTcpServer->nextPendingConnection();
+
+        m_inputBuffers.insert(pSocket, QByteArray());
+        connect(pSocket, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+        connect(pSocket, SIGNAL(disconnected()), this, SLOT(OnDisconnected()));
+    }
+}
+
+void MetricsServer::OnDisconnected()
+{
+    QTcpSocket* pSocket = qobject_cast<QTcpSocket *>(sender());
+
+    if (NULL == pSocket)
+    {
+        return;
+    }
+
+    m_inputBuffers.remove(pSocket);
+    pSocket->deleteLater();
+}
+
+void MetricsServer::OnReadyRead()
+{
+    QTcpSocket* pSocket = qobject_cast<QTcpSocket *>(sender());
+
+    if (NULL == pSocket || !m_inputBuffers.contains(pSocket))
+    {
+        return;
+    }
+
+    HttpRequest request;
+    QByteArray& input = m_inputBuffers[pSocket];
+
+    input.append(pSocket->readAll());
+
+    int consumed = request.Parse(input);
+    if (consumed == 0)
+    {
+        return;
+    }
+
+    // Connection is closed after response, so remaining input is not needed
+    input.clear();
+
+    if (consumed < 0)
+    {
+        SendResponse(pSocket, 400, QByteArray("Bad request"));
+    }
+    else if (request.method != "GET")
+    {
+        SendResponse(pSocket, 405, QByteArray("Method not allowed"));
+    }
+    else if (request.path != "/metrics")
+    {
+        SendResponse(pSocket, 404, QByteArray("Not found"));
+    }
+    else
+    {
+        SendResponse(pSocket, 200, PipelineMetrics::instance()->ToText());
+    }
+}
+
+void MetricsServer::SendResponse(QTcpSocket* pSocket, int code, const QByteArray& body)
+{
+    pSocket->write(HttpRequest::ResponseHeader(code, "text/plain", body.size(), false, "Cache-Control: no-cache\r\n"));
+    pSocket->write(body);
+    pSocket->disconnectFromHost();
+}
@@ -0,0 +1,37 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "networkUtils/httpRequest.h"
+
+/*
+ * Local HTTP endpoint for pipeline metrics
+ * Answers 'GET /metrics' with PipelineMetrics in text format, one request per connection.
+ * Works in main thread, independently of media outputs.
+ */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    MetricsServer(QString address, int port, QObject* parent = NULL);
+    ~MetricsServer();
+
+private slots:
+    void    OnConnected();
+    void    OnReadyRead();
+    void    OnDisconnected();
+
+private:
+    QTcpServer*                     m_pTcpServer;
+    QMap<QTcpSocket*, QByteArray>   m_inputBuffers;     /// Incoming request data for each client
+
+    void    SendResponse(QTcpSocket* pSocket, int code, const QByteArray& body);
+};
+
+#endif // METRICSSERVER_H
@@ -22,6 +22,17 @@ void AnalysisParameters::readParameters(QSettings& ini)
     day                     = ini.value("AnalysisParams/Day", 20).toInt();
     hour                    = ini.value("AnalysisParams/Hour", 14).toInt();
     minute                  = ini.value("AnalysisParams/Minute", 45).toInt();
+    adaptiveFrameRate       = ini.value("AnalysisParams/Adaptive Frame Rate", false).toBool();
+    activeAnalysisFps       = ini.value("AnalysisParams/Active Analysis Fps", 7.0).toDouble();
+    idleAnalysisFps         = ini.value("AnalysisParams/Idle Analysis Fps", 2.0).toDouble();
+    activityMotionPercent   = ini.value("AnalysisParams/Activity Motion Percent", 0.5).toDouble();
+    activityHoldSec         = ini.value("AnalysisParams/Activity Hold Sec", 5).toInt();
+    activityGate            = ini.value("AnalysisParams/Activity Gate", false).toBool();
+    activitySleepSec        = ini.value("AnalysisParams/Activity Sleep Sec", 30).toInt();
+    activityWakeRatio       = ini.value("AnalysisParams/Activity Wake Ratio", 1.5).toDouble();
+    activitySleepRatio      = ini.value("AnalysisParams/Activity Sleep Ratio", 1.15).toDouble();
+    reanalysisWorkers       = ini.value("AnalysisParams/Reanalysis Workers", 0).toInt();
+    reanalysisNamespace     = ini.value("AnalysisParams/Reanalysis Namespace", "reanalysis").toString();
 }
 
 void CommonPipelineParameters::readParameters(QSettings &ini)
@@ -36,10 +47,26 @@ void CommonPipelineParameters::readParameters(QSettings &ini)
     fps                     = ini.value("PipelineParams/fps", 10).toInt();
     globalScale             = ini.value("PipelineParams/Global Scale", 1.0).toDouble();
     databasePath            = ini.value("PipelineParams/Database Path", "video_analytics").toString();
+    databaseBackend         = ini.value("PipelineParams/Database Backend", "postgres").toString();
     archivePath             = ini.value("PipelineParams/Archive Path", "VideoArchive").toString();
+    dataPath                = ini.value("PipelineParams/Data Path", "PipelineData").toString();
     processingIntervalSec   = ini.value("PipelineParams/Processing Interval Sec", 600).toInt();
     statisticIntervalSec    = ini.value("PipelineParams/Statistic Interval Sec", 600).toInt();
     statisticPeriodDays     = ini.value("PipelineParams/Statistic Period Days", 14).toInt();
+    statisticBaselines      = ini.value("PipelineParams/Statistic Baselines", true).toBool();
+    statisticBaselineDecay  = ini.value("PipelineParams/Statistic Baseline Decay", false).toBool();
+    statisticCache          = ini.value("PipelineParams/Statistic Cache", true).toBool();
+    dbAccessSlots           = ini.value("PipelineParams/Db Access Slots", 2).toInt();
+    dbWriteSlots            = ini.value("PipelineParams/Db Write Slots", 1).toInt();
+    storeHeatmap            = ini.value("PipelineParams/Store Heatmap", false).toBool();
+    hlsPort                 = ini.value("PipelineParams/Hls Port", 0).toInt();
+    hlsAddress              = ini.value("PipelineParams/Hls Address", "127.0.0.1").toString();
+    hlsPartDurationMs       = ini.value("PipelineParams/Hls Part Duration", 500).toInt();
+    archiveHttpPort         = ini.value("PipelineParams/Archive Http Port", 0).toInt();
+    archiveHttpAddress      = ini.value("PipelineParams/Archive Http Address", "127.0.0.1").toString();
+    archiveHttpThreads      = ini.value("PipelineParams/Archive Http Threads", 2).toInt();
+    metricsPort             = ini.value("PipelineParams/Metrics Port", 0).toInt();
+    metricsAddress          = ini.value("PipelineParams/Metrics Address", "127.0.0.1").toString();
 }
 
 void EventProcessingParameters::readParameters(QSettings& ini)
@@ -49,3 +76,20 @@ void EventProcessingParameters::readParameters(QSettings& ini)
     idleEventDuration       = ini.value("EventParams/Idle Event Duration",    5000 ).toInt();
     ignoreInterval          = ini.value("EventParams/Ignore Interval",        12000).toInt();
 }
+
+void RecordingParameters::readParameters(QSettings& ini)
+{
+    fragmentedArchive       = ini.value("RecordingParams/Fragmented Archive", true).toBool();
+    fragmentDurationMs      = ini.value("RecordingParams/Fragment Duration", 0).toInt();
+    asyncWriter             = ini.value("RecordingParams/Async Writer", true).toBool();
+    writeBlockKB            = ini.value("RecordingParams/Write Block KB", 1024).toInt();
+    writeQueueBlocks        = ini.value("RecordingParams/Write Queue Blocks", 8).toInt();
+    eventClipCopy           = ini.value("RecordingParams/Event Clip Mode", "virtual").toString() == "copy";
+    eventRecording          = ini.value("RecordingParams/Record Mode", "continuous").toString() == "events";
+    eventPrerollSec         = ini.value("RecordingParams/Event Preroll Seconds", 5).toInt();
+    eventPostrollSec        = ini.value("RecordingParams/Event Postroll Seconds", 10).toInt();
+    prerollBufferSec        = ini.value("RecordingParams/Preroll Buffer Seconds", 70).toInt();
+    prerollBufferMB         = ini.value("RecordingParams/Preroll Buffer MB", 32).toInt();
+    prerollSpillSec         = ini.value("RecordingParams/Preroll Spill Seconds", 0).toInt();
+    prerollSpillPath        = ini.value("RecordingParams/Preroll Spill Path", "").toString();
+}
@@ -27,6 +27,20 @@ struct AnalysisParameters
     int     hour;
     int     minute;
 
+    bool    adaptiveFrameRate;          /// Analyze at idle rate in static scene and at active rate otherwise
+    double  activeAnalysisFps;          /// Full analysis rate (also used without adaptive rate)
+    double  idleAnalysisFps;            /// Analysis rate in static scene
+    double  activityMotionPercent;      /// Frame motion, which switches analysis to full rate
+    int     activityHoldSec;            /// Full rate is kept for this time after last activity
+
+    bool    activityGate;               /// Decode only keyframes while compressed stream shows no activity
+    int     activitySleepSec;           /// Static period before analysis goes to sleep
+    double  activityWakeRatio;          /// Inter frame size to idle level ratio, which wakes full decoding
+    double  activitySleepRatio;         /// Ratio, below which scene is considered static
+
+    int     reanalysisWorkers;          /// Parallel workers for archive reanalysis (0 - number of cores)
+    QString reanalysisNamespace;        /// Suffix of camera name for reanalysis stats and events
+
     void  readParameters(QSettings &ini);
 };
 
@@ -39,8 +53,10 @@ struct CommonPipelineParameters
     QString     outputUrl;
     QString     smallOutputUrl;
     QString     sourceOutputUrl;
-    QString     databasePath;
+    QString     databasePath;           /// Postgres DB name or SQLite file (relative to data path)
+    QString     databaseBackend;        /// "postgres" (default) or "sqlite" (embedded)
     QString     archivePath;
+    QString     dataPath;               /// Local service files (embedded DB, statistics cache), must not be served with archive
 
     int         fps;
     double      globalScale;
@@ -49,6 +65,23 @@ struct CommonPipelineParameters
     int         processingIntervalSec;
     int         statisticIntervalSec;
     int         statisticPeriodDays;
+    bool        statisticBaselines;
+    bool        statisticBaselineDecay; /// Fade out old intervals instead of exact period window (no record reads on update)
+    bool        statisticCache;
+    int         dbAccessSlots;
+    int         dbWriteSlots;           /// Host-wide slots of DB writers (separate from read slots)
+    bool        storeHeatmap;           /// Write rendered heatmap with each record (otherwise rendered on request)
+
+    int         hlsPort;
+    QString     hlsAddress;             /// Listen address (local only by default)
+    int         hlsPartDurationMs;
+
+    int         archiveHttpPort;
+    QString     archiveHttpAddress;     /// Listen address (local only by default)
+    int         archiveHttpThreads;     /// I/O threads, each serves many connections
+
+    int         metricsPort;            /// Port of metrics endpoint (0 - disabled)
+    QString     metricsAddress;         /// Listen address (local only by default)
 
     void  readParameters(QSettings& ini);
 };
@@ -63,4 +96,25 @@ struct EventProcessingParameters
     void  readParameters(QSettings &ini);
 };
 
+struct RecordingParameters
+{
+    bool    fragmentedArchive;      /// Write archive as fragmented mp4 (append-only, no faststart rewrite)
+    int     fragmentDurationMs;     /// Maximum fragment duration (0 - one fragment per gop)
+    bool    asyncWriter;            /// Write fragmented archive from separate I/O thread with large blocks
+    int     writeBlockKB;           /// Size of single archive write
+    int     writeQueueBlocks;       /// Maximum number of blocks waiting for write
+    bool    eventClipCopy;          /// Write separate clip file for each event (otherwise events reference archive)
+
+    bool    eventRecording;         /// Write archive only around events (otherwise continuously)
+    int     eventPrerollSec;        /// Archive time before event start (taken from packet buffer)
+    int     eventPostrollSec;       /// Archive time after event finish
+
+    int     prerollBufferSec;       /// Time budget for in-memory packet buffer
+    int     prerollBufferMB;        /// Memory budget for in-memory packet buffer
+    int     prerollSpillSec;        /// Older gops are kept in local files for this time (0 - disabled)
+    QString prerollSpillPath;       /// Directory for spill files (archive directory by default)
+
+    void  readParameters(QSettings &ini);
+};
+
 #endif // PARAMETERS_H
@@ -3,6 +3,7 @@
 
 #include "cameraPipelineCommon.h"
 #include "motionTypes.h"
+#include "statisticsBlob.h"
 
 /// Detected object parameters
 struct DetectedObject
@@ -40,6 +41,7 @@ struct DetectedObject
 class IntervalStatistics
 {
 public:
+    IntervalStatistics();
     ~IntervalStatistics();
 
     AccumlatorBuffer        accBuffer;
@@ -52,11 +54,29 @@ public:
     QTime                   startTime;
     QTime                   endTime;
     QString                 archiveFile;
+    float                   weightScale;                        /// Applied to all weights when statistics are added (baseline normalization)
 
     void                    Reset();
     void                    CopyFrom(IntervalStatistics& src);
-    ErrorCode               ToByteArray(QByteArray* bytes);
-    ErrorCode               FromByteArray(QByteArray* bytes);
+    ErrorCode               ToByteArray(QByteArray* bytes);       /// Compressed format (version 2)
+    ErrorCode               FromByteArray(QByteArray* bytes);     /// Any known format version
+    ErrorCode               ToBlob(QByteArray* bytes);            /// Aligned format (version 3), can be used in place
+    ErrorCode               Attach(const QByteArray& bytes);      /// Use version 3 data in place (shared, not copied)
+    bool                    IsAttached() { return m_view.IsAttached(); }
+
+    // Access to accumulated data (own buffers or attached blob)
+    int                     AccWidth();
+    int                     AccHeight();
+    void                    AddAccumulatorTo(AccumlatorBuffer* pDst, float weight);
+    void                    AddMotionMapTo(MotionMap* pDst, float weight);
+
+private:
+    QByteArray              m_attachedData;                     /// Keeps attached blob alive
+    StatisticsBlobView      m_view;
+
+    ErrorCode               FromDataStreamV1(QDataStream& in);    /// Raw float buffers
+    ErrorCode               FromDataStreamV2(QDataStream& in);    /// Quantized, delta coded and compressed
+    ErrorCode               FromBlobView(const StatisticsBlobView& view);
 };
 
 /// Results of video analysis
@@ -65,6 +85,7 @@ struct AnalysisResults
     int64_t                  timestamp;
     double                   percentMotion;
     int                      wasCalibrationError;
+    float                    frameWeight;       /// Number of full rate analysis frames, represented by this one
 
     VideoBuffer*             pDiffBuffer;
     MotionFlow*              pCurFlow;
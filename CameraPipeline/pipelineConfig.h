@@ -8,4 +8,24 @@
 #define  HANG_TIMEOUT_MSEC          60000       // Default timeout for pipeline hand detection - 1 min
 #define  HEALTH_CHECK_INTERVAL_SEC  10          // Health check interval
 
+#define  ANALYSIS_TIMELINE_GAP_SEC  10.0        // Shortest time between analyzed frames treated as stream gap (not sparse sampling)
+#define  ANALYSIS_RATE_DECAY        1.25        // Analysis interval growth per analyzed frame after activity hold time
+#define  GATE_MAX_SKIPPED_PACKETS   300         // Skipped packets kept for decoder restore (older are decoded, streams without keyframes)
+
+#define  STATS_CACHE_BASELINES      8           // Most recently used baselines kept in local statistics cache
+#define  STATS_CACHE_INTERVALS      6           // Last written intervals kept in local statistics cache
+#define  STATS_FETCH_PAGE_ROWS      16          // Records fetched by one query (result set is buffered by SQL driver)
+
+#define  DB_WRITER_FLUSH_MSEC       1000        // Delay of queued events write (collected into one batch)
+#define  DB_WRITER_BATCH_EVENTS     64          // Max events in one multi-row insert (full batch is written at once)
+#define  DB_WRITER_BATCH_RECORDS    4           // Max interval records in one transaction
+#define  DB_WRITER_MAX_EVENTS       4096        // Queued events limit (oldest are dropped)
+#define  DB_WRITER_MAX_RECORDS      16          // Queued interval records limit (oldest are dropped)
+#define  DB_WRITER_MAX_RETRY_MSEC   60000       // Longest delay between write retries
+#define  DB_WRITER_MAX_ATTEMPTS     5           // Batch rejected by available DB is dropped after this number of attempts
+
+#define  DB_SQLITE_BUSY_TIMEOUT_MSEC    5000    // Wait for write lock of embedded DB (shared by several connections)
+#define  DB_SQLITE_MMAP_SIZE        268435456   // Memory mapped part of embedded DB file (256 MB)
+#define  DB_SQLITE_MIN_VERSION      3024000     // 3.24.0 - first version with UPSERT (baselines are written by it)
+
 #endif // PIPELINECONFIG_H
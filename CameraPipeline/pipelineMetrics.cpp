@@ -0,0 +1,52 @@
+#include "pipelineMetrics.h"
+
+PipelineMetrics* PipelineMetrics::m_instance = NULL;
+
+PipelineMetrics::PipelineMetrics()
+{
+
+}
+
+PipelineMetrics::~PipelineMetrics()
+{
+
+}
+
+PipelineMetrics* PipelineMetrics::instance()
+{
+    if(!m_instance)
+    {
+        m_instance = new PipelineMetrics();
+    }
+    return m_instance;
+}
+
+void PipelineMetrics::SetGauge(const char* name, double value)
+{
+    QMutexLocker locker(&m_mutex);
+    m_values[QString(name)] = value;
+}
+
+void PipelineMetrics::AddCounter(const char* name, double delta)
+{
+    QMutexLocker locker(&m_mutex);
+    m_values[QString(name)] += delta;
+}
+
+double PipelineMetrics::Value(const char* name)
+{
+    QMutexLocker locker(&m_mutex);
+    return m_values.value(QString(name), 0.0);
+}
+
+QByteArray PipelineMetrics::ToText()
+{
+    QByteArray text;
+    QMutexLocker locker(&m_mutex);
+
+    for (QMap<QString, double>::const_iterator it = m_values.constBegin(); it != m_values.constEnd(); ++it)
+    {
+        text += it.key().toUtf8() + " " + QByteArray::number(it.value(), 'g', 12) + "\n";
+    }
+    return text;
+}
@@ -0,0 +1,37 @@
+#ifndef PIPELINEMETRICS_H
+#define PIPELINEMETRICS_H
+
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QByteArray>
+
+#define  METRICS_LOG_INTERVAL_SEC   60          // How often metrics are dumped to log by health checker
+
+/*
+ * Thread-safe storage for named pipeline metrics (gauges and counters)
+ * Any pipeline block can update its values, and all of them are periodically logged
+ * and can be requested in Prometheus-like text format
+ */
+class PipelineMetrics
+{
+public:
+    static PipelineMetrics* instance();
+    ~PipelineMetrics();
+
+    void        SetGauge(const char* name, double value);           /// Set current value
+    void        AddCounter(const char* name, double delta = 1.0);   /// Increment accumulated value
+    double      Value(const char* name);
+
+    QByteArray  ToText();                                           /// "name value" lines
+
+private:
+    static PipelineMetrics* m_instance;
+
+    PipelineMetrics();
+
+    QMutex                  m_mutex;
+    QMap<QString, double>   m_values;
+};
+
+#endif // PIPELINEMETRICS_H
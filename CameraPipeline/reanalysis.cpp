@@ -0,0 +1,390 @@
+#include <QDir>
+#include <QMap>
+#include <QFileInfo>
+#include <QDateTime>
+
+#include "reanalysis.h"
+#include "archiveIndex.h"
+#include "cameraPipeline.h"
+#include "pipelineConfig.h"
+
+ReanalysisWorker::ReanalysisWorker(int workerId, QStringList fileNames) :
+    QObject(NULL),
+    m_workerId(workerId),
+    m_fileNames(fileNames),
+    m_stop(false),
+    m_framesProcessed(0),
+    m_segmentStartTime(0),
+    m_pFrameBuffer(NULL),
+    m_pVideoAnalyzer(NULL),
+    m_pVideoStatistics(NULL),
+    m_pEventHandler(NULL),
+    m_pStatisticDBIntf(NULL)
+{
+
+}
+
+ReanalysisWorker::~ReanalysisWorker()
+{
+    DEBUG_MESSAGE0("ReanalysisWorker", "~ReanalysisWorker() called");
+    SAFE_DELETE(m_pEventHandler);
+    SAFE_DELETE(m_pVideoStatistics);
+    SAFE_DELETE(m_pVideoAnalyzer);
+    SAFE_DELETE(m_pStatisticDBIntf);
+    SAFE_DELETE(m_pFrameBuffer);
+    DEBUG_MESSAGE0("ReanalysisWorker", "~ReanalysisWorker() finished");
+}
+
+void ReanalysisWorker::Run()
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    QString         camName = pDataDirectory->pipelineParams.pipelineName + '_' +
+                              pDataDirectory->analysisParams.reanalysisNamespace;
+
+    // All objects are created in worker thread, so all connections below are direct
+    m_pFrameBuffer = new FrameCircularBuffer(DEFAULT_FRAME_BUFFER_SIZE);
+    m_pFrameBuffer->SetUseMediaTime(true);
+
+    m_pVideoAnalyzer = new VideoAnalyzer(m_pFrameBuffer);
+    m_pVideoStatistics = new VideoStatistics();
+    m_pEventHandler = new EventHandler();
+
+    // Each worker uses its own DB connection, statistics are read and written without delays
+    m_pStatisticDBIntf = new StatisticDBInterface(QString("reanalysis_%1").arg(m_workerId), camName, true);
+    m_pStatisticDBIntf->OpenDB();
+
+    QObject::connect(m_pVideoAnalyzer, SIGNAL(AnalysisFinished(VideoFrame*, AnalysisResults*)),
+                     m_pVideoStatistics, SLOT(ProcessAnalyzedFrame(VideoFrame*, AnalysisResults*)));
+
+    QObject::connect(m_pEventHandler, SIGNAL(EventDiffBufferUpdate(VideoBuffer*)),
+                     m_pVideoStatistics, SLOT(AddFalseEventDiffBuffer(VideoBuffer*)));
+
+    QObject::connect(m_pVideoStatistics, SIGNAL(StatisticPeriodStarted(QDateTime)),
+                     m_pStatisticDBIntf, SLOT(PerformGetStatistic(QDateTime)));
+
+    QObject::connect(m_pVideoStatistics, SIGNAL(StatisticPeriodReady(IntervalStatistics*)),
+                     m_pStatisticDBIntf, SLOT(PerformWriteStatistic(IntervalStatistics*)));
+
+    QObject::connect(m_pVideoAnalyzer, SIGNAL(AnalysisFinished(VideoFrame*, AnalysisResults*)),
+                     m_pEventHandler, SLOT(ProcessAnalysisResults(VideoFrame*,AnalysisResults*)));
+
+    QObject::connect(m_pStatisticDBIntf, SIGNAL(NewPeriodStatistics(QList<IntervalStatistics*>)),
+                     m_pEventHandler, SLOT(ProcessIntervalStats(QList<IntervalStatistics*>)));
+
+    QObject::connect(m_pEventHandler, SIGNAL(EventStarted(EventDescription)),
+                     m_pVideoAnalyzer, SLOT(EventStarted(EventDescription)));
+
+    QObject::connect(m_pEventHandler, SIGNAL(EventFinished(EventDescription)),
+                     m_pVideoAnalyzer, SLOT(EventFinished(EventDescription)));
+
+    // There is no stream recorder here, so finished events are stored directly
+    QObject::connect(m_pEventHandler, SIGNAL(EventFinished(EventDescription)),
+                     this, SLOT(StoreEvent(EventDescription)));
+
+    m_pVideoAnalyzer->StartAnalyze();
+
+    for (int i = 0; i < m_fileNames.size() && !m_stop; i++)
+    {
+        QElapsedTimer   timer;
+        qint64          framesBefore = m_framesProcessed;
+
+        timer.start();
+
+        if (CAMERA_PIPELINE_OK != ProcessFile(m_fileNames[i]))
+        {
+            ERROR_MESSAGE1(ERR_TYPE_ERROR, "ReanalysisWorker", "Failed to process %s",
+                           m_fileNames[i].toUtf8().constData());
+            continue;
+        }
+
+        ERROR_MESSAGE5(ERR_TYPE_MESSAGE, "ReanalysisWorker", "Worker %d: %s processed (%lld frames in %lld ms), %d left",
+                       m_workerId, m_fileNames[i].toUtf8().constData(),
+                       m_framesProcessed - framesBefore, timer.elapsed(), m_fileNames.size() - i - 1);
+    }
+
+    // Statistics and DB connection should be released in the thread, where they were created
+    SAFE_DELETE(m_pEventHandler);
+    SAFE_DELETE(m_pVideoStatistics);
+    SAFE_DELETE(m_pVideoAnalyzer);
+    SAFE_DELETE(m_pStatisticDBIntf);
+    SAFE_DELETE(m_pFrameBuffer);
+
+    emit Finished(m_workerId, m_framesProcessed);
+}
+
+ErrorCode ReanalysisWorker::ProcessFile(QString fileName)
+{
+    DataDirectory*      pDataDirectory = DataDirectoryInstance::instance();
+    AVFormatContext*    pInputCtx = NULL;
+    AVCodecContext*     pCodecCtx = NULL;
+    AVCodec*            pCodec = NULL;
+    AVPacket*           pPacket = NULL;
+    AVFrame*            pFrame = NULL;
+    QByteArray          inputName = fileName.toUtf8();
+    int                 videoIndex;
+    bool                flushing = false;
+
+    m_segmentStartTime = ReanalysisRunner::SegmentStartTime(fileName);
+    if (m_segmentStartTime <= 0)
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "ReanalysisWorker", "Unknown start time of %s", inputName.constData());
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    if (0 > avformat_open_input(&pInputCtx, inputName.constData(), NULL, NULL) ||
+        0 > avformat_find_stream_info(pInputCtx, NULL))
+    {
+        avformat_close_input(&pInputCtx);
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    videoIndex = av_find_best_stream(pInputCtx, AVMEDIA_TYPE_VIDEO, -1, -1, &pCodec, 0);
+    if (videoIndex < 0 || NULL == pCodec || NULL == (pCodecCtx = avcodec_alloc_context3(pCodec)))
+    {
+        avformat_close_input(&pInputCtx);
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    AVStream* pStream = pInputCtx->streams[videoIndex];
+
+    // Workers already occupy all cores, so each decoder is single threaded
+    avcodec_parameters_to_context(pCodecCtx, pStream->codecpar);
+    pCodecCtx->thread_count = 1;
+
+    if (0 > avcodec_open2(pCodecCtx, pCodec, NULL))
+    {
+        avcodec_free_context(&pCodecCtx);
+        avformat_close_input(&pInputCtx);
+        return CAMERA_PIPELINE_ERROR;
+    }
+
+    // Archive references are the same as for live recording
+    m_shortFileName = '/' + pDataDirectory->pipelineParams.pipelineName + '/' + QFileInfo(fileName).fileName();
+    m_pEventHandler->NewArchiveFileName(m_shortFileName);
+    m_pStatisticDBIntf->NewArchiveFileName(m_shortFileName);
+
+    pPacket = av_packet_alloc();
+    pFrame = av_frame_alloc();
+
+    while (!m_stop)
+    {
+        if (!flushing)
+        {
+            if (0 > av_read_frame(pInputCtx, pPacket))
+            {
+                // Get remaining frames from decoder
+                flushing = true;
+                avcodec_send_packet(pCodecCtx, NULL);
+            }
+            else if (pPacket->stream_index != videoIndex)
+            {
+                av_packet_unref(pPacket);
+                continue;
+            }
+            else
+            {
+                avcodec_send_packet(pCodecCtx, pPacket);
+                av_packet_unref(pPacket);
+            }
+        }
+
+        int decodeRes = avcodec_receive_frame(pCodecCtx, pFrame);
+
+        while (0 == decodeRes && !m_stop)
+        {
+            if (pFrame->format != AV_PIX_FMT_YUV420P && pFrame->format != AV_PIX_FMT_YUVJ420P)
+            {
+                ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "ReanalysisWorker", "Unsupported frame format");
+            }
+            else if (AV_NOPTS_VALUE != pFrame->best_effort_timestamp)
+            {
+                // Frame time in seconds since epoch (segment start is server time of the first packet)
+                double frameTime = m_segmentStartTime / 1000.0 + av_q2d(pStream->time_base) * pFrame->best_effort_timestamp;
+
+                m_pFrameBuffer->AddFrame(pFrame, frameTime, frameTime);
+                m_pVideoAnalyzer->DoAnalyze();
+                m_framesProcessed++;
+            }
+            decodeRes = avcodec_receive_frame(pCodecCtx, pFrame);
+        }
+
+        if (flushing && AVERROR(EAGAIN) != decodeRes)
+        {
+            break;
+        }
+    }
+
+    av_frame_free(&pFrame);
+    av_packet_free(&pPacket);
+    avcodec_free_context(&pCodecCtx);
+    avformat_close_input(&pInputCtx);
+
+    return CAMERA_PIPELINE_OK;
+}
+
+void ReanalysisWorker::StoreEvent(EventDescription event)
+{
+    // Event is placed in current segment (offset is calculated from segment start by DAO)
+    event.clipFileName = m_shortFileName;
+    event.archiveStartTime = m_segmentStartTime;
+    event.clipOffsetMs = std::max((qint64)0, event.startTime.toMSecsSinceEpoch() - m_segmentStartTime);
+
+    m_pStatisticDBIntf->StoreEvent(event);
+}
+
+ReanalysisRunner::ReanalysisRunner(QStringList paths, QObject *parent) :
+    QObject(parent),
+    m_activeWorkers(0),
+    m_framesProcessed(0)
+{
+    QMap<int64_t, QString> sortedFiles;
+
+    // Directories are expanded to archive segments inside
+    Q_FOREACH (const QString& path, paths)
+    {
+        QStringList fileNames;
+        QFileInfo   info(path);
+
+        if (info.isDir())
+        {
+            QDir dir(path);
+            Q_FOREACH (const QString& name, dir.entryList(QStringList() << "*.mp4", QDir::Files))
+            {
+                fileNames.append(dir.filePath(name));
+            }
+        }
+        else
+        {
+            fileNames.append(path);
+        }
+
+        Q_FOREACH (const QString& fileName, fileNames)
+        {
+            int64_t startTime = SegmentStartTime(fileName);
+
+            if (startTime <= 0)
+            {
+                ERROR_MESSAGE1(ERR_TYPE_WARNING, "ReanalysisRunner", "Skipping %s: unknown segment start time",
+                               fileName.toUtf8().constData());
+                continue;
+            }
+            sortedFiles.insertMulti(startTime, fileName);
+        }
+    }
+    m_fileNames = sortedFiles.values();
+}
+
+ReanalysisRunner::~ReanalysisRunner()
+{
+    Stop();
+
+    // Workers are deleted only after their threads are finished
+    for (int i = 0; i < m_threads.size(); i++)
+    {
+        m_threads[i]->quit();
+        m_threads[i]->wait();
+        SAFE_DELETE(m_workers[i]);
+        SAFE_DELETE(m_threads[i]);
+    }
+}
+
+int64_t ReanalysisRunner::SegmentStartTime(QString fileName)
+{
+    ArchiveSegmentIndex index;
+
+    if (CAMERA_PIPELINE_OK == ReadArchiveIndex(fileName, &index))
+    {
+        return index.startTime;
+    }
+
+    // Segment start time is encoded in file name ('dd_MM_yyyy___HH_mm_ss' before extension)
+    QString     timeStr = QFileInfo(fileName).completeBaseName();
+    QDateTime   fileTime;
+
+    timeStr.remove(0, timeStr.length() - 21);
+    fileTime = QDateTime::fromString(timeStr, "dd_MM_yyyy___HH_mm_ss");
+
+    return fileTime.isValid() ? fileTime.toMSecsSinceEpoch() : 0;
+}
+
+void ReanalysisRunner::Start()
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    int             numWorkers = pDataDirectory->analysisParams.reanalysisWorkers;
+
+    if (m_fileNames.isEmpty())
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "ReanalysisRunner", "No archive segments to reanalyze");
+        emit Finished();
+        return;
+    }
+
+    // Missing fps and downscale parameters are taken from archive
+    if (CAMERA_PIPELINE_OK != CameraPipeline::CheckParams(m_fileNames.first()))
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "ReanalysisRunner", "Failed to get parameters of archive segments");
+        emit Finished();
+        return;
+    }
+
+    if (numWorkers <= 0)
+    {
+        numWorkers = QThread::idealThreadCount();
+    }
+    numWorkers = std::max(1, std::min(numWorkers, m_fileNames.size()));
+
+    ERROR_MESSAGE3(ERR_TYPE_MESSAGE, "ReanalysisRunner", "Reanalysis of %d segments started with %d workers (results for '%s')",
+                   m_fileNames.size(), numWorkers,
+                   (pDataDirectory->pipelineParams.pipelineName + '_' +
+                    pDataDirectory->analysisParams.reanalysisNamespace).toUtf8().constData());
+
+    qRegisterMetaType<EventDescription>("EventDescription");
+    qRegisterMetaType< QList<IntervalStatistics* > >("QList<IntervalStatistics* >");
+
+    m_timer.start();
+
+    // Contiguous chunks (intervals and events are not split between workers inside chunk)
+    int chunkSize = (m_fileNames.size() + numWorkers - 1) / numWorkers;
+
+    for (int first = 0; first < m_fileNames.size(); first += chunkSize)
+    {
+        QThread*            pThread = new QThread();
+        ReanalysisWorker*   pWorker = new ReanalysisWorker(m_workers.size(), m_fileNames.mid(first, chunkSize));
+
+        pWorker->moveToThread(pThread);
+        QObject::connect(pThread, SIGNAL(started()),  pWorker, SLOT(Run()));
+        QObject::connect(pWorker, SIGNAL(Finished(int, qint64)), this, SLOT(WorkerFinished(int, qint64)));
+
+        m_threads.append(pThread);
+        m_workers.append(pWorker);
+        m_activeWorkers++;
+
+        pThread->start();
+    }
+}
+
+void ReanalysisRunner::Stop()
+{
+    Q_FOREACH (ReanalysisWorker* pWorker, m_workers)
+    {
+        pWorker->Stop();
+    }
+}
+
+void ReanalysisRunner::WorkerFinished(int workerId, qint64 framesProcessed)
+{
+    m_framesProcessed += framesProcessed;
+    m_threads[workerId]->quit();
+
+    if (--m_activeWorkers > 0)
+    {
+        return;
+    }
+
+    qint64 elapsed = std::max((qint64)1, m_timer.elapsed());
+
+    ERROR_MESSAGE3(ERR_TYPE_MESSAGE, "ReanalysisRunner", "Reanalysis finished: %lld frames in %lld ms (%.1f fps)",
+                   m_framesProcessed, elapsed, m_framesProcessed * 1000.0 / elapsed);
+
+    emit Finished();
+}
@@ -0,0 +1,92 @@
+#ifndef REANALYSIS_H
+#define REANALYSIS_H
+
+#include <QList>
+#include <QThread>
+#include <QObject>
+#include <QStringList>
+#include <QElapsedTimer>
+
+#include "cameraPipelineCommon.h"
+#include "frameCircularBuffer.h"
+#include "videoAnalyzer.h"
+#include "eventHandler.h"
+#include "intervalStatistics.h"
+
+/*
+ * Offline analysis of a contiguous chunk of archive segments
+ * Frames are decoded as fast as possible and passed to analyzer directly (without capture timers),
+ * all objects live in worker thread and are connected directly.
+ * Media time of the segments is used instead of wall clock.
+ */
+class ReanalysisWorker : public QObject
+{
+    Q_OBJECT
+public:
+    ReanalysisWorker(int workerId, QStringList fileNames);
+    ~ReanalysisWorker();
+
+    void    Stop() { m_stop = true; }                       /// Can be called from any thread
+
+signals:
+    void    Finished(int workerId, qint64 framesProcessed);
+
+public slots:
+    void    Run();                                          /// Process all files (called on thread start)
+
+private slots:
+    void    StoreEvent(EventDescription event);             /// Add archive reference and write finished event
+
+private:
+    int                     m_workerId;
+    QStringList             m_fileNames;
+    volatile bool           m_stop;
+    qint64                  m_framesProcessed;
+
+    QString                 m_shortFileName;                /// Current segment name (as in archive recorder)
+    int64_t                 m_segmentStartTime;             /// Server time of current segment start (ms)
+
+    FrameCircularBuffer*    m_pFrameBuffer;
+    VideoAnalyzer*          m_pVideoAnalyzer;
+    VideoStatistics*        m_pVideoStatistics;
+    EventHandler*           m_pEventHandler;
+    StatisticDBInterface*   m_pStatisticDBIntf;
+
+    ErrorCode   ProcessFile(QString fileName);
+};
+
+/*
+ * Runs archive reanalysis (--reanalyze command line option)
+ * Segments are sorted by start time and split in contiguous chunks between workers,
+ * so interval statistics and events are continuous inside each chunk.
+ * Results are stored under '<pipeline name>_<reanalysis namespace>' camera name.
+ */
+class ReanalysisRunner : public QObject
+{
+    Q_OBJECT
+public:
+    ReanalysisRunner(QStringList paths, QObject* parent = NULL);
+    ~ReanalysisRunner();
+
+    static int64_t  SegmentStartTime(QString fileName);     /// Server time of segment start from index or file name (0 if unknown)
+
+signals:
+    void    Finished();
+
+public slots:
+    void    Start();
+    void    Stop();
+
+private slots:
+    void    WorkerFinished(int workerId, qint64 framesProcessed);
+
+private:
+    QStringList                 m_fileNames;
+    QList<QThread*>             m_threads;
+    QList<ReanalysisWorker*>    m_workers;
+    int                         m_activeWorkers;
+    qint64                      m_framesProcessed;
+    QElapsedTimer               m_timer;
+};
+
+#endif // REANALYSIS_H
@@ -3,10 +3,16 @@
 
 #include "libavutil/opt.h"
 
-ResultVideoOutput::ResultVideoOutput(QString outputURL) :
+ResultVideoOutput::ResultVideoOutput(QString outputURL, QString hlsAddress, int hlsPort, int hlsPartDurationMs) :
     pWebSocketServer(NULL),
+    pHlsServer(NULL),
     m_outputUrl(outputURL),
     m_outputInitialized(false),
+    m_hlsAddress(hlsAddress),
+    m_hlsPort(hlsPort),
+    m_hlsPartDurationMs(hlsPartDurationMs),
+    m_pParameterSets(NULL),
+    m_parameterSetsVersion(-1),
     m_pFormatCtx(NULL),
     m_pVideoStream(NULL),
     m_pAVIOCtx(NULL),
@@ -55,6 +61,34 @@ void ResultVideoOutput::OnWsDisconnected()
     }
 }
 
+void ResultVideoOutput::PublishInitialFragments()
+{
+    if (NULL != pHlsServer)
+    {
+        pHlsServer->SetInitSegment(initialFragments);
+    }
+}
+
+void ResultVideoOutput::PublishFragment(const QByteArray& fragment)
+{
+    // Fragment data is shared between all websocket clients and HLS parts
+    Q_FOREACH (QWebSocket* client, clients)
+    {
+        client->sendBinaryMessage(fragment);
+    }
+
+    if (NULL != pHlsServer && AV_NOPTS_VALUE != m_fragmentStartDts)
+    {
+        // Fragment is flushed by muxer, when the packet, which starts the next one, is written
+        double duration = (double)(m_packetDts - m_fragmentStartDts) * av_q2d(m_pVideoStream->time_base);
+
+        pHlsServer->AddPart(fragment, duration, m_fragmentStartKey);
+    }
+
+    m_fragmentStartDts = m_packetDts;
+    m_fragmentStartKey = m_packetKey;
+}
+
 static int WritePacketCallback(void* opaque, uint8_t* buf, int size)
 {
     ResultVideoOutput* pOutput = reinterpret_cast<ResultVideoOutput*>(opaque);
@@ -79,14 +113,12 @@ static int WritePacketCallback(void* opaque, uint8_t* buf, int size)
     else if (!memcmp(buf + 4, moovTag, 4))
     {
         pOutput->initialFragments.append(QByteArray((char *)buf, size));
+        pOutput->PublishInitialFragments();
     }
     // MOOF (or sidx+moov)
     else if (!memcmp(buf + 4, moofTag, 4) || !memcmp(buf + 4, sidxTag, 4))
     {
-        Q_FOREACH (QWebSocket* client, pOutput->clients)
-        {
-            client->sendBinaryMessage(QByteArray((char *)buf, size));
-        }
+        pOutput->PublishFragment(QByteArray((char *)buf, size));
     }
     else
     {
@@ -158,6 +190,12 @@ void ResultVideoOutput::Open(AVStream* pInStream)
             return;
         }
 
+        // HTTP server for low-latency HLS
+        if (m_hlsPort > 0)
+        {
+            pHlsServer = new HlsServer(m_hlsAddress, m_hlsPort, m_hlsPartDurationMs, this);
+        }
+
         m_pAvioCtxBuffer = (uint8_t *)av_malloc(DEFAULT_AVIO_BUFSIZE);
         if (nullptr == m_pAvioCtxBuffer)
         {
@@ -189,6 +227,12 @@ void ResultVideoOutput::Open(AVStream* pInStream)
 
         // Set encoding parameters
         avcodec_parameters_copy(m_pVideoStream->codecpar, pCodecParams);
+
+        // Actual parameter sets of input stream
+        if (NULL != m_pParameterSets)
+        {
+            m_pParameterSets->ApplyTo(m_pVideoStream->codecpar, &m_parameterSetsVersion);
+        }
     }
     else
     {
@@ -207,6 +251,12 @@ void ResultVideoOutput::Open(AVStream* pInStream)
         // Set encoding parameters
         avcodec_parameters_copy(m_pVideoStream->codecpar, pCodecParams);
 
+        // Actual parameter sets of input stream
+        if (NULL != m_pParameterSets)
+        {
+            m_pParameterSets->ApplyTo(m_pVideoStream->codecpar, &m_parameterSetsVersion);
+        }
+
         // Open output file, if it is allowed by format
         if (0 > avio_open(&m_pFormatCtx->pb, m_outputUrl.toUtf8().constData(), AVIO_FLAG_WRITE))
         {
@@ -223,8 +273,19 @@ void ResultVideoOutput::Open(AVStream* pInStream)
     if (m_outputUrl.startsWith("ws"))
     {
         av_dict_set(&opts, "movflags", "empty_moov+dash+default_base_moof+frag_keyframe", 0);
+
+        // Split gops to HLS parts
+        if (NULL != pHlsServer && m_hlsPartDurationMs > 0)
+        {
+            av_dict_set_int(&opts, "frag_duration", (int64_t)m_hlsPartDurationMs * 1000, 0);
+        }
     }
 
+    m_fragmentStartDts = AV_NOPTS_VALUE;
+    m_fragmentStartKey = false;
+    m_packetDts = AV_NOPTS_VALUE;
+    m_packetKey = false;
+
     if (0 > avformat_write_header(m_pFormatCtx, &opts))
     {
         ERROR_MESSAGE0(ERR_TYPE_ERROR, "ResultVideoOutput", "avformat_write_header() failed");
@@ -251,14 +312,46 @@ void ResultVideoOutput::WritePacket(QSharedPointer<AVPacket> pInPacket)
         return;
     }
 
-    // Clone packet because it is ref-counted and will be unrefed in av_interleaved_write_frame
-    AVPacket*   pPacket = av_packet_clone(pInPacket.data());
+    AVPacket*   pPacket = NULL;
+    QByteArray  prefix;
 
-    // Waiting for key frame to start file
-    if (pInPacket->flags & AV_PKT_FLAG_KEY)
+    // HLS clients join at any keyframe and get init segment only once, so parameter sets go in-band
+    if ((pInPacket->flags & AV_PKT_FLAG_KEY) && NULL != pHlsServer && NULL != m_pParameterSets)
     {
-        // Write format header to file
-        FillSPSPPS(m_pVideoStream->codecpar, pPacket);
+        prefix = m_pParameterSets->KeyframePrefix();
+    }
+
+    if (prefix.isEmpty())
+    {
+        // Clone packet because it is ref-counted and will be unrefed in av_interleaved_write_frame
+        pPacket = av_packet_clone(pInPacket.data());
+    }
+    else
+    {
+        pPacket = av_packet_alloc();
+        if (NULL == pPacket || 0 != av_new_packet(pPacket, prefix.size() + pInPacket->size))
+        {
+            ERROR_MESSAGE0(ERR_TYPE_ERROR, "ResultVideoOutput", "Failed to allocate keyframe packet");
+            av_packet_free(&pPacket);
+            return;
+        }
+        memcpy(pPacket->data, prefix.constData(), prefix.size());
+        memcpy(pPacket->data + prefix.size(), pInPacket->data, pInPacket->size);
+        av_packet_copy_props(pPacket, pInPacket.data());
+    }
+
+    // Parameter sets of input stream were changed - pass new extradata to muxer with keyframe
+    if ((pInPacket->flags & AV_PKT_FLAG_KEY) && NULL != m_pParameterSets &&
+        m_pParameterSets->Version() != m_parameterSetsVersion)
+    {
+        m_pParameterSets->ApplyTo(m_pVideoStream->codecpar, &m_parameterSetsVersion);
+
+        int      extradataSize = m_pVideoStream->codecpar->extradata_size;
+        uint8_t* pSideData = av_packet_new_side_data(pPacket, AV_PKT_DATA_NEW_EXTRADATA, extradataSize);
+        if (NULL != pSideData)
+        {
+            memcpy(pSideData, m_pVideoStream->codecpar->extradata, extradataSize);
+        }
     }
 
     if ((AV_NOPTS_VALUE == m_firstDts))
@@ -271,6 +364,15 @@ void ResultVideoOutput::WritePacket(QSharedPointer<AVPacket> pInPacket)
     pPacket->pts -= m_firstDts;
     av_packet_rescale_ts(pPacket, m_inputTimeBase, m_pVideoStream->time_base);
 
+    // Fragment, flushed during this call (if any), ends right before this packet
+    m_packetDts = pPacket->dts;
+    m_packetKey = (pPacket->flags & AV_PKT_FLAG_KEY) != 0;
+    if (AV_NOPTS_VALUE == m_fragmentStartDts)
+    {
+        m_fragmentStartDts = m_packetDts;
+        m_fragmentStartKey = m_packetKey;
+    }
+
     int res = av_interleaved_write_frame(m_pFormatCtx, pPacket);
     av_packet_free(&pPacket);
     if (res < 0)
@@ -283,6 +385,28 @@ void ResultVideoOutput::WritePacket(QSharedPointer<AVPacket> pInPacket)
     DEBUG_MESSAGE0("ResultVideoOutput", "WritePacket() finished");
 }
 
+void ResultVideoOutput::WriteMetadata(double frameTime, QJsonObject metadata)
+{
+    if (!m_outputInitialized || clients.isEmpty() || AV_NOPTS_VALUE == m_firstDts)
+    {
+        return;
+    }
+
+    // Frame pts is in seconds of input stream, convert it to output pts (the same as in WritePacket)
+    int64_t pts = llrint(frameTime / av_q2d(m_inputTimeBase)) - m_firstDts;
+
+    metadata["pts"] = (double)av_rescale_q(pts, m_inputTimeBase, m_pVideoStream->time_base);
+    metadata["timescale"] = m_pVideoStream->time_base.den;
+
+    // Text messages are used for metadata, binary ones - for video fragments
+    QString message = QString::fromUtf8(QJsonDocument(metadata).toJson(QJsonDocument::Compact));
+
+    Q_FOREACH (QWebSocket* client, clients)
+    {
+        client->sendTextMessage(message);
+    }
+}
+
 void ResultVideoOutput::Close()
 {
     DEBUG_MESSAGE0("ResultVideoOutput", "CloseOutput() called");
@@ -305,6 +429,7 @@ void ResultVideoOutput::Close()
             av_freep(&m_pAVIOCtx);
         }
         SAFE_DELETE(pWebSocketServer);
+        SAFE_DELETE(pHlsServer);
         m_outputInitialized = false;
     }
     DEBUG_MESSAGE0("ResultVideoOutput", "CloseOutput() finished");
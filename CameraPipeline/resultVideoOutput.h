@@ -4,9 +4,12 @@
 #include <QObject>
 #include <QString>
 #include <QtWebSockets>
+#include <QJsonObject>
+#include <QJsonDocument>
 
 #include "networkUtils/dataDirectory.h"
 #include "cameraPipelineCommon.h"
+#include "hlsServer.h"
 
 class AnalysisResults;
 
@@ -16,7 +19,7 @@ class ResultVideoOutput : public QObject
 {
     Q_OBJECT
 public:
-    ResultVideoOutput(QString outputURL);
+    ResultVideoOutput(QString outputURL, QString hlsAddress = QString(), int hlsPort = 0, int hlsPartDurationMs = 0);
     ~ResultVideoOutput();
 
     // Output to framented mp4 using websockets
@@ -24,10 +27,19 @@ public:
     QWebSocketServer*   pWebSocketServer;
     QList<QWebSocket*>  clients;
 
+    // Same fragments are published as low-latency HLS (if hls port is set)
+    HlsServer*          pHlsServer;
+
+    void    SetParameterSets(ParameterSetTracker* pParameterSets) { m_pParameterSets = pParameterSets; }
+
+    void    PublishInitialFragments();
+    void    PublishFragment(const QByteArray& fragment);
+
 public slots:
     void    Close();
     void    Open(AVStream* pInStream);
     void    WritePacket(QSharedPointer<AVPacket> pInPacket);
+    void    WriteMetadata(double frameTime, QJsonObject metadata);     /// Send timed metadata to websocket clients
 
     void    OnWsConnected();
     void    OnWsDisconnected();
@@ -36,6 +48,17 @@ private:
     QString             m_outputUrl;            /// Output stream location (network, file, etc...)
     int64_t             m_firstDts;             /// First packet timestamp
     bool                m_outputInitialized;    /// indicates, if output format initialized correctly
+    QString             m_hlsAddress;           /// HLS server listen address
+    int                 m_hlsPort;              /// HLS server port (0 - disabled)
+    int                 m_hlsPartDurationMs;    /// Maximum fragment (HLS part) duration
+
+    int64_t             m_fragmentStartDts;     /// Output dts of the first packet in current fragment
+    bool                m_fragmentStartKey;     /// Current fragment starts from key frame
+    int64_t             m_packetDts;            /// Output dts of the packet being written
+    bool                m_packetKey;
+
+    ParameterSetTracker* m_pParameterSets;      /// Parameter sets of input stream (owned by capture)
+    int                 m_parameterSetsVersion; /// Version of parameter sets passed to muxer
 
     /// AVLib stuff
     AVFormatContext*    m_pFormatCtx;
@@ -4,6 +4,7 @@
 #include <QElapsedTimer>
 
 #include "rtspCapture.h"
+#include "pipelineMetrics.h"
 
 RTSPCapture::RTSPCapture(QString uri, FrameCircularBuffer *pFrameBuffer) :
     QObject(NULL),
@@ -14,7 +15,9 @@ RTSPCapture::RTSPCapture(QString uri, FrameCircularBuffer *pFrameBuffer) :
     m_pFrame(NULL),
     m_videoStreamIndex(0),
     m_readErrorNumber(0),
-    m_framesToSnapshot(0)
+    m_framesToSnapshot(0),
+    m_pActivityGate(NULL),
+    m_lastGateTime(0)
 {
     DataDirectory*            pDataDirectory = DataDirectoryInstance::instance();
 
@@ -29,6 +32,8 @@ RTSPCapture::~RTSPCapture()
 {
     DEBUG_MESSAGE0("RTSPCapture", "~RTSPCapture() called");
     SAFE_DELETE(m_pCaptureTimer);
+    SAFE_DELETE(m_pActivityGate);
+    m_skippedPackets.clear();
 
     if(NULL != m_pFrame)
     {
@@ -159,6 +164,7 @@ ErrorCode RTSPCapture::InitCapture()
     QUrl            testUrl(m_rtspUri);
     AVDictionary*   inputOptions(NULL);
     AVCodec*        pCodec;
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
 
     if(!testUrl.isValid())
     {
@@ -222,6 +228,9 @@ ErrorCode RTSPCapture::InitCapture()
     // Required for flv format output (to avoid "avc1/0x31637661 incompatible with output codec id 28")
     m_pInputContext->streams[m_videoStreamIndex]->codecpar->codec_tag = 0;
 
+    // Initial parameter sets (from SDP) should be known before muxers are opened
+    m_parameterSets.Reset(m_pInputContext->streams[m_videoStreamIndex]->codecpar);
+
     // Notify stream recorder, tha we have new codec context
     emit NewCodecParams(m_pInputContext->streams[m_videoStreamIndex]);
 
@@ -232,6 +241,16 @@ ErrorCode RTSPCapture::InitCapture()
         return CAMERA_PIPELINE_ERROR;
     }
 
+    // Analysis can sleep (keyframes only) while compressed stream shows no activity
+    SAFE_DELETE(m_pActivityGate);
+    if (m_doDecoding && pDataDirectory->analysisParams.activityGate)
+    {
+        m_pActivityGate = new ActivityGate(m_fps,
+                                           pDataDirectory->analysisParams.activitySleepSec,
+                                           pDataDirectory->analysisParams.activityWakeRatio,
+                                           pDataDirectory->analysisParams.activitySleepRatio);
+    }
+
     // Frame capturing performed on capture timers' timeout event
     // This made to prevent event loop blocking with while(1)
     // This timer should be created here, because InitCapture function
@@ -261,7 +280,7 @@ void RTSPCapture::CaptureNewFrame()
     {
         if (pPacket.data()->stream_index == m_videoStreamIndex)  // We need only video frames to be decoded
         {
-            if (m_doDecoding)
+            if (m_doDecoding && UpdateActivityGate(pPacket.data()))
             {
                 // Decode frame
                 sendRes = avcodec_send_packet(m_pCodecContext, pPacket.data());
@@ -278,7 +297,7 @@ void RTSPCapture::CaptureNewFrame()
                                    err1, err2);
                 }
             }
-            else
+            else if (!m_doDecoding)
             {
                 if (pPacket->flags & AV_PKT_FLAG_KEY)
                 {
@@ -292,6 +311,11 @@ void RTSPCapture::CaptureNewFrame()
                 m_framesToSnapshot--;
             }
 
+            if ((pPacket->flags & AV_PKT_FLAG_KEY) && m_parameterSets.Update(pPacket.data()))
+            {
+                DEBUG_MESSAGE1("RTSPCapture", "Stream parameter sets updated (version %d)", m_parameterSets.Version());
+            }
+
             pPacket->pos = QDateTime::currentMSecsSinceEpoch(); // Set server's timestamp to packet
 
             if (!m_stop)
@@ -346,7 +370,12 @@ void RTSPCapture::CaptureNewFrame()
             else
                 frameTime = av_q2d(av_inv_q(m_pInputContext->streams[m_videoStreamIndex]->avg_frame_rate)) * m_pFrame->display_picture_number;
 
-            m_pFrameBuffer->AddFrame(m_pFrame, frameTime);
+            // Timed metadata is aligned to video pts (best effort timestamp can be guessed from dts)
+            double presentationTime = frameTime;
+            if (m_pFrame->pts != AV_NOPTS_VALUE)
+                presentationTime = av_q2d(m_pInputContext->streams[m_videoStreamIndex]->time_base) * m_pFrame->pts;
+
+            m_pFrameBuffer->AddFrame(m_pFrame, frameTime, presentationTime);
         }
     }
 
@@ -369,6 +398,83 @@ void RTSPCapture::CaptureNewFrame()
     }
 }
 
+bool RTSPCapture::UpdateActivityGate(AVPacket* pPacket)
+{
+    if (NULL == m_pActivityGate)
+    {
+        return true;
+    }
+
+    PipelineMetrics*    pMetrics = PipelineMetrics::instance();
+    int64_t             currentTime = QDateTime::currentMSecsSinceEpoch();
+    bool                wasSleeping = m_pActivityGate->IsSleeping();
+    bool                isKey = (pPacket->flags & AV_PKT_FLAG_KEY);
+    bool                doDecode = m_pActivityGate->Update(pPacket, currentTime);
+
+    // Time spent in each state
+    if (m_lastGateTime > 0)
+    {
+        pMetrics->AddCounter(wasSleeping ? "capture_gate_sleep_seconds_total" : "capture_gate_active_seconds_total",
+                             (currentTime - m_lastGateTime) / 1000.0);
+    }
+    m_lastGateTime = currentTime;
+
+    pMetrics->SetGauge("capture_gate_sleeping", m_pActivityGate->IsSleeping() ? 1.0 : 0.0);
+    pMetrics->SetGauge("capture_gate_activity_ratio", m_pActivityGate->ActivityRatio());
+
+    if (wasSleeping != m_pActivityGate->IsSleeping())
+    {
+        ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "RTSPCapture", "Activity gate %s (activity ratio %.2f)",
+                       wasSleeping ? "woke up" : "went to sleep", m_pActivityGate->ActivityRatio());
+        pMetrics->AddCounter(wasSleeping ? "capture_gate_wakeups_total" : "capture_gate_sleeps_total");
+    }
+
+    if (isKey)
+    {
+        m_skippedPackets.clear();
+        return true;
+    }
+
+    if (!doDecode)
+    {
+        // Packet is kept, because decoder needs whole gop to continue from the middle of it
+        m_skippedPackets.append(QSharedPointer<AVPacket>(av_packet_clone(pPacket), [](AVPacket *pkt){av_packet_free(&pkt);}));
+        pMetrics->AddCounter("capture_gate_skipped_frames_total");
+
+        // Very long gop (or stream without keyframes) - memory is limited by decoding kept packets now
+        if (m_skippedPackets.size() >= GATE_MAX_SKIPPED_PACKETS)
+        {
+            DecodeSkippedPackets();
+        }
+        return false;
+    }
+
+    // Gate has just opened in the middle of gop - restore decoder state with skipped packets
+    if (!m_skippedPackets.isEmpty())
+    {
+        DEBUG_MESSAGE1("RTSPCapture", "Decoding %d skipped packets after wake up", m_skippedPackets.size());
+        DecodeSkippedPackets();
+    }
+    return true;
+}
+
+void RTSPCapture::DecodeSkippedPackets()
+{
+    while (!m_skippedPackets.isEmpty())
+    {
+        QSharedPointer<AVPacket> pSkipped = m_skippedPackets.takeFirst();
+
+        if (0 == avcodec_send_packet(m_pCodecContext, pSkipped.data()))
+        {
+            // Decoder can return several frames (or none) per packet, all are drained before next packet
+            while (0 == avcodec_receive_frame(m_pCodecContext, m_pFrame))
+            {
+                av_frame_unref(m_pFrame);
+            }
+        }
+    }
+}
+
 void RTSPCapture::StartCapture()
 {
     DEBUG_MESSAGE0("RTSPCapture", "StartCapture() called");
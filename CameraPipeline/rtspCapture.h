@@ -1,6 +1,7 @@
 #ifndef RTSPCAPTURE_H
 #define RTSPCAPTURE_H
 
+#include <QList>
 #include <QObject>
 #include <QTimer>
 
@@ -17,6 +18,8 @@ public:
 
     static int ProbeStreamParameters(const char *url, double* fps, int* w, int* h);
 
+    ParameterSetTracker*    ParameterSets() { return &m_parameterSets; }   /// Shared with all muxers of this stream
+
 signals:
     void    NewCodecParams(AVStream* pCodecParams);                 /// Signal about new input codec parameters
     void    NewPacketReceived(QSharedPointer<AVPacket> pPacket);    /// Signal that we have read new packet
@@ -51,9 +54,16 @@ private:
     int                     m_readErrorNumber;  /// Number of read frame error in a row
     bool                    m_stop;             /// Flag to exit from while loop
     int64_t                 m_framesToSnapshot; /// Number of frames left to next snapshot
+    ParameterSetTracker     m_parameterSets;    /// SPS/PPS (VPS) of input stream
+
+    ActivityGate*           m_pActivityGate;    /// Decoding of inter frames is skipped in static periods (NULL if disabled)
+    QList<QSharedPointer<AVPacket> > m_skippedPackets; /// Not decoded packets since last keyframe (to restore decoder on wake up)
+    int64_t                 m_lastGateTime;     /// Time of previous gate update (for state time metrics)
 
     ErrorCode   InitCapture();                      /// All init and allocation AVLib routines
     ErrorCode   DecodeSingleKey(AVPacket *pPacket); /// Decode keyframe time-to-time to create snapshot
+    bool        UpdateActivityGate(AVPacket* pPacket);  /// Returns true if packet should be decoded
+    void        DecodeSkippedPackets();                 /// Feed skipped packets to decoder (frames are dropped)
 };
 
 #endif // RTSPCAPTURE_H
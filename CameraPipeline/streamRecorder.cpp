@@ -2,15 +2,25 @@
 #include <QMutex>
 #include <QtConcurrent/QtConcurrent>
 #include "streamRecorder.h"
+#include "pipelineMetrics.h"
 
 StreamRecorder::StreamRecorder() :
     QObject(NULL),
     m_firstDts(AV_NOPTS_VALUE),
     m_fileOpened(false),
     m_needStartNewFile(false),
+    m_pIntervalTimer(NULL),
     m_pCodecParams(NULL),
     m_pFormatCtx(NULL),
-    m_pVideoStream(NULL)
+    m_pVideoStream(NULL),
+    m_pParameterSets(NULL),
+    m_pPacketBuffer(NULL),
+    m_pFileWriter(NULL),
+    m_archiveBytesPerSec(0),
+    m_fileStartTime(0),
+    m_lastPacketTime(0),
+    m_hasPendingKeyframe(false),
+    m_recordUntil(0)
 {
 
 }
@@ -32,6 +42,7 @@ StreamRecorder::~StreamRecorder()
 
     SAFE_DELETE(m_pIntervalTimer);
     SAFE_DELETE(m_pPacketBuffer);
+    SAFE_DELETE(m_pFileWriter);
     DEBUG_MESSAGE0("StreamRecorder", "~StreamRecorder() finished");
 }
 
@@ -55,7 +66,15 @@ void StreamRecorder::Open()
     m_shortNamePattern += pDataDirectory->pipelineParams.pipelineName;
     m_shortNamePattern += "_%time%.mp4";
 
-    m_pPacketBuffer = new PacketBuffer();
+    m_pPacketBuffer = new PacketBuffer(m_pParameterSets);
+
+    // Moving data for faststart needs archive file to be read back while it is written, so async writer
+    // is used only for fragmented archive
+    if (pDataDirectory->recordParams.asyncWriter && pDataDirectory->recordParams.fragmentedArchive)
+    {
+        m_pFileWriter = new ArchiveFileWriter(pDataDirectory->recordParams.writeBlockKB,
+                                              pDataDirectory->recordParams.writeQueueBlocks);
+    }
 }
 
 void StreamRecorder::Close()
@@ -78,6 +97,7 @@ void StreamRecorder::Close()
 
     SAFE_DELETE(m_pIntervalTimer);
     SAFE_DELETE(m_pPacketBuffer);
+    SAFE_DELETE(m_pFileWriter);
     DEBUG_MESSAGE0("StreamRecorder", "Close() finished");
 }
 
@@ -92,16 +112,10 @@ void StreamRecorder::CopyCodecParameters(AVStream* pVideoStream)
     m_inputTimebase = pVideoStream->time_base;
 
     // Same for PacketBuffer
-    if (NULL != m_pPacketBuffer->inputCodecParams)
-    {
-        avcodec_parameters_free(&m_pPacketBuffer->inputCodecParams);
-    }
-    m_pPacketBuffer->inputCodecParams = avcodec_parameters_alloc();
-    avcodec_parameters_copy(m_pPacketBuffer->inputCodecParams, pVideoStream->codecpar);
-    m_pPacketBuffer->inputTimeBase = pVideoStream->time_base;
+    m_pPacketBuffer->SetCodecParameters(pVideoStream);
 }
 
-void StreamRecorder::StartFile(QString startTime)
+void StreamRecorder::StartFile(QString startTime, AVPacket* pKeyPacket)
 {
     DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
 
@@ -132,6 +146,7 @@ void StreamRecorder::StartFile(QString startTime)
         if (NULL == m_pVideoStream)
         {
             ERROR_MESSAGE0(ERR_TYPE_ERROR, "StreamRecorder", "avformat_new_stream() failed");
+            AbortFile(fileName);
             return;
         }
 
@@ -141,11 +156,31 @@ void StreamRecorder::StartFile(QString startTime)
         if (0 > avcodec_parameters_copy(m_pVideoStream->codecpar, m_pCodecParams))
         {
             ERROR_MESSAGE0(ERR_TYPE_ERROR, "StreamRecorder", "avcodec_parameters_copy() failed");
+            AbortFile(fileName);
             return;
         }
 
+        // Parameter sets should be known before header is written (moov is written at the beginning for fragmented mp4)
+        if (NULL != m_pParameterSets)
+        {
+            m_pParameterSets->ApplyTo(m_pVideoStream->codecpar);
+        }
+
         // Open output file, if it is allowed by format
-        if (!(m_pFormatCtx->oformat->flags & AVFMT_NOFILE))
+        if (NULL != m_pFileWriter)
+        {
+            // Preallocate the whole segment according to observed bitrate (10% reserve)
+            qint64 expectedSize = (qint64)(m_archiveBytesPerSec * pDataDirectory->pipelineParams.processingIntervalSec * 1.1);
+
+            if (CAMERA_PIPELINE_OK != m_pFileWriter->Open(fileName, expectedSize))
+            {
+                AbortFile(fileName);
+                return;
+            }
+            m_pFormatCtx->pb = m_pFileWriter->IoContext();
+            m_pFormatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+        else if (!(m_pFormatCtx->oformat->flags & AVFMT_NOFILE))
         {
             int res = avio_open(&m_pFormatCtx->pb, fileName.toUtf8().constData(), AVIO_FLAG_WRITE);
             if (res < 0)
@@ -154,25 +189,59 @@ void StreamRecorder::StartFile(QString startTime)
                 av_make_error_string(err, 255, res);
                 ERROR_MESSAGE2(ERR_TYPE_ERROR, "StreamRecorder", "avio_open() failed for %s: %s",
                                fileName.toUtf8().constData(), err);
+                AbortFile(fileName);
                 return;
             }
         }
 
-        // Moov atom for mp4 fast playback start.
         AVDictionary* opts(0);
-        av_dict_set(&opts, "movflags", "faststart", 0);
 
-        if (0 > avformat_write_header(m_pFormatCtx, &opts))
+        if (pDataDirectory->recordParams.fragmentedArchive)
         {
-            ERROR_MESSAGE0(ERR_TYPE_ERROR, "RTSPCapture", "avformat_write_header() failed");
-            return;
+            // Empty moov at the beginning and self-contained fragments (moof+mdat) for each gop.
+            // File is playable while it is written and closing it doesn't require rewriting
+            av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+            if (pDataDirectory->recordParams.fragmentDurationMs > 0)
+            {
+                av_dict_set_int(&opts, "frag_duration", (int64_t)pDataDirectory->recordParams.fragmentDurationMs * 1000, 0);
+            }
+        }
+        else
+        {
+            // Moov atom for mp4 fast playback start.
+            av_dict_set(&opts, "movflags", "faststart", 0);
         }
+
+        int res = avformat_write_header(m_pFormatCtx, &opts);
         av_dict_free(&opts);
+        if (0 > res)
+        {
+            ERROR_MESSAGE0(ERR_TYPE_ERROR, "StreamRecorder", "avformat_write_header() failed");
+            AbortFile(fileName);
+            return;
+        }
+
+        // Start keyframe index for new segment
+        m_indexWriter.Open(fileName, pKeyPacket->pos);
+        m_hasPendingKeyframe = false;
+        m_unwrittenKeyframes.clear();
+
+        ArchiveSegmentIndex segmentIndex;
+        segmentIndex.shortFileName = shortFileName;
+        segmentIndex.filePath = fileName;
+        segmentIndex.startTime = pKeyPacket->pos;
+        m_archiveIndex.append(segmentIndex);
+        while (m_archiveIndex.size() > ARCHIVE_INDEX_SEGMENTS)
+        {
+            m_archiveIndex.removeFirst();
+        }
 
         // Inform all subscribers, that we started new archive file
         emit NewFileOpened(shortFileName);
 
         m_fileOpened = true;
+        m_fileStartTime = pKeyPacket->pos;
+        m_lastPacketTime = pKeyPacket->pos;
         m_firstDts = AV_NOPTS_VALUE;
         m_needStartNewFile = false;
         DEBUG_MESSAGE0("StreamRecorder", "StartFile() finished. File opened for writing");
@@ -184,16 +253,38 @@ void StreamRecorder::CloseFile()
     DEBUG_MESSAGE0("StreamRecorder", "CloseFile() called");
     if (m_fileOpened)
     {
-        // Free extradata memory
-        if (NULL != m_pFormatCtx->streams[0]->codecpar->extradata)
+        // Write format trailer
+        av_write_trailer(m_pFormatCtx);
+
+        if (m_pFormatCtx->flags & AVFMT_FLAG_CUSTOM_IO)
         {
-            free(m_pFormatCtx->streams[0]->codecpar->extradata);
-            m_pFormatCtx->streams[0]->codecpar->extradata = NULL;
+            m_pFileWriter->Close();
+            m_pFormatCtx->pb = NULL;
+
+            // Bitrate estimation for the next segment preallocation
+            if (m_lastPacketTime - m_fileStartTime >= 1000)
+            {
+                m_archiveBytesPerSec = m_pFileWriter->FileSize() * 1000.0 / (m_lastPacketTime - m_fileStartTime);
+            }
+        }
+        else
+        {
+            avio_closep(&m_pFormatCtx->pb);
         }
 
-        // Write format trailer
-        av_write_trailer(m_pFormatCtx);
-        avio_closep(&m_pFormatCtx->pb);
+        // All gops are in file now (all data is written by file close)
+        while (!m_unwrittenKeyframes.isEmpty())
+        {
+            PendingKeyframe pending = m_unwrittenKeyframes.dequeue();
+            m_indexWriter.Append(pending.serverTime, pending.keyFrame);
+        }
+        if (m_hasPendingKeyframe)
+        {
+            m_indexWriter.Append(m_pendingKeyframe.serverTime, m_pendingKeyframe.keyFrame);
+            m_hasPendingKeyframe = false;
+        }
+        m_indexWriter.Close();
+
         // Free output context
         avformat_free_context(m_pFormatCtx);
         m_pFormatCtx = NULL;
@@ -202,6 +293,31 @@ void StreamRecorder::CloseFile()
     }
 }
 
+void StreamRecorder::AbortFile(QString fileName)
+{
+    if (NULL != m_pFormatCtx)
+    {
+        if (m_pFormatCtx->flags & AVFMT_FLAG_CUSTOM_IO)
+        {
+            m_pFileWriter->Close();
+            m_pFormatCtx->pb = NULL;
+        }
+        else
+        {
+            avio_closep(&m_pFormatCtx->pb);
+        }
+
+        avformat_free_context(m_pFormatCtx);
+        m_pFormatCtx = NULL;
+    }
+
+    // File without header is not playable (and preallocated space is released)
+    QFile::remove(fileName);
+
+    m_pVideoStream = NULL;
+    m_fileOpened = false;
+}
+
 void StreamRecorder::IntervalStarted(QDateTime currentTime)
 {
     Q_UNUSED(currentTime);
@@ -226,29 +342,203 @@ void StreamRecorder::WritePacket(QSharedPointer<AVPacket> pInPacket)
     // Check, if we have keyframe and need to start new file
     m_pIntervalTimer->Tick(curDateTime);
 
-    if ((pInPacket->flags & AV_PKT_FLAG_KEY) && m_needStartNewFile)
+    bool recording = IsRecording(pInPacket->pos);
+
+    if ((pInPacket->flags & AV_PKT_FLAG_KEY) && m_needStartNewFile && recording)
     {
         CloseFile();
-        StartFile(curDateTime.toString("dd_MM_yyyy___HH_mm_ss"));
-        FillSPSPPS(m_pFormatCtx->streams[0]->codecpar, pInPacket.data());
+        StartFile(curDateTime.toString("dd_MM_yyyy___HH_mm_ss"), pInPacket.data());
         m_firstDts = pInPacket->dts;
     }
 
+    // Post-roll is over (event recording mode)
+    if (!recording && m_fileOpened)
+    {
+        CloseFile();
+        m_needStartNewFile = true;
+    }
+
     if (m_fileOpened)
     {
-        AVPacket* pPacket = av_packet_clone(pInPacket.data());
-        pPacket->pts -= m_firstDts;
-        pPacket->dts -= m_firstDts;
-        pPacket->stream_index = 0; // Default video stream index
-        av_packet_rescale_ts(pPacket, m_inputTimebase, m_pVideoStream->time_base);
-        int res = av_interleaved_write_frame(m_pFormatCtx, pPacket);
-        av_packet_free(&pPacket);
-        if (res < 0)
+        WriteToFile(pInPacket.data());
+    }
+}
+
+void StreamRecorder::WriteToFile(AVPacket* pInPacket)
+{
+    m_lastPacketTime = pInPacket->pos;
+
+    AVPacket* pPacket = av_packet_clone(pInPacket);
+    pPacket->pts -= m_firstDts;
+    pPacket->dts -= m_firstDts;
+    pPacket->stream_index = 0; // Default video stream index
+    av_packet_rescale_ts(pPacket, m_inputTimebase, m_pVideoStream->time_base);
+    int64_t mediaMs = av_rescale_q(pPacket->dts, m_pVideoStream->time_base, av_make_q(1, 1000));
+    int res = av_interleaved_write_frame(m_pFormatCtx, pPacket);
+    av_packet_free(&pPacket);
+    if (res < 0)
+    {
+        ERROR_MESSAGE0(ERR_TYPE_ERROR, "StreamRecorder", "av_interleaved_write_frame() failed");
+        return;
+    }
+
+    if ((pInPacket->flags & AV_PKT_FLAG_KEY) && !m_archiveIndex.isEmpty())
+    {
+        ArchiveKeyframe keyFrame;
+
+        // Previous fragment is flushed by muxer when keyframe arrives,
+        // so current position is the beginning of the fragment started from this keyframe
+        keyFrame.mediaMs = mediaMs;
+        keyFrame.byteOffset = DataDirectoryInstance::instance()->recordParams.fragmentedArchive ? avio_tell(m_pFormatCtx->pb) : -1;
+        m_archiveIndex.last().keyFrames.insert(pInPacket->pos, keyFrame);
+
+        // Previous gop is completely muxed and ends here, its keyframe is added to sidecar index
+        // only when the gop data is actually in file
+        if (m_hasPendingKeyframe)
         {
-            ERROR_MESSAGE0(ERR_TYPE_ERROR, "StreamRecorder", "av_interleaved_write_frame() failed");
-            return;
+            m_pendingKeyframe.fragmentEnd = avio_tell(m_pFormatCtx->pb);
+            m_unwrittenKeyframes.enqueue(m_pendingKeyframe);
         }
+        m_hasPendingKeyframe = true;
+        m_pendingKeyframe.serverTime = pInPacket->pos;
+        m_pendingKeyframe.keyFrame = keyFrame;
+        m_pendingKeyframe.fragmentEnd = -1;
+    }
+
+    AppendWrittenKeyframes();
+}
+
+qint64 StreamRecorder::WrittenBytes()
+{
+    // Async writer: muxer output can be still queued for I/O thread
+    if (m_pFormatCtx->flags & AVFMT_FLAG_CUSTOM_IO)
+    {
+        return m_pFileWriter->WrittenOffset();
     }
+
+    // Default avio: data before avio buffer is written
+    return m_pFormatCtx->pb->error ? 0 : m_pFormatCtx->pb->pos;
+}
+
+void StreamRecorder::AppendWrittenKeyframes()
+{
+    if (m_unwrittenKeyframes.isEmpty())
+    {
+        return;
+    }
+
+    qint64 writtenBytes = WrittenBytes();
+
+    while (!m_unwrittenKeyframes.isEmpty() && m_unwrittenKeyframes.head().fragmentEnd <= writtenBytes)
+    {
+        PendingKeyframe pending = m_unwrittenKeyframes.dequeue();
+        m_indexWriter.Append(pending.serverTime, pending.keyFrame);
+    }
+}
+
+bool StreamRecorder::IsRecording(int64_t packetTime)
+{
+    if (!DataDirectoryInstance::instance()->recordParams.eventRecording)
+    {
+        return true;
+    }
+    return !m_activeEvents.isEmpty() || packetTime <= m_recordUntil;
+}
+
+void StreamRecorder::StartEventRecording(EventDescription event)
+{
+    DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
+
+    if (!pDataDirectory->recordParams.eventRecording)
+    {
+        return;
+    }
+
+    m_activeEvents.insert(event.id);
+
+    // Archive is still open (event started during post-roll of previous one)
+    if (m_fileOpened || NULL == m_pCodecParams)
+    {
+        return;
+    }
+
+    // Pre-roll is taken from packet buffer, starting from keyframe
+    int64_t prerollStart = event.startTime.toMSecsSinceEpoch() - (int64_t)pDataDirectory->recordParams.eventPrerollSec * 1000;
+    QVector<QSharedPointer<AVPacket> > packets = m_pPacketBuffer->TakeSnapshot(prerollStart, INT64_MAX);
+
+    // Buffer is shorter than pre-roll - start from the last keyframe before event
+    if (packets.isEmpty())
+    {
+        packets = m_pPacketBuffer->TakeSnapshot(event.startTime.toMSecsSinceEpoch(), INT64_MAX);
+    }
+
+    if (packets.isEmpty())
+    {
+        // No keyframe in buffer yet - file will be started on the next one
+        m_needStartNewFile = true;
+        return;
+    }
+
+    QDateTime firstTime = QDateTime::fromMSecsSinceEpoch(packets.first()->pos);
+
+    CloseFile();
+    StartFile(firstTime.toString("dd_MM_yyyy___HH_mm_ss"), packets.first().data());
+    m_firstDts = packets.first()->dts;
+
+    if (m_fileOpened)
+    {
+        Q_FOREACH (const QSharedPointer<AVPacket>& pPacket, packets)
+        {
+            WriteToFile(pPacket.data());
+        }
+    }
+
+    DEBUG_MESSAGE2("StreamRecorder", "Event %d recording started with %d pre-roll packets", event.id, packets.size());
+}
+
+void StreamRecorder::StopEventRecording(EventDescription event)
+{
+    DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
+
+    if (!pDataDirectory->recordParams.eventRecording || !m_activeEvents.remove(event.id))
+    {
+        return;
+    }
+
+    // File is closed by WritePacket, when post-roll of the last active event is over
+    int64_t endTime = event.endTime.isValid() ? event.endTime.toMSecsSinceEpoch() : QDateTime::currentMSecsSinceEpoch();
+
+    m_recordUntil = qMax(m_recordUntil, endTime + (int64_t)pDataDirectory->recordParams.eventPostrollSec * 1000);
+}
+
+bool StreamRecorder::FindArchiveReference(EventDescription& event)
+{
+    int64_t startTime = event.startTime.toMSecsSinceEpoch();
+
+    for (int i = m_archiveIndex.size() - 1; i >= 0; i--)
+    {
+        const ArchiveSegmentIndex& segment = m_archiveIndex[i];
+
+        if (segment.startTime > startTime || segment.keyFrames.isEmpty())
+        {
+            continue;
+        }
+
+        // Last keyframe before event start
+        QMap<int64_t, ArchiveKeyframe>::const_iterator it = segment.keyFrames.upperBound(startTime);
+        if (it != segment.keyFrames.constBegin())
+        {
+            --it;
+        }
+
+        event.clipFileName = segment.shortFileName;
+        event.clipOffsetMs = it.value().mediaMs;
+        event.clipByteOffset = it.value().byteOffset;
+        event.archiveStartTime = segment.startTime;
+        event.offset = (startTime - segment.startTime) / 1000;
+        return true;
+    }
+    return false;
 }
 
 void StreamRecorder::WriteEventFile(EventDescription event)
@@ -264,7 +554,13 @@ void StreamRecorder::WriteEventFile(EventDescription event)
 
     DEBUG_MESSAGE1("StreamRecorder", "WriteEventFile() called. File name: %s", videoPath.toUtf8().constData());
 
-    m_pPacketBuffer->EnqueueWrite10SecFile(event.startTime.toMSecsSinceEpoch(), videoPath);
+    // Event references archive range. Separate clip is written only if requested or if archive is not available
+    if (!FindArchiveReference(event) || pDataDirectory->recordParams.eventClipCopy)
+    {
+        m_pPacketBuffer->EnqueueWrite10SecFile(event.startTime.toMSecsSinceEpoch(), videoPath);
+    }
+
+    emit EventArchived(event);
 }
 
 
@@ -281,28 +577,157 @@ void StreamRecorder::WriteEventFile(EventDescription event)
 //------------------------------------------------------------
 //------------------------------------------------------------
 
-PacketBuffer::PacketBuffer()
+PacketBuffer::PacketBuffer(ParameterSetTracker* pParameterSets) :
+    m_pParameterSets(pParameterSets)
 {
-    inputCodecParams = NULL;
-    m_currentIndex = 0;
+    DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
+
+    m_pCodecParams = NULL;
+    m_firstSequence = 0;
     m_packetsWritten = 0;
-    m_bufferSize = PACKET_BUFFER_SECONDS * 30; // Assuming 30 fps is maximum that we will have
-    m_pPackets.resize(m_bufferSize);
-    m_pPackets.setSharable(true);
+    m_memoryBytes = 0;
+    m_maxMemoryBytes = (qint64)pDataDirectory->recordParams.prerollBufferMB * 1024 * 1024;
+    m_maxMemoryMs = (int64_t)pDataDirectory->recordParams.prerollBufferSec * 1000;
+    m_memoryTruncated = false;
+
+    m_spilledFirstSequence = 0;
+    m_currentSpillFile = 0;
+    m_maxSpillMs = (int64_t)pDataDirectory->recordParams.prerollSpillSec * 1000;
+    m_spillBytes = 0;
+    m_spillReaders = 0;
+
+    for (int i = 0; i < PREROLL_SPILL_FILES; i++)
+    {
+        m_spillFileStart[i] = -1;
+    }
+
+    if (m_maxSpillMs > 0)
+    {
+        OpenSpillFiles();
+    }
 }
 
 PacketBuffer::~PacketBuffer()
 {
-    avcodec_parameters_free(&inputCodecParams);
-    m_pPackets.clear();
+    avcodec_parameters_free(&m_pCodecParams);
+    m_packets.clear();
+
+    for (int i = 0; i < PREROLL_SPILL_FILES; i++)
+    {
+        if (m_spillFiles[i].isOpen())
+        {
+            m_spillFiles[i].remove();
+        }
+    }
+}
+
+void PacketBuffer::OpenSpillFiles()
+{
+    DataDirectory* pDataDirectory = DataDirectoryInstance::instance();
+
+    QString path = pDataDirectory->recordParams.prerollSpillPath;
+
+    if (path.isEmpty())
+    {
+        path = pDataDirectory->pipelineParams.archivePath + '/' + pDataDirectory->pipelineParams.pipelineName;
+    }
+    QDir().mkpath(path);
+
+    for (int i = 0; i < PREROLL_SPILL_FILES; i++)
+    {
+        m_spillFiles[i].setFileName(QString("%1/%2_preroll%3.bin").arg(path).arg(pDataDirectory->pipelineParams.pipelineName).arg(i));
+        if (!m_spillFiles[i].open(QIODevice::ReadWrite | QIODevice::Truncate))
+        {
+            ERROR_MESSAGE1(ERR_TYPE_ERROR, "StreamRecorder::PacketBuffer",
+                           "Cannot open preroll spill file %s. Spill disabled", m_spillFiles[i].fileName().toUtf8().constData());
+            m_maxSpillMs = 0;
+            return;
+        }
+    }
+
+    ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "StreamRecorder::PacketBuffer",
+                   "Preroll spill enabled for %d sec in %s", (int)(m_maxSpillMs / 1000), path.toUtf8().constData());
+}
+
+void PacketBuffer::SetCodecParameters(AVStream* pVideoStream)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (NULL != m_pCodecParams)
+    {
+        avcodec_parameters_free(&m_pCodecParams);
+    }
+    m_pCodecParams = avcodec_parameters_alloc();
+    avcodec_parameters_copy(m_pCodecParams, pVideoStream->codecpar);
+    m_inputTimeBase = pVideoStream->time_base;
 }
 
 void PacketBuffer::AddPacket(QSharedPointer<AVPacket> pPacket)
 {
-    m_pPackets[m_currentIndex] = QSharedPointer<AVPacket>(av_packet_clone(pPacket.data()), [](AVPacket *pkt){av_packet_free(&pkt);});
-    m_currentIndex = (m_currentIndex + 1) % m_bufferSize;
+    QSharedPointer<AVPacket> pClone(av_packet_clone(pPacket.data()), [](AVPacket *pkt){av_packet_free(&pkt);});
+
+    m_mutex.lock();
+
+    m_packets.append(pClone);
+    m_memoryBytes += pClone->size;
+
+    if (pPacket->flags & AV_PKT_FLAG_KEY)
+    {
+        m_keyFrames.insert(m_packetsWritten, pPacket->pos);
+    }
     m_packetsWritten++;
 
+    // Evict oldest gops, while budgets are exceeded.
+    // The newest complete gop before the current one is always kept (event start can be in it)
+    bool evicted = false;
+    bool truncated = false;
+
+    while (!m_keyFrames.isEmpty())
+    {
+        // The first keyframe after the oldest gop in memory
+        QMap<int64_t, int64_t>::const_iterator it = m_keyFrames.upperBound(m_firstSequence);
+
+        if (it == m_keyFrames.constEnd() || it.key() >= m_keyFrames.lastKey())
+        {
+            break;
+        }
+
+        // Time budget is kept in memory even after eviction
+        bool overTime = (m_packets.last()->pos - it.value()) >= m_maxMemoryMs;
+        bool overMemory = (m_memoryBytes > m_maxMemoryBytes);
+
+        if (!overTime && !overMemory)
+        {
+            break;
+        }
+        evicted = true;
+        truncated = truncated || (!overTime && m_maxSpillMs <= 0);     // Spilled gops are still available
+        EvictGop(it.key());
+    }
+
+    if (pPacket->flags & AV_PKT_FLAG_KEY)
+    {
+        UpdateMetrics();
+    }
+
+    // Memory budget is too small for configured time (high bitrate stream)
+    if (truncated && !m_memoryTruncated)
+    {
+        int64_t memoryMs = m_packets.last()->pos - m_packets.first()->pos;
+
+        ERROR_MESSAGE4(ERR_TYPE_WARNING, "StreamRecorder::PacketBuffer",
+                       "Preroll is truncated to %d sec by memory budget %d MB (%d sec requested, ~%d MB needed)",
+                       (int)(memoryMs / 1000), (int)(m_maxMemoryBytes >> 20), (int)(m_maxMemoryMs / 1000),
+                       (int)((memoryMs > 0) ? ((m_memoryBytes * m_maxMemoryMs / memoryMs) >> 20) + 1 : 0));
+        PipelineMetrics::instance()->AddCounter("preroll_truncated_total");
+    }
+    if (evicted)
+    {
+        m_memoryTruncated = truncated;
+    }
+
+    m_mutex.unlock();
+
     // Check, if we have enough packets to write next 10sec file
     if (!m_startTimeQueue.empty())
     {
@@ -317,39 +742,282 @@ void PacketBuffer::AddPacket(QSharedPointer<AVPacket> pPacket)
     }
 }
 
+void PacketBuffer::EvictGop(int64_t nextKeySequence)
+{
+    bool spill = (m_maxSpillMs > 0);
+
+    if (spill)
+    {
+        RotateSpillFiles(m_packets.first()->pos);
+    }
+
+    while (m_firstSequence < nextKeySequence)
+    {
+        QSharedPointer<AVPacket> pPacket = m_packets.takeFirst();
+
+        m_memoryBytes -= pPacket->size;
+        if (spill && !SpillPacket(pPacket, m_firstSequence))
+        {
+            // Spill file write error. Continue with memory buffer only
+            DropSpilledPackets();
+            m_maxSpillMs = 0;
+            spill = false;
+        }
+        m_firstSequence++;
+    }
+
+    if (spill)
+    {
+        m_spillFiles[m_currentSpillFile].flush();
+    }
+
+    // Remove index entries for dropped packets
+    int64_t firstAvailable = m_spilled.isEmpty() ? m_firstSequence : m_spilledFirstSequence;
+    while (!m_keyFrames.isEmpty() && m_keyFrames.firstKey() < firstAvailable)
+    {
+        m_keyFrames.erase(m_keyFrames.begin());
+    }
+
+    PipelineMetrics::instance()->AddCounter("preroll_gops_evicted_total");
+}
+
+bool PacketBuffer::SpillPacket(const QSharedPointer<AVPacket>& pPacket, int64_t sequence)
+{
+    QFile&          file = m_spillFiles[m_currentSpillFile];
+    SpilledPacket   spilled;
+    QByteArray      prefix;
+
+    // Clips can start from any spilled keyframe, so it carries parameter sets (if stream does not)
+    if ((pPacket->flags & AV_PKT_FLAG_KEY) && NULL != m_pParameterSets)
+    {
+        prefix = m_pParameterSets->KeyframePrefix();
+    }
+
+    spilled.pos = pPacket->pos;
+    spilled.pts = pPacket->pts;
+    spilled.dts = pPacket->dts;
+    spilled.duration = pPacket->duration;
+    spilled.flags = pPacket->flags;
+    spilled.size = prefix.size() + pPacket->size;
+    spilled.file = m_currentSpillFile;
+    spilled.offset = file.pos();
+
+    if (file.write(prefix) != prefix.size() ||
+        file.write((const char *)pPacket->data, pPacket->size) != pPacket->size)
+    {
+        ERROR_MESSAGE1(ERR_TYPE_ERROR, "StreamRecorder::PacketBuffer",
+                       "Preroll spill file write error: %s. Spill disabled", file.errorString().toUtf8().constData());
+        return false;
+    }
+
+    if (m_spilled.isEmpty())
+    {
+        m_spilledFirstSequence = sequence;
+    }
+    if (m_spillFileStart[m_currentSpillFile] < 0)
+    {
+        m_spillFileStart[m_currentSpillFile] = spilled.pos;
+    }
+
+    m_spilled.append(spilled);
+    m_spillBytes += spilled.size;
+    return true;
+}
+
+void PacketBuffer::RotateSpillFiles(int64_t gopStartTime)
+{
+    int64_t currentStart = m_spillFileStart[m_currentSpillFile];
+
+    // Rotate, when current file covers the whole spill period (older file is not needed any more)
+    if (currentStart < 0 || (gopStartTime - currentStart) < m_maxSpillMs || m_spillReaders > 0)
+    {
+        return;
+    }
+
+    int next = (m_currentSpillFile + 1) % PREROLL_SPILL_FILES;
+
+    while (!m_spilled.isEmpty() && m_spilled.first().file == next)
+    {
+        m_spillBytes -= m_spilled.first().size;
+        m_spilled.removeFirst();
+        m_spilledFirstSequence++;
+    }
+
+    m_spillFiles[next].resize(0);
+    m_spillFiles[next].seek(0);
+    m_spillFileStart[next] = -1;
+    m_currentSpillFile = next;
+}
+
+void PacketBuffer::DropSpilledPackets()
+{
+    m_spilled.clear();
+    m_spillBytes = 0;
+
+    for (int i = 0; i < PREROLL_SPILL_FILES; i++)
+    {
+        m_spillFileStart[i] = -1;
+    }
+}
+
+void PacketBuffer::UpdateMetrics()
+{
+    PipelineMetrics* pMetrics = PipelineMetrics::instance();
+
+    pMetrics->SetGauge("preroll_memory_bytes", m_memoryBytes);
+    pMetrics->SetGauge("preroll_memory_budget_bytes", m_maxMemoryBytes);
+    pMetrics->SetGauge("preroll_memory_ms", m_packets.last()->pos - m_packets.first()->pos);
+    pMetrics->SetGauge("preroll_memory_budget_ms", m_maxMemoryMs);
+    pMetrics->SetGauge("preroll_spill_bytes", m_spillBytes);
+    pMetrics->SetGauge("preroll_spill_ms", m_spilled.isEmpty() ? 0 : m_packets.first()->pos - m_spilled.first().pos);
+    pMetrics->SetGauge("preroll_spill_budget_ms", m_maxSpillMs);
+}
+
 void PacketBuffer::EnqueueWrite10SecFile(int64_t startTime, QString fileName)
 {
     m_startTimeQueue.push_back(startTime);
     m_fileNamesQueue.push_back(fileName);
 }
 
-void PacketBuffer::Write10SecFile(int64_t startTime, QString fileName)
+QSharedPointer<AVPacket> PacketBuffer::ReadSpilledPacket(QFile& file, const SpilledPacket& spilled)
 {
-    AVFormatContext*  pFormatCtx = NULL;
-    AVStream*         pStream = NULL;
+    QSharedPointer<AVPacket> pPacket(av_packet_alloc(), [](AVPacket *pkt){av_packet_free(&pkt);});
 
-    int  k = 0;
-    bool keyFound = false;
-    int  packetIndex = (m_currentIndex > 0) ? m_currentIndex - 1 : m_bufferSize - 1;
+    if (0 > av_new_packet(pPacket.data(), spilled.size))
+    {
+        return QSharedPointer<AVPacket>();
+    }
 
-    // Find start index in buffer
-    while (k < (m_bufferSize - 1))
+    if (!file.seek(spilled.offset) || file.read((char *)pPacket->data, spilled.size) != spilled.size)
     {
-        if ((m_pPackets[packetIndex]->pos <= startTime) &&
-            (m_pPackets[packetIndex]->flags & AV_PKT_FLAG_KEY))
+        return QSharedPointer<AVPacket>();
+    }
+
+    pPacket->pos = spilled.pos;
+    pPacket->pts = spilled.pts;
+    pPacket->dts = spilled.dts;
+    pPacket->duration = spilled.duration;
+    pPacket->flags = spilled.flags;
+    return pPacket;
+}
+
+QVector<QSharedPointer<AVPacket> > PacketBuffer::TakeSnapshot(int64_t startTime, int64_t durationMs)
+{
+    QVector<QSharedPointer<AVPacket> > packets;
+    QVector<QSharedPointer<AVPacket> > memoryPackets;
+    QList<SpilledPacket>               spilledPackets;
+    QString                            spillFileNames[PREROLL_SPILL_FILES];
+
+    m_mutex.lock();
+
+    // Last keyframe with time <= startTime (searched from the newest one)
+    QMap<int64_t, int64_t>::const_iterator it = m_keyFrames.constEnd();
+    bool found = false;
+
+    while (!found && it != m_keyFrames.constBegin())
+    {
+        --it;
+        found = (it.value() <= startTime);
+    }
+
+    if (!found)
+    {
+        m_mutex.unlock();
+        return packets;
+    }
+
+    int64_t firstMillis = it.value();
+
+    for (int64_t sequence = it.key(); sequence < m_packetsWritten; sequence++)
+    {
+        if (sequence < m_firstSequence)
         {
-            keyFound = true;
-            break;
+            const SpilledPacket& spilled = m_spilled[sequence - m_spilledFirstSequence];
+
+            if (spilled.pos - firstMillis >= durationMs)
+            {
+                break;
+            }
+            spilledPackets.append(spilled);
+        }
+        else
+        {
+            const QSharedPointer<AVPacket>& pPacket = m_packets[sequence - m_firstSequence];
+
+            if (pPacket->pos - firstMillis >= durationMs)
+            {
+                break;
+            }
+            memoryPackets.append(pPacket);
         }
-        // Navigate backward in circular buffer
-        packetIndex = (packetIndex > 0) ? packetIndex - 1 : m_bufferSize - 1;
-        k++;
     }
 
-    if (!keyFound) // In theory we should never get here
+    if (!spilledPackets.isEmpty())
+    {
+        m_spillReaders++;
+        for (int i = 0; i < PREROLL_SPILL_FILES; i++)
+        {
+            spillFileNames[i] = m_spillFiles[i].fileName();
+        }
+    }
+
+    m_mutex.unlock();
+
+    // Spilled packets are read without lock (files are not rotated until reading is finished)
+    if (!spilledPackets.isEmpty())
+    {
+        QFile files[PREROLL_SPILL_FILES];
+
+        for (int i = 0; i < PREROLL_SPILL_FILES; i++)
+        {
+            files[i].setFileName(spillFileNames[i]);
+            files[i].open(QIODevice::ReadOnly);
+        }
+
+        for (int i = 0; i < spilledPackets.size(); i++)
+        {
+            QSharedPointer<AVPacket> pPacket = ReadSpilledPacket(files[spilledPackets[i].file], spilledPackets[i]);
+
+            if (pPacket.isNull())
+            {
+                // Fall back to packets in memory (they always start from keyframe if something was spilled)
+                ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StreamRecorder::PacketBuffer",
+                               "Failed to read packets from preroll spill file");
+                packets.clear();
+                break;
+            }
+            packets.append(pPacket);
+        }
+
+        m_mutex.lock();
+        m_spillReaders--;
+        m_mutex.unlock();
+    }
+
+    packets += memoryPackets;
+    return packets;
+}
+
+void PacketBuffer::Write10SecFile(int64_t startTime, QString fileName)
+{
+    AVFormatContext*    pFormatCtx = NULL;
+    AVStream*           pStream = NULL;
+    AVCodecParameters*  pCodecParams = avcodec_parameters_alloc();
+    AVRational          inputTimeBase;
+
+    // Take references to required packets, so buffer can be updated while file is written
+    QVector<QSharedPointer<AVPacket> > packets = TakeSnapshot(startTime, 10000);
+
+    m_mutex.lock();
+    avcodec_parameters_copy(pCodecParams, m_pCodecParams);
+    inputTimeBase = m_inputTimeBase;
+    m_mutex.unlock();
+
+    if (packets.isEmpty()) // In theory we should never get here
     {
         ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StreamRecorder::PacketBuffer",
                        "Cannot write 10sec event file. I-frame before start position not found in circular buffer");
+        avcodec_parameters_free(&pCodecParams);
         return;
     }
 
@@ -359,6 +1027,7 @@ void PacketBuffer::Write10SecFile(int64_t startTime, QString fileName)
     {
         ERROR_MESSAGE0(ERR_TYPE_ERROR, "StreamRecorder::PacketBuffer",
                        "Cannot open format context for event video fragment file");
+        avcodec_parameters_free(&pCodecParams);
         return;
     }
 
@@ -368,6 +1037,8 @@ void PacketBuffer::Write10SecFile(int64_t startTime, QString fileName)
     {
         ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StreamRecorder::PacketBuffer",
                        "Cannot create video stream for event video fragment file");
+        avformat_free_context(pFormatCtx);
+        avcodec_parameters_free(&pCodecParams);
         return;
     }
 
@@ -376,12 +1047,19 @@ void PacketBuffer::Write10SecFile(int64_t startTime, QString fileName)
     pStream->time_base = av_make_q(1, DEFAULT_TIMEBASE);
 
     // Copy encoders parameters
-    avcodec_parameters_copy(pStream->codecpar, inputCodecParams);
+    avcodec_parameters_copy(pStream->codecpar, pCodecParams);
+    avcodec_parameters_free(&pCodecParams);
+
+    if (NULL != m_pParameterSets)
+    {
+        m_pParameterSets->ApplyTo(pStream->codecpar);
+    }
 
     if (0 > avio_open(&pFormatCtx->pb, fileName.toUtf8().constData(), AVIO_FLAG_WRITE))
     {
         ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StreamRecorder::PacketBuffer",
                        "Cannot open open avio for event video fragment file");
+        avformat_free_context(pFormatCtx);
         return;
     }
 
@@ -389,18 +1067,17 @@ void PacketBuffer::Write10SecFile(int64_t startTime, QString fileName)
     {
         ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StreamRecorder::PacketBuffer",
                        "Cannot write format header into event video fragment file");
+        avio_closep(&pFormatCtx->pb);
+        avformat_free_context(pFormatCtx);
         return;
     }
 
     // Write packets to file
-    int64_t firstDts = m_pPackets[packetIndex]->dts;
-    int64_t firstMillis = m_pPackets[packetIndex]->pos;
+    int64_t firstDts = packets[0]->dts;
 
-    FillSPSPPS(pStream->codecpar, m_pPackets[packetIndex].data());
-
-    while ((k--) && ((m_pPackets[packetIndex]->pos - firstMillis) < 10000))
+    for (int i = 0; i < packets.size(); i++)
     {
-        AVPacket* pPacket = av_packet_clone(m_pPackets[packetIndex].data());
+        AVPacket* pPacket = av_packet_clone(packets[i].data());
 
         pPacket->stream_index = 0;
         pPacket->dts -= firstDts;
@@ -414,16 +1091,18 @@ void PacketBuffer::Write10SecFile(int64_t startTime, QString fileName)
         {
             ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StreamRecorder::PacketBuffer",
                            "Error writing event fragment file: av_interleaved_write_frame() failed");
+            avio_closep(&pFormatCtx->pb);
             avformat_free_context(pFormatCtx);
             return;
         }
-        packetIndex = (packetIndex + 1) % m_bufferSize;
     }
 
     if (0 != av_write_trailer(pFormatCtx))
     {
         ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StreamRecorder::PacketBuffer",
                        "Error writing trailer to event fragment file av_write_trailer() failed");
+        avio_closep(&pFormatCtx->pb);
+        avformat_free_context(pFormatCtx);
         return;
     }
 
@@ -431,9 +1110,9 @@ void PacketBuffer::Write10SecFile(int64_t startTime, QString fileName)
     {
         ERROR_MESSAGE0(ERR_TYPE_DISPOSABLE, "StreamRecorder::PacketBuffer",
                        "Error while closing event fragment file avio_close() failed");
+        avformat_free_context(pFormatCtx);
         return;
     }
     avformat_free_context(pFormatCtx);
     return;
 }
-
@@ -2,36 +2,97 @@
 #define STREAMRECORDER_H
 
 #include <QDateTime>
+#include <QMap>
+#include <QSet>
+#include <QFile>
 #include <QQueue>
+#include <QMutex>
 #include <QObject>
 
 #include "networkUtils/dataDirectory.h"
 #include "cameraPipelineCommon.h"
+#include "archiveIndex.h"
+#include "archiveFileWriter.h"
 
-#define  PACKET_BUFFER_SECONDS  70  // Store 70 sec of video stream (for writing event fragment files)
+#define  PREROLL_SPILL_FILES    2   // Number of append-only files for spilled packets (rotated)
+#define  ARCHIVE_INDEX_SEGMENTS 3   // Number of last archive segments with keyframe index in memory
 
+/// Packet moved from memory to spill file
+struct SpilledPacket
+{
+    int64_t     pos;                    /// Server time (ms)
+    int64_t     pts;
+    int64_t     dts;
+    int64_t     duration;
+    int         flags;
+    int         size;
+    int         file;                   /// Spill file index
+    qint64      offset;                 /// Packet data offset in spill file
+};
+
+/// Archive keyframe, which is added to sidecar index when its fragment is in file
+struct PendingKeyframe
+{
+    int64_t         serverTime;
+    ArchiveKeyframe keyFrame;
+    qint64          fragmentEnd;        /// File offset after the last byte of fragment (-1 while it is muxed)
+};
+
+/*
+ * Buffer for last packets of video stream (for writing event fragment files)
+ * Packets are kept in memory within time and memory budgets and evicted by whole gops.
+ * Evicted gops can be spilled to local append-only files to get long pre-event history without RAM.
+ */
 class PacketBuffer
 {
 public:
-    PacketBuffer();
+    PacketBuffer(ParameterSetTracker* pParameterSets);
     ~PacketBuffer();
 
+    void  SetCodecParameters(AVStream* pVideoStream);
     void  AddPacket(QSharedPointer<AVPacket> pPacket);
     void  EnqueueWrite10SecFile(int64_t startTime, QString fileName);
 
-    QString errorString;
+    /// Copy references to packets from the last keyframe before startTime (ms) up to durationMs
+    QVector<QSharedPointer<AVPacket> > TakeSnapshot(int64_t startTime, int64_t durationMs);
 
-    AVCodecParameters* inputCodecParams;
-    AVRational         inputTimeBase;
+    QString errorString;
 
 private:
     QQueue<int64_t> m_startTimeQueue;
     QQueue<QString> m_fileNamesQueue;
-    QVector<QSharedPointer<AVPacket> > m_pPackets;
-
-    int         m_bufferSize;
-    int         m_packetsWritten;
-    int         m_currentIndex;
+    QList<QSharedPointer<AVPacket> > m_packets; /// Packets in memory
+    QMap<int64_t, int64_t>  m_keyFrames;        /// Keyframe packet sequence number -> server time (ms) (server time can jump)
+    QMutex                  m_mutex;            /// Packets are read from writer threads
+
+    AVCodecParameters*  m_pCodecParams;
+    AVRational          m_inputTimeBase;
+    ParameterSetTracker* m_pParameterSets;      /// Parameter sets of input stream
+
+    int64_t     m_firstSequence;                /// Sequence number of the first packet in memory
+    int64_t     m_packetsWritten;               /// Sequence number of the next packet
+    qint64      m_memoryBytes;                  /// Size of packets in memory
+    qint64      m_maxMemoryBytes;               /// Memory budget
+    int64_t     m_maxMemoryMs;                  /// Time budget
+    bool        m_memoryTruncated;              /// Memory budget is reached before time budget (reported once)
+
+    // Spill files
+    QList<SpilledPacket>    m_spilled;          /// Index of packets in spill files
+    int64_t     m_spilledFirstSequence;         /// Sequence number of m_spilled.first()
+    QFile       m_spillFiles[PREROLL_SPILL_FILES];
+    int64_t     m_spillFileStart[PREROLL_SPILL_FILES];  /// Time of the first packet in each file (-1 if empty)
+    int         m_currentSpillFile;             /// File for appending
+    int64_t     m_maxSpillMs;                   /// Spill time budget (0 - spill disabled)
+    qint64      m_spillBytes;
+    int         m_spillReaders;                 /// Files are not rotated, while snapshots are being read
+
+    void  EvictGop(int64_t nextKeySequence);
+    void  OpenSpillFiles();
+    bool  SpillPacket(const QSharedPointer<AVPacket>& pPacket, int64_t sequence);
+    void  RotateSpillFiles(int64_t gopStartTime);
+    void  DropSpilledPackets();
+    void  UpdateMetrics();
+    QSharedPointer<AVPacket> ReadSpilledPacket(QFile& file, const SpilledPacket& spilled);
 
     void Write10SecFile(int64_t startTime, QString fileName);
 };
@@ -43,14 +104,19 @@ public:
     StreamRecorder();
     ~StreamRecorder();
 
+    void    SetParameterSets(ParameterSetTracker* pParameterSets) { m_pParameterSets = pParameterSets; }
+
 signals:
     void    NewFileOpened(QString newFileName);     /// Inform subscribers about actual archive file name
+    void    EventArchived(EventDescription event);  /// Event with filled archive clip reference
     void    Ping(const char* name, int timeoutMs);  /// Ping signal for health checker
 
 public slots:
     void    CopyCodecParameters(AVStream *pVideoStream); /// Store input contexts parameters
     void    WritePacket(QSharedPointer<AVPacket> pInPacket);
     void    WriteEventFile(EventDescription event);
+    void    StartEventRecording(EventDescription event);    /// Open archive with pre-roll (event recording mode)
+    void    StopEventRecording(EventDescription event);     /// Schedule archive closing after post-roll
     void    Open();                             /// Init
     void    Close();                            /// Close current file and deinit
 
@@ -72,11 +138,34 @@ private:
     AVCodecParameters*  m_pCodecParams;         /// Codec parameters from VideoEncoder (for writing packets from packetBuffer)
     AVFormatContext*    m_pFormatCtx;           /// Output format context
     AVStream*           m_pVideoStream;         /// Video stream pointer
+    ParameterSetTracker* m_pParameterSets;      /// Parameter sets of input stream (owned by capture)
 
     PacketBuffer*       m_pPacketBuffer;        /// Small packet buffer for storing last minute of video stream
 
-    void  StartFile(QString startTime);         /// Open new file
+    ArchiveFileWriter*  m_pFileWriter;          /// Async archive output (NULL - default avio is used)
+    double              m_archiveBytesPerSec;   /// Observed archive bitrate (for segment preallocation)
+    int64_t             m_fileStartTime;        /// Server time of the first packet in current file
+    int64_t             m_lastPacketTime;       /// Server time of the last packet written to current file
+
+    QList<ArchiveSegmentIndex>  m_archiveIndex; /// Keyframe index for the last archive segments
+    ArchiveIndexWriter  m_indexWriter;          /// Sidecar index of current segment
+    bool                m_hasPendingKeyframe;   /// Fragment of m_pendingKeyframe is being muxed
+    PendingKeyframe     m_pendingKeyframe;
+    QQueue<PendingKeyframe> m_unwrittenKeyframes;   /// Muxed fragments, which are not in file yet
+
+    QSet<int>           m_activeEvents;         /// Events being recorded (event recording mode)
+    int64_t             m_recordUntil;          /// Server time (ms) of post-roll end
+
+    bool  IsRecording(int64_t packetTime);      /// Should packet be written to archive
+    void  WriteToFile(AVPacket* pInPacket);     /// Write packet to current archive file and update index
+    qint64 WrittenBytes();                      /// Size of data already in file (does not wait for writer)
+    void  AppendWrittenKeyframes();             /// Add keyframes of fragments, which are in file, to sidecar index
+
+    bool  FindArchiveReference(EventDescription& event);   /// Fill event clip reference from archive index
+
+    void  StartFile(QString startTime, AVPacket* pKeyPacket);  /// Open new file (starting from given keyframe)
     void  CloseFile();                          /// Close current file
+    void  AbortFile(QString fileName);          /// Release output and remove file, which failed to start
 };
 
 #endif // STREAMRECORDER_H
@@ -3,11 +3,16 @@
 #include <QDateTime>
 
 #include "videoAnalyzer.h"
+#include "pipelineMetrics.h"
 
 VideoAnalyzer::VideoAnalyzer(FrameCircularBuffer *pFrameBuffer) :
     QObject(NULL),
     m_pInputFrameBuffer(pFrameBuffer),
     m_pProcessingTimer(NULL),
+    m_adaptiveRate(false),
+    m_lastAnalyzedTime(-1.0),
+    m_lastActivityTime(0.0),
+    m_activeEvents(0),
     m_pObjectDetector(NULL),
     m_pMotionEstimator(NULL)
 {
@@ -34,11 +39,30 @@ void VideoAnalyzer::StartAnalyze()
     // Get fixed step to keep analysis fps as low as possible and save resources
     m_frameStep = 1;
     m_frameNumber = 0;
-    while (((double)pDataDirectory->pipelineParams.fps / (double)(m_frameStep + 1)) > 6.99)
+    while (((double)pDataDirectory->pipelineParams.fps / (double)(m_frameStep + 1)) > pDataDirectory->analysisParams.activeAnalysisFps - 0.01)
     {
         m_frameStep++;
     }
-    ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "VideoAnalyzer", "Every %d frame will be analyzed", m_frameStep);
+
+    // Adaptive rate starts from full rate and decays to idle rate in static scene
+    m_adaptiveRate = pDataDirectory->analysisParams.adaptiveFrameRate;
+    m_minIntervalSec = (double)m_frameStep / (double)std::max(1, pDataDirectory->pipelineParams.fps);
+    m_maxIntervalSec = std::max(m_minIntervalSec, 1.0 / std::max(0.1, pDataDirectory->analysisParams.idleAnalysisFps));
+    m_analysisIntervalSec = m_minIntervalSec;
+
+    // Idle rate and keyframe-only decoding (activity gate) are regular sampling, only longer breaks are gaps
+    m_timelineGapSec = std::max(std::max(ANALYSIS_TIMELINE_GAP_SEC, 2.0 * m_maxIntervalSec),
+                                (double)pDataDirectory->analysisParams.activityHoldSec);
+
+    if (m_adaptiveRate)
+    {
+        ERROR_MESSAGE2(ERR_TYPE_MESSAGE, "VideoAnalyzer", "Adaptive analysis rate from %.2f to %.2f fps",
+                       1.0 / m_maxIntervalSec, 1.0 / m_minIntervalSec);
+    }
+    else
+    {
+        ERROR_MESSAGE1(ERR_TYPE_MESSAGE, "VideoAnalyzer", "Every %d frame will be analyzed", m_frameStep);
+    }
 
 //    m_pProcessingTimer = new QTimer;
 //    m_pProcessingTimer->setTimerType(Qt::PreciseTimer);
@@ -75,6 +99,7 @@ void VideoAnalyzer::StopAnalyze()
 void VideoAnalyzer::DoAnalyze()
 {
     VideoFrame*     pCurrFrame = NULL;
+    float           frameWeight = 1.0f;
 
     DEBUG_MESSAGE1("VideoAnalyzer", "Analysis started, m_nextFrameTime = %f", m_nextFrameTime);
 
@@ -91,13 +116,14 @@ void VideoAnalyzer::DoAnalyze()
     // Send ping that analysis is alive and keeps reading frames
     emit Ping("VideoAnalyzer", HANG_TIMEOUT_MSEC);
 
-    // Analyze every n-th frame
-    if (pCurrFrame != NULL && ((++m_frameNumber % m_frameStep) == 0))
+    // Analyze every n-th frame (or according to current adaptive rate)
+    if (pCurrFrame != NULL && IsFrameToAnalyze(pCurrFrame, &frameWeight))
     {
         // Zero current results
         currentResults.timestamp = pCurrFrame->userTimestamp;
         currentResults.percentMotion = 0;
         currentResults.wasCalibrationError = 0;
+        currentResults.frameWeight = frameWeight;
         currentResults.pCurFlow = NULL;
         currentResults.pDiffBuffer = NULL;
         currentResults.objects.clear();
@@ -105,6 +131,11 @@ void VideoAnalyzer::DoAnalyze()
         // Main analysis here
         ProcessFrame(pCurrFrame);
 
+        if (m_adaptiveRate)
+        {
+            UpdateAnalysisRate(pCurrFrame);
+        }
+
         DEBUG_MESSAGE2("VideoAnalyzer",
                        "Analysis finished. FrameMotion = %f, Objects count = %d",
                        (float)currentResults.percentMotion,
@@ -119,3 +150,74 @@ void VideoAnalyzer::ProcessNewStats(QList<IntervalStatistics *> curStatsList)
 {
     Q_UNUSED(curStatsList);
 }
+
+void VideoAnalyzer::EventStarted(EventDescription event)
+{
+    Q_UNUSED(event);
+    m_activeEvents++;
+    m_analysisIntervalSec = m_minIntervalSec;
+}
+
+void VideoAnalyzer::EventFinished(EventDescription event)
+{
+    Q_UNUSED(event);
+    m_activeEvents = std::max(0, m_activeEvents - 1);
+}
+
+bool VideoAnalyzer::IsFrameToAnalyze(VideoFrame* pCurFrame, float* pWeight)
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+
+    *pWeight = 1.0f;
+
+    if (!m_adaptiveRate)
+    {
+        return ((++m_frameNumber % m_frameStep) == 0);
+    }
+
+    double elapsed = pCurFrame->nativeTimeInSeconds - m_lastAnalyzedTime;
+
+    // First frame or stream timeline restart
+    if (m_lastAnalyzedTime < 0.0 || elapsed < 0.0)
+    {
+        m_lastAnalyzedTime = pCurFrame->nativeTimeInSeconds;
+        m_lastActivityTime = pCurFrame->nativeTimeInSeconds;
+        return true;
+    }
+
+    // Half of source frame interval is tolerated for timestamps jitter
+    if (elapsed + 0.5 / std::max(1, pDataDirectory->pipelineParams.fps) < m_analysisIntervalSec)
+    {
+        return false;
+    }
+
+    // Sparse frame stands for all skipped full rate frames in interval statistics
+    // Stream gap (reconnect, stall) is not filled with this frame
+    if (elapsed <= m_timelineGapSec)
+    {
+        *pWeight = std::max(1.0f, (float)(elapsed / m_minIntervalSec));
+    }
+    m_lastAnalyzedTime = pCurFrame->nativeTimeInSeconds;
+
+    return true;
+}
+
+void VideoAnalyzer::UpdateAnalysisRate(VideoFrame* pCurFrame)
+{
+    DataDirectory*  pDataDirectory = DataDirectoryInstance::instance();
+    bool            isActive = (currentResults.percentMotion >= pDataDirectory->analysisParams.activityMotionPercent) ||
+                               !currentResults.objects.isEmpty() ||
+                               (m_activeEvents > 0);
+
+    if (isActive)
+    {
+        m_lastActivityTime = pCurFrame->nativeTimeInSeconds;
+        m_analysisIntervalSec = m_minIntervalSec;
+    }
+    else if (pCurFrame->nativeTimeInSeconds - m_lastActivityTime > pDataDirectory->analysisParams.activityHoldSec)
+    {
+        m_analysisIntervalSec = std::min(m_maxIntervalSec, m_analysisIntervalSec * ANALYSIS_RATE_DECAY);
+    }
+
+    PipelineMetrics::instance()->SetGauge("analysis_fps", 1.0 / m_analysisIntervalSec);
+}
@@ -13,6 +13,7 @@
 #include "motionAnalysis.h"
 #include "denoiseFilter.h"
 #include "frameCircularBuffer.h"
+#include "eventDescription.h"
 
 class VideoAnalyzer : public QObject
 {
@@ -32,6 +33,8 @@ public slots:
     void    StopAnalyze();                                                  /// Stop processing
     void    DoAnalyze();                                                    /// Main processing loop here
     void    ProcessNewStats(QList<IntervalStatistics *>  curStatsList);     /// For processing period stats
+    void    EventStarted(EventDescription event);                           /// Keep full analysis rate while event is open
+    void    EventFinished(EventDescription event);
 
 private:
     FrameCircularBuffer*    m_pInputFrameBuffer;    /// Pointer to buffer with input frames. Must be set from outside!
@@ -40,6 +43,16 @@ private:
     uint64_t                m_frameNumber;
     int                     m_frameStep;
 
+    // Adaptive analysis rate (native frame time is used for scheduling)
+    bool                    m_adaptiveRate;
+    double                  m_minIntervalSec;       /// Analysis interval at full rate
+    double                  m_maxIntervalSec;       /// Analysis interval in static scene
+    double                  m_analysisIntervalSec;  /// Current analysis interval
+    double                  m_timelineGapSec;       /// Longer time between analyzed frames is stream gap (frame weight is not extended)
+    double                  m_lastAnalyzedTime;     /// Native time of last analyzed frame (-1 if none)
+    double                  m_lastActivityTime;     /// Native time of last frame with activity
+    int                     m_activeEvents;         /// Number of currently open events
+
     VideoFrame              m_scaledPrevFrame;      /// Buffer for downscaled previous frame
     VideoBuffer             m_diffBuffer;           /// Buffer for difference calculation (downscaled, luma only)
 
@@ -49,6 +62,8 @@ private:
     MotionEstimator*        m_pMotionEstimator;     /// Motion estimator
 
     void ProcessFrame(VideoFrame* pCurFrame);    /// Processing algorithms here
+    bool IsFrameToAnalyze(VideoFrame* pCurFrame, float* pWeight);   /// Analysis scheduler (fixed or adaptive step)
+    void UpdateAnalysisRate(VideoFrame* pCurFrame);                 /// Ramp up on activity and decay in static scene
 };
 
 #endif // VIDEOANALYZER_H
@@ -1,8 +1,13 @@
 
 #include <string>
 #include <iostream>
+#include <signal.h>
 
+#include "reanalysis.h"
 #include "cameraPipeline.h"
+#include "pipelineMetrics.h"
+#include "archiveBenchmark.h"
+#include "dbstat/dbBenchmark.h"
 #include "networkUtils/dataDirectory.h"
 
 using namespace std;
@@ -11,13 +16,50 @@ int main(int argc, char *argv[])
 {
     QCoreApplication application(argc, argv);
 
-    QString cfgPath;
+    // Writes to closed sockets (sendfile() to disconnected HTTP clients) must fail with EPIPE,
+    // not terminate the process
+    signal(SIGPIPE, SIG_IGN);
+
+    QString     cfgPath;
+    QStringList reanalyzePaths;     /// Archive segments (or folders) for offline analysis
+    bool        dbBenchmark = false;
+    int         benchmarkEvents = 10000;
+    int         benchmarkDays = 3;
+    bool        archiveBenchmark = false;
+    int         benchmarkSizeMB = 1024;
 
     if(argc < 2)
         cfgPath = "theorem.conf";
     else
         cfgPath = QString(argv[1]);
 
+    // Usage: processInstance <config> --reanalyze <segment.mp4|folder> ...
+    if (argc > 3 && QString(argv[2]) == "--reanalyze")
+    {
+        for (int i = 3; i < argc; i++)
+        {
+            reanalyzePaths.append(QString(argv[i]));
+        }
+    }
+
+    // Usage: processInstance <config> --db-benchmark [events] [days]
+    if (argc > 2 && QString(argv[2]) == "--db-benchmark")
+    {
+        dbBenchmark = true;
+        if (argc > 3)
+            benchmarkEvents = QString(argv[3]).toInt();
+        if (argc > 4)
+            benchmarkDays = QString(argv[4]).toInt();
+    }
+
+    // Usage: processInstance <config> --archive-benchmark [megabytes]
+    if (argc > 2 && QString(argv[2]) == "--archive-benchmark")
+    {
+        archiveBenchmark = true;
+        if (argc > 3)
+            benchmarkSizeMB = QString(argv[3]).toInt();
+    }
+
     QSettings settings(cfgPath, QSettings::IniFormat);
 
     // Preparing data
@@ -30,6 +72,9 @@ int main(int argc, char *argv[])
     DataDirectory*  pDataDir = DataDirectoryInstance::instance();
     ErrorHandler*   pErrHandler = ErrorHandler::instance();
 
+    // Create metrics storage before pipeline threads are started
+    PipelineMetrics::instance();
+
     if (NULL == pDataDir)
     {
         printf("Data directory is not accessible via singleton class. Exiting");
@@ -42,6 +87,30 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+    // Configured DB backend throughput (no pipeline is started)
+    if (dbBenchmark)
+    {
+        return (CAMERA_PIPELINE_OK == DbBenchmark::Run(benchmarkEvents, qMax(1, benchmarkDays))) ? 0 : -1;
+    }
+
+    // Archive writer throughput on configured archive disk
+    if (archiveBenchmark)
+    {
+        return (CAMERA_PIPELINE_OK == ArchiveBenchmark::Run(qMax(1, benchmarkSizeMB))) ? 0 : -1;
+    }
+
+    // Offline analysis of archived segments instead of live pipeline
+    if (!reanalyzePaths.isEmpty())
+    {
+        ReanalysisRunner runner(reanalyzePaths, &application);
+
+        QObject::connect(&application, SIGNAL(aboutToQuit()), &runner, SLOT(Stop()));
+        QObject::connect(&runner, SIGNAL(Finished()), &application, SLOT(quit()));
+        QTimer::singleShot(0, &runner, SLOT(Start()));
+
+        return application.exec();
+    }
+
     // Starting camera pipeline
     CameraPipeline  pipeline(&application);
 
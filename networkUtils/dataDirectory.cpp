@@ -13,6 +13,7 @@ DataDirectory::DataDirectory(QSettings& settings) :
     analysisParams.readParameters(settings);
     pipelineParams.readParameters(settings);
     eventParams.readParameters(settings);
+    recordParams.readParameters(settings);
 
     mTcpServer = new QTcpServer();
     connect(mTcpServer, SIGNAL(newConnection()), this, SLOT(onTCPConnect()));
@@ -63,7 +64,11 @@ void DataDirectory::onTCPRead()
     if (!inJson.isEmpty())
     {
         QJsonObject object = inJson.object();
-        if (!object.isEmpty())
+        if (object.contains("command"))
+        {
+            emit commandReceived(object.toVariantMap());
+        }
+        else if (!object.isEmpty())
         {
             EventDescription descr;
             QVariantMap values = object.toVariantMap();
@@ -94,3 +99,13 @@ void DataDirectory::eventHandler(EventDescription eventDescription)
         mTcpSocket->write(out.append(QByteArray(4, 0)));
     }
 }
+
+void DataDirectory::sendCommandResponse(QVariantMap response)
+{
+    QJsonDocument doc = QJsonDocument::fromVariant(response);
+    if (NULL != mTcpSocket)
+    {
+        QByteArray out(doc.toJson(QJsonDocument::Compact));
+        mTcpSocket->write(out.append(QByteArray(4, 0)));
+    }
+}
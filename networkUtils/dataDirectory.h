@@ -20,12 +20,15 @@ public:
     CommonPipelineParameters     pipelineParams;
     AnalysisParameters           analysisParams;
     EventProcessingParameters    eventParams;
+    RecordingParameters          recordParams;
 
 public slots:
    void  eventHandler(EventDescription eventDescription);
+   void  sendCommandResponse(QVariantMap response);
 
 signals:
     void securityReactionEvent(EventDescription eventDescription);
+    void commandReceived(QVariantMap command);      /// Objects with "command" key (export requests etc.)
 
 private:
    // External communication
@@ -0,0 +1,111 @@
+#include <QUrl>
+#include <QList>
+
+#include "httpRequest.h"
+
+HttpRequest::HttpRequest()
+{
+
+}
+
+int HttpRequest::Parse(const QByteArray& data)
+{
+    int headerEnd = data.indexOf("\r\n\r\n");
+
+    if (headerEnd < 0)
+    {
+        return (data.size() > HTTP_MAX_HEADER_SIZE) ? -1 : 0;
+    }
+
+    QList<QByteArray> lines = data.left(headerEnd).split('\n');
+    QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+
+    if (requestLine.size() != 3)
+    {
+        return -1;
+    }
+
+    method = requestLine[0];
+    version = requestLine[2];
+
+    QUrl url(QString::fromLatin1(requestLine[1]));
+    if (!url.isValid())
+    {
+        return -1;
+    }
+    path = url.path();
+    query = QUrlQuery(url);
+
+    headers.clear();
+    Q_FOREACH (const QByteArray& line, lines)
+    {
+        int separator = line.indexOf(':');
+        if (separator > 0)
+        {
+            headers.insert(line.left(separator).trimmed().toLower(), line.mid(separator + 1).trimmed());
+        }
+    }
+
+    return headerEnd + 4;
+}
+
+QByteArray HttpRequest::Header(const char* name) const
+{
+    return headers.value(QByteArray(name));
+}
+
+bool HttpRequest::KeepAlive() const
+{
+    QByteArray connection = Header("connection").toLower();
+
+    if (version == "HTTP/1.0")
+    {
+        return (connection == "keep-alive");
+    }
+    return (connection != "close");
+}
+
+QByteArray HttpRequest::ResponseHeader(int code,
+                                       const char* contentType,
+                                       qint64 contentLength,
+                                       bool keepAlive,
+                                       const QByteArray& extraHeaders)
+{
+    const char* status;
+
+    switch (code)
+    {
+        case 200: status = "OK"; break;
+        case 206: status = "Partial Content"; break;
+        case 400: status = "Bad Request"; break;
+        case 403: status = "Forbidden"; break;
+        case 404: status = "Not Found"; break;
+        case 405: status = "Method Not Allowed"; break;
+        case 416: status = "Range Not Satisfiable"; break;
+        case 503: status = "Service Unavailable"; break;
+        default:  status = "Internal Server Error"; break;
+    }
+
+    QByteArray header = "HTTP/1.1 " + QByteArray::number(code) + " " + status + "\r\n";
+
+    header += "Content-Type: ";
+    header += contentType;
+    header += "\r\n";
+
+    // Negative length means that response body will be sent with chunked transfer encoding
+    if (contentLength < 0)
+    {
+        header += "Transfer-Encoding: chunked\r\n";
+    }
+    else
+    {
+        header += "Content-Length: " + QByteArray::number(contentLength) + "\r\n";
+    }
+
+    header += "Access-Control-Allow-Origin: *\r\n";
+    header += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    header += extraHeaders;
+    header += "\r\n";
+
+    return header;
+}
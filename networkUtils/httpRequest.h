@@ -0,0 +1,40 @@
+#ifndef HTTPREQUEST_H
+#define HTTPREQUEST_H
+
+#include <QMap>
+#include <QString>
+#include <QUrlQuery>
+#include <QByteArray>
+
+#define  HTTP_MAX_HEADER_SIZE   (16*1024)   // Requests with longer headers are rejected
+
+/*
+ * Minimal HTTP/1.x request header parser for small built-in servers
+ * Only request line and headers are parsed, request body is not supported
+ */
+class HttpRequest
+{
+public:
+    HttpRequest();
+
+    /// Returns number of bytes consumed by request header, 0 if header is incomplete and -1 on error
+    int         Parse(const QByteArray& data);
+
+    QByteArray  Header(const char* name) const;     /// Header value by lowercase name (empty if not present)
+    bool        KeepAlive() const;                  /// Should connection stay open after response
+
+    /// Create response status line and headers (terminated with empty line)
+    static QByteArray ResponseHeader(int code,
+                                     const char* contentType,
+                                     qint64 contentLength,
+                                     bool keepAlive,
+                                     const QByteArray& extraHeaders = QByteArray());
+
+    QByteArray                  method;
+    QString                     path;           /// Decoded path without query
+    QUrlQuery                   query;
+    QByteArray                  version;
+    QMap<QByteArray, QByteArray> headers;       /// Header names are lowercase
+};
+
+#endif // HTTPREQUEST_H
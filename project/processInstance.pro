@@ -6,6 +6,7 @@ QT += sql
 QT += opengl
 QT += testlib
 QT += websockets
+QT += concurrent
 
 INCLUDEPATH += ../
 INCLUDEPATH += ../CameraPipeline
@@ -27,19 +28,36 @@ HEADERS += \
     ../CameraPipeline/cameraPipelineCommon.h \
     ../CameraPipeline/videoAnalyzer.h \
     ../CameraPipeline/streamRecorder.h \
+    ../CameraPipeline/archiveIndex.h \
+    ../CameraPipeline/archiveFileWriter.h \
+    ../CameraPipeline/archiveBenchmark.h \
+    ../CameraPipeline/clipExporter.h \
+    ../CameraPipeline/archiveHttpServer.h \
+    ../CameraPipeline/reanalysis.h \
     ../CameraPipeline/cameraPipeline.h \
     ../CameraPipeline/resultVideoOutput.h \
+    ../CameraPipeline/hlsServer.h \
+    ../CameraPipeline/pipelineMetrics.h \
+    ../CameraPipeline/metricsServer.h \
     ../CameraPipeline/decisionMaker.h \
     ../CameraPipeline/dbstat/analysisRecordModel.h \
     ../CameraPipeline/dbstat/analysisRecordSQliteDao.h \
     ../CameraPipeline/dbstat/intervalStatistics.h \
+    ../CameraPipeline/dbstat/statisticsBlob.h \
+    ../CameraPipeline/dbstat/statisticsCache.h \
+    ../CameraPipeline/dbstat/dbAccessScheduler.h \
+    ../CameraPipeline/dbstat/dbWriter.h \
+    ../CameraPipeline/dbstat/analysisRecordPostgresDao.h \
+    ../CameraPipeline/dbstat/analysisRecordEmbeddedDao.h \
+    ../CameraPipeline/dbstat/dbBenchmark.h \
     ../videoAnalysis/objectDetector.h \
     ../videoAnalysis/multimodalBG.h \
     ../videoAnalysis/motionAnalysis.h \
     ../videoAnalysis/motionTypes.h \
     ../videoAnalysis/videoScaler.h \
     ../videoAnalysis/denoiseFilter.h \
-    ../networkUtils/dataDirectory.h
+    ../networkUtils/dataDirectory.h \
+    ../networkUtils/httpRequest.h
 
 SOURCES += \
     ../main_pi.cpp \
@@ -56,17 +74,34 @@ SOURCES += \
     ../CameraPipeline/videoProcessingFunctions.cpp \
     ../CameraPipeline/cameraPipeline.cpp \
     ../CameraPipeline/streamRecorder.cpp \
+    ../CameraPipeline/archiveIndex.cpp \
+    ../CameraPipeline/archiveFileWriter.cpp \
+    ../CameraPipeline/archiveBenchmark.cpp \
+    ../CameraPipeline/clipExporter.cpp \
+    ../CameraPipeline/archiveHttpServer.cpp \
+    ../CameraPipeline/reanalysis.cpp \
     ../CameraPipeline/resultVideoOutput.cpp \
+    ../CameraPipeline/hlsServer.cpp \
+    ../CameraPipeline/pipelineMetrics.cpp \
+    ../CameraPipeline/metricsServer.cpp \
     ../CameraPipeline/decisionMaker.cpp \
     ../CameraPipeline/dbstat/analysisRecordModel.cpp \
     ../CameraPipeline/dbstat/analysisRecordSQliteDao.cpp \
     ../CameraPipeline/dbstat/intervalStatistics.cpp \
+    ../CameraPipeline/dbstat/statisticsBlob.cpp \
+    ../CameraPipeline/dbstat/statisticsCache.cpp \
+    ../CameraPipeline/dbstat/dbAccessScheduler.cpp \
+    ../CameraPipeline/dbstat/dbWriter.cpp \
+    ../CameraPipeline/dbstat/analysisRecordPostgresDao.cpp \
+    ../CameraPipeline/dbstat/analysisRecordEmbeddedDao.cpp \
+    ../CameraPipeline/dbstat/dbBenchmark.cpp \
     ../videoAnalysis/objectDetector.cpp \
     ../videoAnalysis/multimodalBG.cpp \
     ../videoAnalysis/motionAnalysis.cpp \
     ../videoAnalysis/denoiseFilter.cpp \
     ../videoAnalysis/videoScaler.cpp \
-    ../networkUtils/dataDirectory.cpp
+    ../networkUtils/dataDirectory.cpp \
+    ../networkUtils/httpRequest.cpp
 
 QMAKE_CXXFLAGS += -std=gnu++11
 
@@ -159,7 +159,7 @@ void MotionMap::Reset()
     m_frameNumber = 0;
 }
 
-void MotionMap::AverageMV(MotionBin_t* pBin, mv_t& curMV)
+void MotionMap::AverageMV(MotionBin_t* pBin, mv_t& curMV, float weight)
 {
     const int SuspiciousMVThreshold = 20.0f;
 
@@ -174,14 +174,14 @@ void MotionMap::AverageMV(MotionBin_t* pBin, mv_t& curMV)
         {
             pBin->mvx = (pBin->mvx + curMV.x) / 2.0f;
             pBin->mvy = (pBin->mvy + curMV.y) / 2.0f;
-            pBin->height += 1.0f;
+            pBin->height += weight;
         }
     }
     else
     {
         pBin->mvx = (pBin->mvx + curMV.x) / 2.0f;
         pBin->mvy = (pBin->mvy + curMV.y) / 2.0f;
-        pBin->height += 1.0f;
+        pBin->height += weight;
     }
 }
 
@@ -216,7 +216,7 @@ MotionBin_t* MotionMap::GetBinByDirection(int p, int direction)
     return NULL; // Should never get here
 }
 
-void MotionMap::Update(MotionFlow *pCurFlow)
+void MotionMap::Update(MotionFlow *pCurFlow, float weight)
 {
     int p;
     int s;
@@ -233,6 +233,11 @@ void MotionMap::Update(MotionFlow *pCurFlow)
     {
         mv_t         curMV = pCurFlow->pVectors[p];
         MotionBin_t* pBins = m_pModel[p].bins;
+
+        // Flow between distant frames is proportionally longer, so it is normalized to single frame interval
+        curMV.x /= weight;
+        curMV.y /= weight;
+
         int          curDirection = GetDirectionIdx(curMV.x, curMV.y);
 
         if (curDirection >= 0)
@@ -242,7 +247,7 @@ void MotionMap::Update(MotionFlow *pCurFlow)
                 //try to associate the current vector direction values to an existing bin
                 if (curDirection == pBins[s].directionIdx)
                 {
-                    AverageMV(&pBins[s], curMV);
+                    AverageMV(&pBins[s], curMV, weight);
 
                     // Keep bins sorted by height
                     idx = s;
@@ -261,39 +266,53 @@ void MotionMap::Update(MotionFlow *pCurFlow)
 
 void MotionMap::CopyFrom(MotionMap* pMap)
 {
-    MotionModel_t*  pInModelPtr = pMap->GetModelPtr();
+    CopyFrom(pMap->GetModelPtr(), pMap->GetWidth(), pMap->GetHeight(), pMap->GetBlockSize());
+}
 
-    if ((pMap->GetBlocksCount() != m_blocksCount) || (pMap->GetBlockSize() != m_blockSize))
+void MotionMap::CopyFrom(const MotionModel_t* pModel, int width, int height, int blockSize)
+{
+    if ((width*height != m_blocksCount) || (blockSize != m_blockSize))
     {
-        Init(pMap->GetWidth(), pMap->GetHeight(), pMap->GetBlockSize());
+        Init(width, height, blockSize);
     }
 
-    memcpy(m_pModel, pInModelPtr, m_blocksCount*sizeof(MotionModel_t));
+    if (NULL != pModel)
+    {
+        memcpy(m_pModel, pModel, m_blocksCount*sizeof(MotionModel_t));
+    }
 }
 
 void MotionMap::AddMap(MotionMap *pMap, float weight)
+{
+    AddMap(pMap->GetModelPtr(), pMap->GetWidth(), pMap->GetHeight(), pMap->GetBlockSize(), weight);
+}
+
+void MotionMap::AddMap(const MotionModel_t* pInModelPtr, int width, int height, int blockSize, float weight)
 {
     int p;
     int s1;
     int s2;
 
-    if ((pMap->GetBlocksCount() != m_blocksCount) || (pMap->GetBlockSize() != m_blockSize))
+    if ((width*height != m_blocksCount) || (blockSize != m_blockSize))
     {
         ERROR_MESSAGE4(ERR_TYPE_WARNING, "MotionMap",
                        "Different buffer size in AddMap() (%dx%d) (%dx%d). Init() will be called",
                        m_width, m_height,
-                       pMap->GetWidth(),
-                       pMap->GetHeight());
+                       width,
+                       height);
 
-        Init(pMap->GetWidth(), pMap->GetHeight(), pMap->GetBlockSize());
+        Init(width, height, blockSize);
     }
 
-    MotionModel_t* pInModelPtr = pMap->GetModelPtr();
+    if (NULL == pInModelPtr)
+    {
+        return;
+    }
 
     for (p = 0; p < m_blocksCount; p++)
     {
-        MotionBin_t* pBins1 = m_pModel[p].bins;
-        MotionBin_t* pBins2 = pInModelPtr[p].bins;
+        MotionBin_t*        pBins1 = m_pModel[p].bins;
+        const MotionBin_t*  pBins2 = pInModelPtr[p].bins;
 
         for (s1 = 0; s1 < MAX_MV_SAMPLES; s1++)
         {
@@ -304,9 +323,13 @@ void MotionMap::AddMap(MotionMap *pMap, float weight)
                 {
                     if (fabs(pBins2[s2].mvx) > 0.5f || fabs(pBins2[s2].mvy) > 0.5f)
                     {
-                        pBins1[s1].mvx = (fabs(pBins1[s1].mvx) > 0.0f) ? (pBins1[s1].mvx + pBins2[s2].mvx) / 2.0f : pBins2[s2].mvx;
-                        pBins1[s1].mvy = (fabs(pBins1[s1].mvy) > 0.0f) ? (pBins1[s1].mvy + pBins2[s2].mvy) / 2.0f : pBins2[s2].mvy;
-                        pBins1[s1].height = pBins1[s1].height + pBins2[s2].height * weight;
+                        // Negative weight removes previously added map (only heights, vectors are kept)
+                        if (weight > 0.0f)
+                        {
+                            pBins1[s1].mvx = (fabs(pBins1[s1].mvx) > 0.0f) ? (pBins1[s1].mvx + pBins2[s2].mvx) / 2.0f : pBins2[s2].mvx;
+                            pBins1[s1].mvy = (fabs(pBins1[s1].mvy) > 0.0f) ? (pBins1[s1].mvy + pBins2[s2].mvy) / 2.0f : pBins2[s2].mvy;
+                        }
+                        pBins1[s1].height = std::max(0.0f, pBins1[s1].height + pBins2[s2].height * weight);
                     }
                     break;
                 }
@@ -327,6 +350,22 @@ void MotionMap::AddMap(MotionMap *pMap, float weight)
     }
 }
 
+void MotionMap::Scale(float scale)
+{
+    if (m_pModel == NULL)
+    {
+        return;
+    }
+
+    for (int p = 0; p < m_blocksCount; p++)
+    {
+        for (int i = 0; i < MAX_MV_SAMPLES; i++)
+        {
+            m_pModel[p].bins[i].height *= scale;
+        }
+    }
+}
+
 void MotionMap::SwapMotionBins(int p, int idx1, int idx2)
 {
     MotionBin_t  tmp;
@@ -487,14 +526,29 @@ void MotionMap::ToByteArray(QByteArray* bytes)
     bytes->append((char *)m_pModel, m_blocksCount*sizeof(MotionModel_t));
 }
 
-void MotionMap::FromDataStream(QDataStream& in)
+bool MotionMap::FromDataStream(QDataStream& in)
 {
+    int width = 0;
+    int height = 0;
+    int blockSize = 0;
+
     // Background buffer size and data
-    in.readRawData((char *)&(m_width), sizeof(m_width));
-    in.readRawData((char *)&(m_height), sizeof(m_height));
-    in.readRawData((char *)&(m_blockSize), sizeof(m_blockSize));
-    Init(m_width, m_height, m_blockSize);
-    in.readRawData((char*)m_pModel, m_blocksCount*sizeof(MotionModel_t));
+    in.readRawData((char *)&(width), sizeof(width));
+    in.readRawData((char *)&(height), sizeof(height));
+    in.readRawData((char *)&(blockSize), sizeof(blockSize));
+
+    // Sizes are checked against stream length before allocation
+    if ((in.status() != QDataStream::Ok) ||
+        (width < 0) || (height < 0) || (blockSize < 0) || (blockSize > MAX_ME_BLOCK_SIZE) ||
+        ((width*(qint64)height > 0) && (0 == blockSize)) ||
+        (width*(qint64)height*(qint64)sizeof(MotionModel_t) > in.device()->bytesAvailable()))
+    {
+        Init(0, 0, 0);
+        return false;
+    }
+
+    Init(width, height, blockSize);
+    return (in.readRawData((char*)m_pModel, m_blocksCount*sizeof(MotionModel_t)) == (int)(m_blocksCount*sizeof(MotionModel_t)));
 }
 
 
@@ -4,6 +4,7 @@
 #include <QDataStream>
 
 #define     ME_BLOCK_SIZE           8
+#define     MAX_ME_BLOCK_SIZE       64      // Sanity limit for stored motion maps
                                             // Attention!
 #define     MAX_MV_SAMPLES          8       // Requires manually hardcoded direction table!!!!!
                                             // Do not change without need
@@ -54,12 +55,15 @@ public:
     ~MotionMap();
 
     void    Reset();
-    void    Update(MotionFlow* pCurFlow);
+    void    Update(MotionFlow* pCurFlow, float weight = 1.0f);   /// Weight - number of frames between flow frames
     void    CopyFrom(MotionMap* pMap);
+    void    CopyFrom(const MotionModel_t* pModel, int width, int height, int blockSize);
     void    AddMap(MotionMap* pMap, float weight = 1.0f);
+    void    AddMap(const MotionModel_t* pInModelPtr, int width, int height, int blockSize, float weight = 1.0f);
+    void    Scale(float scale);                                  /// Scale bins heights (motion vectors are not changed)
     void    DrawMotionMap(VideoBuffer *pRes, int index, float scale);
     void    ToByteArray(QByteArray* bytes);
-    void    FromDataStream(QDataStream& in);
+    bool    FromDataStream(QDataStream& in);                     /// False if stored map is damaged (map is empty then)
     float   CompareWith(MotionFlow* pCurFlow, VideoBuffer* pResultMask);
     int     CheckObject(MotionFlow *pCurFlow, int *decision, float* confidence, int x, int y, int w, int h);
 
@@ -84,7 +88,7 @@ private:
 
     void    Init(int width, int height, int blockSize);
     void    SwapMotionBins(int p, int idx1, int idx2);
-    void    AverageMV(MotionBin_t *pBin, mv_t &curMV);
+    void    AverageMV(MotionBin_t *pBin, mv_t &curMV, float weight);
     int     CheckVelocity(MotionBin_t *pBin, mv_t curMV, float *confidence);
 
     MotionBin_t* GetBinByDirection(int p, int direction);